@@ -24,289 +24,796 @@
 
 
 /* ---------------- Inclusions ----------------- */
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/crc.h>
 #include <libopencm3/stm32/f4/nvic.h>
 
+#include "rtos.h"
 #include "eeprom.h"
 
 
 /* ---------------- Local Defines ----------------- */
 
-/* EEPROM address */
+/* EEPROM address: device of the default context */
 #define EEPROM_ADDRESS				0
 
-/* Address byte to send */
-#define ADDRESS_BYTE				((uint8_t)(0x50 | EEPROM_ADDRESS))
+/* Device address: the address pins of the device and the block select
+ * bits, the memory address bits beyond the memory address bytes */
+#define ADDRESS_BYTE(device, address)	((uint8_t)(0x50 | ((device) << EEPROM_BLOCK_BITS) \
+										| (((uint32_t)(address) >> (8 * EEPROM_ADDRESS_BYTES)) \
+										   & ((1u << EEPROM_BLOCK_BITS) - 1))))
+
+/* I2C peripherals: I2C1, I2C2 and I2C3 */
+#define EEPROM_BUSES				3
+
+/* DMA controller serving the I2C peripherals */
+#define EEPROM_DMA					DMA1
+
+/* Shortest data phase moved by DMA: single byte reads need the
+ * NACK/STOP sequence before ADDR clearing, so they stay on the CPU */
+#define EEPROM_DMA_MIN_LENGTH		2
+
+/* Hook executed while a blocking function waits for the transfer engine.
+ * Empty on target: the engine is driven by the I2C interrupts. */
+#ifndef EEPROM_CFG_IDLE_HOOK
+#define EEPROM_CFG_IDLE_HOOK()
+#endif
+
+/* RTOS callback pacing the block writes during the device write cycle */
+#define EEPROM_WRITE_CB_ID			RTOS_CFG_CB_ID_EEPROM
+
+/* Write cycle predictor: first guess (datasheet tWR), bounds of the
+ * prediction and of the back-off between probes, give up time */
+#define EEPROM_TWR_DEFAULT_US		5000
+#define EEPROM_TWR_MIN_US			500
+#define EEPROM_TWR_BACKOFF_MIN_US	100
+#define EEPROM_TWR_BACKOFF_MAX_US	1600
+#define EEPROM_TWR_TIMEOUT_US		20000
+
+/* Moving average weight (1/8) and prediction shortening (1/16) when the
+ * device is ready at the first probe */
+#define EEPROM_TWR_AVG_SHIFT		3
+#define EEPROM_TWR_SHRINK_SHIFT		4
+
+/* Record CRC of the reads computed by the CRC unit, one 32-bit word every
+ * four bytes, the last bytes by the software table. 0: software only. */
+#ifndef EEPROM_CFG_CRC_HW
+#define EEPROM_CFG_CRC_HW			1
+#endif
+
+/* CRC-32/MPEG-2 initial value: reset value of the CRC unit */
+#define EEPROM_CRC_INIT				0xFFFFFFFFu
+
+/* Gap between two segments of a vector read read through and dropped:
+ * cheaper than the START and address frames of a new read */
+#define EEPROM_READV_GAP_MAX		4
+
+/* Buffers of a vector transfer: the segments and the gaps between them */
+#define EEPROM_IOV_PIECES			(2 * EEPROM_IOV_MAX)
+
+/* I2C error flags cleared by the error interrupt */
+#define I2C_SR1_ERR_MASK			(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF \
+									| I2C_SR1_OVR | I2C_SR1_PECERR | I2C_SR1_TIMEOUT)
 
 
 /* ---------------- Local Macros ----------------- */
 
+/* Compiler barrier: the performance counters are written between the two
+ * sequence updates, and read between the two sequence reads */
+#define PERF_BARRIER()		__asm__ volatile ("" ::: "memory")
+
+
+
+
+/* ------------- Local typedef definitions ------------- */
+
+/* Transfer engine states */
+enum {
+	XFER_ST_IDLE,			/* no transfer ongoing */
+	XFER_ST_START,			/* START sent, waiting for SB */
+	XFER_ST_ADDR_WR,		/* device address + W sent, waiting for ADDR */
+	XFER_ST_TX,				/* sending memory address and data bytes */
+	XFER_ST_RESTART,		/* repeated START sent, waiting for SB */
+	XFER_ST_ADDR_RD,		/* device address + R sent, waiting for ADDR */
+	XFER_ST_RX				/* receiving data bytes */
+};
+
+/* Transfer types */
+enum {
+	XFER_WRITE,				/* memory address + data bytes */
+	XFER_READ,				/* memory address, repeated START, data bytes */
+	XFER_PROBE,				/* device address only (ACK polling) */
+	XFER_CHECKSUM,			/* read fed to the CRC, stored if a buffer is given */
+	XFER_RECORD,			/* checksum read of the data, then of its CRC */
+	XFER_COMPARE			/* read compared to the buffer, cut at the first difference */
+};
+
+/* Non-blocking block write states */
+enum {
+	BLOCK_ST_IDLE,			/* no block write ongoing */
+	BLOCK_ST_WRITE,			/* page write on the bus */
+	BLOCK_ST_CYCLE,			/* device in its write cycle: poll at next tick */
+	BLOCK_ST_PROBE,			/* ACK polling on the bus */
+	BLOCK_ST_NEXT			/* device ready: write next page at next tick */
+};
+
+/* I2C peripheral resources */
+typedef struct {
+	uint32_t i2c;				/* peripheral */
+	enum rcc_periph_clken rcc;	/* peripheral clock */
+	uint8_t ev_irq;				/* event interrupt */
+	uint8_t er_irq;				/* error interrupt */
+	uint8_t dma_rx_stream;		/* DMA1 streams and channel of the peripheral */
+	uint8_t dma_tx_stream;
+	uint32_t dma_channel;
+	uint8_t dma_rx_irq;			/* DMA1 stream interrupts */
+	uint8_t dma_tx_irq;
+} bus_hw_t;
+
+/* Caller buffer moved by the data phase of a gather/scatter transfer */
+typedef struct {
+	uint8_t *data_ptr;			/* first byte */
+	uint16_t data_length;		/* bytes, not 0 */
+} piece_t;
+
+/* Bus context: configuration and state of the transfers of one bus */
+struct eeprom_ctx {
+	eeprom_bus_cfg_t cfg;		/* bus configuration */
+	const bus_hw_t *hw;			/* peripheral resources, NULL before init */
+
+	/* Transfer descriptor shared between the API and the I2C interrupts */
+	struct {
+		volatile uint8_t state;		/* engine state */
+		volatile uint8_t status;	/* result of the last transfer */
+		uint8_t type;				/* write, read or probe */
+		uint8_t device;				/* address pins of the device */
+		uint8_t address_byte;		/* device address with the block select bits */
+		eeprom_addr_t address;		/* memory address */
+		uint8_t mem_address[EEPROM_ADDRESS_BYTES];	/* memory address bytes, MSB first */
+		uint8_t mem_address_index;	/* next memory address byte to send */
+		uint8_t *data_ptr;			/* next data byte */
+		uint16_t data_length;		/* remaining data bytes */
+		uint8_t *buffer_ptr;		/* first data byte */
+		uint16_t buffer_length;		/* data bytes requested */
+		const piece_t *pieces;		/* buffers of a gather/scatter transfer, NULL for one */
+		uint8_t piece_count;		/* buffers of a gather/scatter transfer */
+		const piece_t *piece_ptr;	/* buffer of the next data byte */
+		uint16_t piece_left;		/* bytes left in this buffer */
+		bool dma;					/* data phase moved by DMA */
+		bool block;					/* page or probe of the block write */
+		eeprom_cb_ptr_t cb_ptr;		/* completion callback */
+		uint16_t crc_length;		/* data bytes still to feed to the CRC */
+		bool crc_hw;				/* CRC unit claimed by the transfer */
+		uint32_t crc;				/* running CRC */
+		uint32_t crc_word;			/* bytes waiting for the CRC unit, MSB first */
+		uint8_t crc_word_bytes;		/* bytes in crc_word */
+		uint32_t crc_trailer;		/* CRC read after the record data */
+		bool compare_diff;			/* compare read: difference found */
+		uint16_t compare_offset;	/* compare read: first different byte */
+		uint32_t start_cycles;		/* DWT cycle counter at the START request */
+		uint32_t stop_spins;		/* loops waiting for the previous STOP */
+		uint32_t events;			/* event interrupts served */
+	} xfer;
+
+	/* Performance counters, written by end_transfer only, from the
+	 * interrupts. Readers copy them while the sequence stays the same even
+	 * value: an odd one marks an update in progress. */
+	struct {
+		volatile uint32_t seq;		/* update sequence */
+		eeprom_perf_stats_t stats;	/* counters */
+	} perf;
+
+	/* Observer of the completed writes */
+	eeprom_write_hook_t write_hook_ptr;
+
+	/* Non-blocking block write descriptor */
+	struct {
+		volatile uint8_t state;		/* block write state */
+		eeprom_addr_t address;		/* address of the current page chunk */
+		uint8_t *data_ptr;			/* data of the current page chunk */
+		uint16_t data_length;		/* remaining data bytes */
+		uint16_t chunk_size;		/* bytes of the current page chunk */
+		eeprom_cb_ptr_t cb_ptr;		/* completion callback */
+	} block;
+
+	/* Write cycle predictor: the write cycle is learned from all the devices
+	 * of the bus, which are the same part, and followed for each of them */
+	struct {
+		eeprom_twr_stats_t stats;	/* learned write cycle and polling counters */
+		struct {
+			volatile bool pending;	/* write cycle not yet seen over */
+			bool first_probe;		/* no probe NACKed since the write */
+			uint32_t start_cycles;	/* DWT cycle counter at the end of the write */
+			uint32_t nack_us;		/* elapsed time at the last NACKed probe */
+		} dev[EEPROM_DEVICES];
+	} twr;
+
+	/* Internal address counter of each device of the bus: a read starting
+	 * where the last one stopped is sent as a current address read */
+	struct {
+		bool valid;				/* counter known */
+		eeprom_addr_t address;	/* next byte the device sends */
+	} cursor[EEPROM_DEVICES];
+};
+
 
 
 
 /* ----------- Local variables declaration ------------- */
 
+/* I2C peripheral resources, by bus index. The DMA1 streams do not overlap,
+ * so the three buses can use DMA at the same time. */
+static const bus_hw_t bus_hw[EEPROM_BUSES] = {
+	{I2C1, RCC_I2C1, NVIC_I2C1_EV_IRQ, NVIC_I2C1_ER_IRQ,
+	 DMA_STREAM0, DMA_STREAM6, DMA_SxCR_CHSEL_1, NVIC_DMA1_STREAM0_IRQ, NVIC_DMA1_STREAM6_IRQ},
+	{I2C2, RCC_I2C2, NVIC_I2C2_EV_IRQ, NVIC_I2C2_ER_IRQ,
+	 DMA_STREAM3, DMA_STREAM7, DMA_SxCR_CHSEL_7, NVIC_DMA1_STREAM3_IRQ, NVIC_DMA1_STREAM7_IRQ},
+	{I2C3, RCC_I2C3, NVIC_I2C3_EV_IRQ, NVIC_I2C3_ER_IRQ,
+	 DMA_STREAM2, DMA_STREAM4, DMA_SxCR_CHSEL_3, NVIC_DMA1_STREAM2_IRQ, NVIC_DMA1_STREAM4_IRQ}
+};
+
+/* libopencm3 bus speeds, by EEPROM_SPEED_x */
+static const enum i2c_speeds i2c_speeds_array[] = {
+	i2c_speed_sm_100k,
+	i2c_speed_fm_400k,
+	i2c_speed_fmp_1m
+};
+
+/* Performance counters operation type, by transfer type */
+static const uint8_t perf_ops_array[] = {
+	EEPROM_PERF_WRITE,		/* XFER_WRITE */
+	EEPROM_PERF_READ,		/* XFER_READ */
+	EEPROM_PERF_PROBE,		/* XFER_PROBE */
+	EEPROM_PERF_CHECK,		/* XFER_CHECKSUM */
+	EEPROM_PERF_CHECK,		/* XFER_RECORD */
+	EEPROM_PERF_CHECK		/* XFER_COMPARE */
+};
+
+/* Bus contexts, by bus index */
+static eeprom_ctx_t bus_ctx[EEPROM_BUSES];
+
+/* Context of the single device functions */
+static eeprom_ctx_t *default_ctx = &bus_ctx[0];
+
+#if EEPROM_CFG_CRC_HW
+/* Context of the transfer using the CRC unit */
+static eeprom_ctx_t *volatile crc_owner = NULL;
+#endif
+
+/* CRC-32/MPEG-2 table: polynomial 0x04C11DB7, MSB first as the CRC unit */
+static const uint32_t crc_table[256] = {
+	0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9,
+	0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+	0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61,
+	0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
+	0x4C11DB70, 0x48D0C6C7, 0x4593E01E, 0x4152FDA9,
+	0x5F15ADAC, 0x5BD4B01B, 0x569796C2, 0x52568B75,
+	0x6A1936C8, 0x6ED82B7F, 0x639B0DA6, 0x675A1011,
+	0x791D4014, 0x7DDC5DA3, 0x709F7B7A, 0x745E66CD,
+	0x9823B6E0, 0x9CE2AB57, 0x91A18D8E, 0x95609039,
+	0x8B27C03C, 0x8FE6DD8B, 0x82A5FB52, 0x8664E6E5,
+	0xBE2B5B58, 0xBAEA46EF, 0xB7A96036, 0xB3687D81,
+	0xAD2F2D84, 0xA9EE3033, 0xA4AD16EA, 0xA06C0B5D,
+	0xD4326D90, 0xD0F37027, 0xDDB056FE, 0xD9714B49,
+	0xC7361B4C, 0xC3F706FB, 0xCEB42022, 0xCA753D95,
+	0xF23A8028, 0xF6FB9D9F, 0xFBB8BB46, 0xFF79A6F1,
+	0xE13EF6F4, 0xE5FFEB43, 0xE8BCCD9A, 0xEC7DD02D,
+	0x34867077, 0x30476DC0, 0x3D044B19, 0x39C556AE,
+	0x278206AB, 0x23431B1C, 0x2E003DC5, 0x2AC12072,
+	0x128E9DCF, 0x164F8078, 0x1B0CA6A1, 0x1FCDBB16,
+	0x018AEB13, 0x054BF6A4, 0x0808D07D, 0x0CC9CDCA,
+	0x7897AB07, 0x7C56B6B0, 0x71159069, 0x75D48DDE,
+	0x6B93DDDB, 0x6F52C06C, 0x6211E6B5, 0x66D0FB02,
+	0x5E9F46BF, 0x5A5E5B08, 0x571D7DD1, 0x53DC6066,
+	0x4D9B3063, 0x495A2DD4, 0x44190B0D, 0x40D816BA,
+	0xACA5C697, 0xA864DB20, 0xA527FDF9, 0xA1E6E04E,
+	0xBFA1B04B, 0xBB60ADFC, 0xB6238B25, 0xB2E29692,
+	0x8AAD2B2F, 0x8E6C3698, 0x832F1041, 0x87EE0DF6,
+	0x99A95DF3, 0x9D684044, 0x902B669D, 0x94EA7B2A,
+	0xE0B41DE7, 0xE4750050, 0xE9362689, 0xEDF73B3E,
+	0xF3B06B3B, 0xF771768C, 0xFA325055, 0xFEF34DE2,
+	0xC6BCF05F, 0xC27DEDE8, 0xCF3ECB31, 0xCBFFD686,
+	0xD5B88683, 0xD1799B34, 0xDC3ABDED, 0xD8FBA05A,
+	0x690CE0EE, 0x6DCDFD59, 0x608EDB80, 0x644FC637,
+	0x7A089632, 0x7EC98B85, 0x738AAD5C, 0x774BB0EB,
+	0x4F040D56, 0x4BC510E1, 0x46863638, 0x42472B8F,
+	0x5C007B8A, 0x58C1663D, 0x558240E4, 0x51435D53,
+	0x251D3B9E, 0x21DC2629, 0x2C9F00F0, 0x285E1D47,
+	0x36194D42, 0x32D850F5, 0x3F9B762C, 0x3B5A6B9B,
+	0x0315D626, 0x07D4CB91, 0x0A97ED48, 0x0E56F0FF,
+	0x1011A0FA, 0x14D0BD4D, 0x19939B94, 0x1D528623,
+	0xF12F560E, 0xF5EE4BB9, 0xF8AD6D60, 0xFC6C70D7,
+	0xE22B20D2, 0xE6EA3D65, 0xEBA91BBC, 0xEF68060B,
+	0xD727BBB6, 0xD3E6A601, 0xDEA580D8, 0xDA649D6F,
+	0xC423CD6A, 0xC0E2D0DD, 0xCDA1F604, 0xC960EBB3,
+	0xBD3E8D7E, 0xB9FF90C9, 0xB4BCB610, 0xB07DABA7,
+	0xAE3AFBA2, 0xAAFBE615, 0xA7B8C0CC, 0xA379DD7B,
+	0x9B3660C6, 0x9FF77D71, 0x92B45BA8, 0x9675461F,
+	0x8832161A, 0x8CF30BAD, 0x81B02D74, 0x857130C3,
+	0x5D8A9099, 0x594B8D2E, 0x5408ABF7, 0x50C9B640,
+	0x4E8EE645, 0x4A4FFBF2, 0x470CDD2B, 0x43CDC09C,
+	0x7B827D21, 0x7F436096, 0x7200464F, 0x76C15BF8,
+	0x68860BFD, 0x6C47164A, 0x61043093, 0x65C52D24,
+	0x119B4BE9, 0x155A565E, 0x18197087, 0x1CD86D30,
+	0x029F3D35, 0x065E2082, 0x0B1D065B, 0x0FDC1BEC,
+	0x3793A651, 0x3352BBE6, 0x3E119D3F, 0x3AD08088,
+	0x2497D08D, 0x2056CD3A, 0x2D15EBE3, 0x29D4F654,
+	0xC5A92679, 0xC1683BCE, 0xCC2B1D17, 0xC8EA00A0,
+	0xD6AD50A5, 0xD26C4D12, 0xDF2F6BCB, 0xDBEE767C,
+	0xE3A1CBC1, 0xE760D676, 0xEA23F0AF, 0xEEE2ED18,
+	0xF0A5BD1D, 0xF464A0AA, 0xF9278673, 0xFDE69BC4,
+	0x89B8FD09, 0x8D79E0BE, 0x803AC667, 0x84FBDBD0,
+	0x9ABC8BD5, 0x9E7D9662, 0x933EB0BB, 0x97FFAD0C,
+	0xAFB010B1, 0xAB710D06, 0xA6322BDF, 0xA2F33668,
+	0xBCB4666D, 0xB8757BDA, 0xB5365D03, 0xB1F740B4
+};
+
 
 
 
 /* ----------- Local functions prototypes ------------- */
 
+static uint16_t page_length(eeprom_addr_t, uint16_t);
+static bool start_transfer(eeprom_ctx_t *, uint8_t, uint8_t, eeprom_addr_t, uint8_t *, uint16_t, bool, eeprom_cb_ptr_t);
+static bool start_pieces(eeprom_ctx_t *, uint8_t, uint8_t, eeprom_addr_t, const piece_t *, uint8_t, bool, eeprom_cb_ptr_t);
+static uint8_t run_transfer(eeprom_ctx_t *, uint8_t, uint8_t, eeprom_addr_t, uint8_t *, uint16_t);
+static uint8_t run_pieces(eeprom_ctx_t *, uint8_t, uint8_t, eeprom_addr_t, const piece_t *, uint8_t);
+static void end_transfer(eeprom_ctx_t *, uint8_t);
+static void perf_end(eeprom_ctx_t *, uint8_t);
+static void data_next(eeprom_ctx_t *);
+static void rx_byte(eeprom_ctx_t *, uint8_t);
+static bool iov_sort(const eeprom_iovec_t *, uint8_t, uint8_t *);
+static uint32_t crc_step(uint32_t, uint8_t);
+static void crc_byte(eeprom_ctx_t *, uint8_t);
+static void crc_end(eeprom_ctx_t *);
+static void dma_start(eeprom_ctx_t *, uint8_t, uint32_t, uint8_t *, uint16_t);
+static void dma_stop(eeprom_ctx_t *);
+static void block_write_page(eeprom_ctx_t *);
+static void block_page_done(eeprom_ctx_t *, uint8_t);
+static void block_probe_done(eeprom_ctx_t *, uint8_t);
+static void block_end(eeprom_ctx_t *, uint8_t);
+static void block_tick(void);
+static uint32_t twr_elapsed_us(eeprom_ctx_t *, uint8_t);
+static void twr_delay_us(uint32_t);
+static void twr_probe_done(eeprom_ctx_t *, uint8_t, uint8_t);
+static enum rcc_periph_clken gpio_clock(uint32_t);
+static void ev_isr(eeprom_ctx_t *);
+static void er_isr(eeprom_ctx_t *);
+static void dma_rx_isr(eeprom_ctx_t *);
+static void dma_tx_isr(eeprom_ctx_t *);
+
 
 
 
 /* ------------- Exported functions implementation --------------- */
 
-/* Function to init EEPROM driver and I2C peripheral */
+/* Function to init EEPROM driver and I2C peripheral in the default mode */
 void eeprom_init(void)
 {
-	i2c_peripheral_disable(I2C1);
-	/* Enable GPIOB clock. */
-	rcc_periph_clock_enable(RCC_GPIOB);
-	/* Alternate Function: I2C1 */
-	gpio_set_af(GPIOB, GPIO_AF4,  GPIO6 | GPIO7);
-	/* set I2C1_SCL and I2C1_SDA, external pull-up resistors */
-	gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO6 | GPIO7);
+	eeprom_init_mode(EEPROM_MODE_IRQ);
+}
+
+
+/* Function to init EEPROM driver and I2C peripheral: the default context,
+ * I2C1 on PB6/PB7 at EEPROM_CFG_SPEED, used by the single device functions */
+void eeprom_init_mode(uint8_t mode)
+{
+	eeprom_bus_cfg_t cfg = {
+		I2C1, GPIOB, GPIO6, GPIOB, GPIO7,
+		EEPROM_CFG_SPEED, mode, EEPROM_ADDRESS
+	};
+
+	(void)eeprom_ctx_init(&cfg);
+}
+
+
+/* Function to init the default context in the default mode at another bus
+ * speed, e.g. to compare the speeds. Return false on an invalid speed. */
+bool eeprom_init_speed(uint8_t speed)
+{
+	eeprom_bus_cfg_t cfg = {
+		I2C1, GPIOB, GPIO6, GPIOB, GPIO7,
+		speed, EEPROM_MODE_IRQ, EEPROM_ADDRESS
+	};
+
+	return (NULL != eeprom_ctx_init(&cfg));
+}
+
+
+/* Function to init a bus context and its I2C peripheral. In DMA mode page
+ * writes and reads of two bytes or more move their data phase with DMA1,
+ * straight from/to the caller buffer. Each bus has its own transfer engine,
+ * so the contexts of different buses run their transfers concurrently.
+ * Return NULL if the configuration is not valid. */
+eeprom_ctx_t *eeprom_ctx_init(const eeprom_bus_cfg_t *cfg_ptr)
+{
+	eeprom_ctx_t *ctx;
+	uint8_t bus = 0;
+	uint8_t i;
+
+	while ((bus < EEPROM_BUSES)
+	&& (bus_hw[bus].i2c != cfg_ptr->i2c)) {
+		bus++;
+	}
+
+	if ((bus >= EEPROM_BUSES)
+	|| (cfg_ptr->device >= EEPROM_DEVICES)
+	|| (cfg_ptr->speed > EEPROM_SPEED_1M)) {
+		return NULL;
+	}
+
+	ctx = &bus_ctx[bus];
+	if (NULL == ctx->hw) {
+		/* first init of the bus: the predictor starts from the datasheet,
+		 * a new init keeps what it has learned */
+		ctx->twr.stats.twr_avg_us = EEPROM_TWR_DEFAULT_US;
+		for (i = 0; i < EEPROM_DEVICES; i++) {
+			ctx->twr.dev[i].pending = false;
+		}
+		ctx->xfer.state = XFER_ST_IDLE;
+		ctx->xfer.status = EEPROM_ST_IDLE;
+		ctx->block.state = BLOCK_ST_IDLE;
+	}
+	/* the devices may have been power cycled */
+	for (i = 0; i < EEPROM_DEVICES; i++) {
+		ctx->cursor[i].valid = false;
+	}
+	ctx->cfg = *cfg_ptr;
+	ctx->hw = &bus_hw[bus];
+
+	/* time base of the write cycle predictor */
+	dwt_enable_cycle_counter();
+
+	i2c_peripheral_disable(ctx->hw->i2c);
+	/* Enable GPIO clocks. */
+	rcc_periph_clock_enable(gpio_clock(ctx->cfg.scl_port));
+	rcc_periph_clock_enable(gpio_clock(ctx->cfg.sda_port));
+	/* Alternate Function: I2C */
+	gpio_set_af(ctx->cfg.scl_port, GPIO_AF4, ctx->cfg.scl_pin);
+	gpio_set_af(ctx->cfg.sda_port, GPIO_AF4, ctx->cfg.sda_pin);
+	/* set SCL and SDA, external pull-up resistors */
+	gpio_mode_setup(ctx->cfg.scl_port, GPIO_MODE_AF, GPIO_PUPD_NONE, ctx->cfg.scl_pin);
+	gpio_mode_setup(ctx->cfg.sda_port, GPIO_MODE_AF, GPIO_PUPD_NONE, ctx->cfg.sda_pin);
 	/* Open Drain, Speed 100 MHz */
-	gpio_set_output_options(GPIOB, GPIO_OTYPE_OD, GPIO_OSPEED_100MHZ, GPIO6 | GPIO7);
-
-	/* Enable I2C1 clock. */
-	rcc_periph_clock_enable(RCC_I2C1);
-	/* Enable I2C1 interrupt. */
-	nvic_enable_irq(NVIC_I2C1_EV_IRQ);
-	/* reset I2C1 */
-	i2c_reset(I2C1);
+	gpio_set_output_options(ctx->cfg.scl_port, GPIO_OTYPE_OD, GPIO_OSPEED_100MHZ, ctx->cfg.scl_pin);
+	gpio_set_output_options(ctx->cfg.sda_port, GPIO_OTYPE_OD, GPIO_OSPEED_100MHZ, ctx->cfg.sda_pin);
+
+	/* Enable I2C clock. */
+	rcc_periph_clock_enable(ctx->hw->rcc);
+	/* Enable I2C event and error interrupts. */
+	nvic_enable_irq(ctx->hw->ev_irq);
+	nvic_enable_irq(ctx->hw->er_irq);
+	/* reset I2C */
+	i2c_reset(ctx->hw->i2c);
 	/* standard mode */
-	i2c_set_standard_mode(I2C1);
+	i2c_set_standard_mode(ctx->hw->i2c);
 	/* clock and bus frequencies */
-	i2c_set_speed( I2C1, i2c_speed_fm_400k, rcc_apb1_frequency / 1e6 );
-	/* enable error event interrupt only */
-	i2c_enable_interrupt(I2C1, I2C_CR2_ITERREN);
+	i2c_set_speed(ctx->hw->i2c, i2c_speeds_array[ctx->cfg.speed], rcc_apb1_frequency / 1e6);
+	/* enable error event interrupt only: event interrupts are enabled
+	 * for the duration of each transfer */
+	i2c_enable_interrupt(ctx->hw->i2c, I2C_CR2_ITERREN);
 	/* enable I2C */
-	i2c_peripheral_enable(I2C1);
+	i2c_peripheral_enable(ctx->hw->i2c);
+
+#if EEPROM_CFG_CRC_HW
+	/* Enable CRC clock. */
+	rcc_periph_clock_enable(RCC_CRC);
+#endif
+
+	if (EEPROM_MODE_DMA == ctx->cfg.mode) {
+		/* Enable DMA1 clock and transfer complete interrupts. */
+		rcc_periph_clock_enable(RCC_DMA1);
+		nvic_enable_irq(ctx->hw->dma_rx_irq);
+		nvic_enable_irq(ctx->hw->dma_tx_irq);
+	}
+
+	return ctx;
 }
 
 
-/* Function to write a byte at a specific address */
-bool eeprom_write_byte(uint16_t address, uint8_t data)
+/* Function to get the context of the single device functions */
+eeprom_ctx_t *eeprom_default_ctx(void)
 {
-	bool success = false;
+	return default_ctx;
+}
 
-	/* send START and wait for completion */
-	i2c_send_start(I2C1);
-	while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
 
-	/* send device address, r/w request and wait for completion */
-	i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_WRITE);
-	while ((I2C_SR1(I2C1) & (I2C_SR1_ADDR|I2C_SR1_AF)) == 0);
-	bool ack = (I2C_SR1(I2C1) & I2C_SR1_ADDR) != 0; /* has the slave responded?  */
+/* Function to start writing a page starting from a specific address.
+ * The callback is called from the I2C interrupt at the end of the transfer.
+ * Return false if the engine is busy. */
+bool eeprom_ctx_write_page_async(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	data_length = page_length(address, data_length);
+
+	return start_transfer(ctx, XFER_WRITE, ctx->cfg.device, address, data_ptr, data_length, false, cb_ptr);
+}
 
-	/* check SR2 and go on if OK */
-	if (ack && (I2C_SR2(I2C1) & I2C_SR2_MSL)		/* master mode */
-	        && (I2C_SR2(I2C1) & I2C_SR2_BUSY)) {	/* communication ongoing  */
 
-		/* send memory address MSB */
-		i2c_send_data(I2C1, ((uint8_t)(address >> 8)));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
+/* Function to start reading a page starting from a specific address.
+ * The callback is called from the I2C interrupt at the end of the transfer.
+ * Return false if the engine is busy or the length is not valid. */
+bool eeprom_ctx_read_page_async(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	bool success = false;
 
-		/* send memory address LSB */
-		i2c_send_data(I2C1, ((uint8_t)address));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
+	data_length = page_length(address, data_length);
 
-		/* send data byte */
-		i2c_send_data(I2C1, data);
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
-		success = true;
+	if (data_length > 0) {
+		success = start_transfer(ctx, XFER_READ, ctx->cfg.device, address, byte_ptr, data_length, false, cb_ptr);
 	}
-	/* send stop */
-	i2c_send_stop(I2C1);
-	while ((I2C_SR2(I2C1) & (I2C_SR2_BUSY | I2C_SR2_MSL)) != 0);
 
 	return success;
 }
 
 
-/* Function to write a page starting from a specific address */
-bool eeprom_write_page(uint16_t address, uint8_t *data_ptr, uint16_t data_length)
+/* Function to start a sequential read of any length starting from a
+ * specific address: a single transaction, wrapping at the end of the array.
+ * The callback is called from the I2C interrupt at the end of the transfer.
+ * Return false if the engine is busy or the length is not valid. */
+bool eeprom_ctx_read_block_async(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
 {
 	bool success = false;
 
-	/* make sure we don't cross the page boundary */
-	uint16_t start_of_next_page = (address & ~PAGE_MASK) + PAGE_SIZE;
-	if( address + data_length > start_of_next_page )
-		data_length = start_of_next_page - address;
+	if (data_length > 0) {
+		success = start_transfer(ctx, XFER_READ, ctx->cfg.device, address, byte_ptr, data_length, false, cb_ptr);
+	}
+
+	return success;
+}
 
-	/* send START and wait for completion */
-	i2c_send_start(I2C1);
-	while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
 
-	/* send device address, r/w request and wait for completion */
-	i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_WRITE);
-	while ((I2C_SR1(I2C1) & (I2C_SR1_ADDR|I2C_SR1_AF)) == 0);
-	bool ack = (I2C_SR1(I2C1) & I2C_SR1_ADDR) != 0; /* has the slave responded?  */
+/* Function to start addressing the device without any data (ACK polling).
+ * The callback receives EEPROM_ST_DONE if the device has acknowledged. */
+bool eeprom_ctx_probe_async(eeprom_ctx_t *ctx, eeprom_cb_ptr_t cb_ptr)
+{
+	return start_transfer(ctx, XFER_PROBE, ctx->cfg.device, 0, NULL, 0, false, cb_ptr);
+}
+
 
-	/* check SR2 and go on if OK */
-	if (ack && (I2C_SR2(I2C1) & I2C_SR2_MSL)	/* master mode */
-	        && (I2C_SR2(I2C1) & I2C_SR2_BUSY)) {	/* communication ongoing  */
+/* Function to start writing any length starting from a specific address
+ * without blocking: the device write cycle after each page is waited by
+ * RTOS callbacks, so the tasks keep their period during long writes.
+ * The callback is called from the I2C interrupt when the last page is
+ * committed or on the first failure. The data shall stay valid until then.
+ * Return false if a block write is ongoing or the length is not valid. */
+bool eeprom_ctx_write_block_async(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	bool success = false;
 
-		/* send memory address MSB */
-		i2c_send_data(I2C1, ((uint8_t)(address >> 8)));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
+	if ((BLOCK_ST_IDLE == ctx->block.state)
+	&& (data_length > 0)) {
+		ctx->block.address = address;
+		ctx->block.data_ptr = data_ptr;
+		ctx->block.data_length = data_length;
+		ctx->block.cb_ptr = cb_ptr;
 
-		/* send memory address LSB */
-		i2c_send_data(I2C1, ((uint8_t)address));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
+		/* the tick callback picks up the block if the engine is busy now */
+		ctx->block.state = BLOCK_ST_NEXT;
+		rtos_set_callback(EEPROM_WRITE_CB_ID, RTOS_CB_TYPE_SINGLE, 0, &block_tick);
+		block_write_page(ctx);
 
-		/* write all bytes */
-		while (data_length > 0) {
-			/* send next data byte */
-			i2c_send_data(I2C1, *data_ptr);
-			/* increment data buffer pointer and
-			 * decrement data buffer length */
-			data_ptr++;
-			data_length--;
-			while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
-		}
 		success = true;
 	}
-	/* send stop */
-	i2c_send_stop(I2C1);
-	while ((I2C_SR2(I2C1) & (I2C_SR2_BUSY | I2C_SR2_MSL)) != 0);
 
 	return success;
 }
 
 
-/* Function to write a byte at a specific address */
-bool eeprom_read_byte(uint16_t address, uint8_t *byte_ptr)
+/* Function to know if a non-blocking block write is ongoing */
+bool eeprom_ctx_write_block_busy(eeprom_ctx_t *ctx)
 {
-	bool success = false;
-
-	/* send START and wait for completion */
-	i2c_send_start(I2C1);
-	while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
+	return (BLOCK_ST_IDLE != ctx->block.state);
+}
 
-	/* send device address, write request and wait for completion */
-	i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_WRITE);
-	while ((I2C_SR1(I2C1) & (I2C_SR1_ADDR|I2C_SR1_AF)) == 0);
-	bool ack = (I2C_SR1(I2C1) & I2C_SR1_ADDR) != 0; /* has the slave responded?  */
 
-	/* check SR2 and go on if OK */
-	if (ack && (I2C_SR2(I2C1) & I2C_SR2_MSL)	/* master mode */
-	        && (I2C_SR2(I2C1) & I2C_SR2_BUSY)) {	/* communication ongoing  */
+/* Function to wait for the end of the device write cycle. The first probe
+ * is sent when the predicted write cycle is over, later ones are spaced
+ * by a growing back-off, so the bus stays free for other devices.
+ * Return false if the device does not answer within the timeout. */
+bool eeprom_ctx_wait_ready(eeprom_ctx_t *ctx)
+{
+	return eeprom_ctx_dev_wait_ready(ctx, ctx->cfg.device);
+}
 
-		/* send memory address MSB */
-		i2c_send_data(I2C1, ((uint8_t)(address >> 8)));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
 
-		/* send memory address LSB */
-		i2c_send_data(I2C1, ((uint8_t)address));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
+/* Function to wait for the end of the write cycle of a device, see
+ * eeprom_wait_ready. The other devices keep their write cycles meanwhile. */
+bool eeprom_ctx_dev_wait_ready(eeprom_ctx_t *ctx, uint8_t device)
+{
+	uint32_t backoff_us = EEPROM_TWR_BACKOFF_MIN_US;
+	uint32_t elapsed_us;
+	uint8_t status = EEPROM_ST_DONE;
 
-		/* send START and wait for completion */
-		i2c_send_start(I2C1);
-		while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
+	if (device >= EEPROM_DEVICES) {
+		return false;
+	}
 
-		/* send device address, read request and wait for completion */
-		i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_READ);
-		while ((I2C_SR1(I2C1) & I2C_SR1_ADDR) == 0);
+	if (ctx->twr.dev[device].pending) {
+		elapsed_us = twr_elapsed_us(ctx, device);
+		if (elapsed_us < ctx->twr.stats.twr_avg_us) {
+			twr_delay_us(ctx->twr.stats.twr_avg_us - elapsed_us);
+		}
 
-		/* if communication ongoing  */
-		if (I2C_SR2(I2C1) & I2C_SR2_BUSY) {
-			/* read received byte */
-			while ((I2C_SR1(I2C1) & I2C_SR1_RxNE) == 0);
-			*byte_ptr = i2c_get_data(I2C1);
-			success = true;
+		status = run_transfer(ctx, XFER_PROBE, device, 0, NULL, 0);
+		twr_probe_done(ctx, device, status);
+		while ((EEPROM_ST_NACK == status)
+		&& (ctx->twr.dev[device].nack_us < EEPROM_TWR_TIMEOUT_US)) {
+			/* device still busy in its internal write cycle */
+			twr_delay_us(backoff_us);
+			if (backoff_us < EEPROM_TWR_BACKOFF_MAX_US) {
+				backoff_us <<= 1;
+			}
+			status = run_transfer(ctx, XFER_PROBE, device, 0, NULL, 0);
+			twr_probe_done(ctx, device, status);
 		}
+		/* do not wait again for a device that did not answer */
+		ctx->twr.dev[device].pending = false;
 	}
-	/* send stop */
-	i2c_send_stop(I2C1);
-	while ((I2C_SR2(I2C1) & (I2C_SR2_BUSY | I2C_SR2_MSL)) != 0);
 
-	return success;
+	return (EEPROM_ST_DONE == status);
+}
+
+
+/* Function to get the write cycle predictor statistics */
+void eeprom_ctx_get_twr_stats(eeprom_ctx_t *ctx, eeprom_twr_stats_t *stats_ptr)
+{
+	*stats_ptr = ctx->twr.stats;
+}
+
+
+/* Function to get the performance counters of a bus with no interrupt
+ * masking: the copy is taken again if a transfer ended meanwhile. It may
+ * be called from the task or from a completion callback. */
+void eeprom_ctx_get_perf_stats(eeprom_ctx_t *ctx, eeprom_perf_stats_t *stats_ptr)
+{
+	uint32_t seq;
+
+	do {
+		seq = ctx->perf.seq;
+		PERF_BARRIER();
+		*stats_ptr = ctx->perf.stats;
+		PERF_BARRIER();
+	} while (((seq & 1) != 0) || (seq != ctx->perf.seq));
+}
+
+
+/* Function to clear the performance counters of a bus */
+void eeprom_ctx_reset_perf_stats(eeprom_ctx_t *ctx)
+{
+	uint32_t irq_mask;
+
+	/* the interrupts are masked for the clear only: a reader sees the
+	 * sequence move */
+	irq_mask = cm_mask_interrupts(1);
+	ctx->perf.seq++;
+	PERF_BARRIER();
+	memset(&ctx->perf.stats, 0, sizeof(ctx->perf.stats));
+	PERF_BARRIER();
+	ctx->perf.seq++;
+	cm_mask_interrupts(irq_mask);
+}
+
+
+/* Function to register the observer of the completed writes, e.g. a
+ * cache that shall stay coherent with the device */
+void eeprom_ctx_set_write_hook(eeprom_ctx_t *ctx, eeprom_write_hook_t hook_ptr)
+{
+	ctx->write_hook_ptr = hook_ptr;
+}
+
+
+/* Function to get the status of the transfer engine */
+uint8_t eeprom_ctx_get_status(eeprom_ctx_t *ctx)
+{
+	return ctx->xfer.status;
+}
+
+
+/* Function to write a byte at a specific address */
+bool eeprom_ctx_write_byte(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t data)
+{
+	return (EEPROM_ST_DONE == run_transfer(ctx, XFER_WRITE, ctx->cfg.device, address, &data, 1));
+}
+
+
+/* Function to write a page starting from a specific address */
+bool eeprom_ctx_write_page(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	/* make sure we don't cross the page boundary */
+	data_length = page_length(address, data_length);
+
+	return (EEPROM_ST_DONE == run_transfer(ctx, XFER_WRITE, ctx->cfg.device, address, data_ptr, data_length));
+}
+
+
+/* Function to read a byte at a specific address */
+bool eeprom_ctx_read_byte(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr)
+{
+	return (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, ctx->cfg.device, address, byte_ptr, 1));
 }
 
 
 /* Function to read a page starting from a specific address */
-bool eeprom_read_page(uint16_t address, uint8_t *byte_ptr, uint16_t data_length)
+bool eeprom_ctx_read_page(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
 {
 	bool success = false;
 
 	/* make sure we don't cross the page boundary */
-	uint16_t start_of_next_page = (address & ~PAGE_MASK) + PAGE_SIZE;
-	if( address + data_length > start_of_next_page )
-		data_length = start_of_next_page - address;
-
-	/* send START and wait for completion */
-	i2c_send_start(I2C1);
-	while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
-
-	/* send device address, write request and wait for completion */
-	i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_WRITE);
-	while ((I2C_SR1(I2C1) & (I2C_SR1_ADDR|I2C_SR1_AF)) == 0);
-	bool ack = (I2C_SR1(I2C1) & I2C_SR1_ADDR) != 0; /* has the slave responded?  */
-
-	/* check SR2 and go on if OK */
-	if (ack && (I2C_SR2(I2C1) & I2C_SR2_MSL)	/* master mode */
-	        && (I2C_SR2(I2C1) & I2C_SR2_BUSY)) {	/* communication ongoing  */
-
-		/* send memory address MSB */
-		i2c_send_data(I2C1, ((uint8_t)(address >> 8)));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
-
-		/* send memory address LSB */
-		i2c_send_data(I2C1, ((uint8_t)address));
-		while ((I2C_SR1(I2C1) & I2C_SR1_TxE) == 0);
-
-		/* send START and wait for completion */
-		i2c_send_start(I2C1);
-		while ((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
-
-		/* send device address, read request and wait for completion */
-		i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_READ);
-		while ((I2C_SR1(I2C1) & I2C_SR1_ADDR) == 0);
-
-		/* if communication ongoing  */
-		if (I2C_SR2(I2C1) & I2C_SR2_BUSY) {
-			/* enable ACK */
-			i2c_enable_ack(I2C1);
-			/* read all bytes */
-			while (data_length > 0) {
-				/* read received byte */
-				while ((I2C_SR1(I2C1) & I2C_SR1_RxNE) == 0);
-				*byte_ptr = i2c_get_data(I2C1);
-				/* increment data buffer pointer and
-				 * decrement data buffer length */
-				byte_ptr++;
-				data_length--;
-				/* if last byte is remaining */
-				if (data_length == 1) {
-					/* disable ACK */
-					i2c_disable_ack(I2C1);
-				}
-			}
-			success = true;
-		}
+	data_length = page_length(address, data_length);
+
+	if (data_length > 0) {
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, ctx->cfg.device, address, byte_ptr, data_length));
+	}
+
+	return success;
+}
+
+/* Function to write a page of a device of the bus without waiting for its
+ * write cycle, so that another device can be written meanwhile */
+bool eeprom_ctx_dev_write_page(eeprom_ctx_t *ctx, uint8_t device, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	bool success = false;
+
+	data_length = page_length(address, data_length);
+
+	if (device < EEPROM_DEVICES) {
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_WRITE, device, address, data_ptr, data_length));
+	}
+
+	return success;
+}
+
+
+/* Function to read any length from a device of the bus with a single
+ * sequential read */
+bool eeprom_ctx_dev_read_block(eeprom_ctx_t *ctx, uint8_t device, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	bool success = (device < EEPROM_DEVICES);
+
+	if (success && (data_length > 0)) {
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, device, address, byte_ptr, data_length));
+	}
+
+	return success;
+}
+
+/* Function to read any length starting from a specific address with a
+ * single sequential read: the device address counter crosses the page
+ * boundaries, so the address phase is paid once per block */
+bool eeprom_ctx_read_block(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	bool success = true;
+
+	if (data_length > 0) {
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, ctx->cfg.device, address, byte_ptr, data_length));
 	}
-	/* send stop */
-	i2c_send_stop(I2C1);
-	while ((I2C_SR2(I2C1) & (I2C_SR2_BUSY | I2C_SR2_MSL)) != 0);
 
 	return success;
 }
 
-bool eeprom_read_block(uint16_t address, uint8_t *byte_ptr, uint16_t data_length)
+bool eeprom_ctx_write_block(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
 {
 	while( data_length > 0 )
 	{
-		int chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		uint16_t chunk_size = PAGE_SIZE - (address & PAGE_MASK);
 		if( chunk_size > data_length )
 			chunk_size = data_length;
-		if( !eeprom_read_page( address, byte_ptr, chunk_size ) )
+		if( !eeprom_ctx_write_page(ctx, address, byte_ptr, chunk_size ) )
+			return false;
+
+		/* wait for eeprom to become responsive again */
+		if( !eeprom_ctx_wait_ready(ctx) )
 			return false;
+
 		address += chunk_size;
 		byte_ptr += chunk_size;
 		data_length -= chunk_size;
@@ -314,48 +821,1403 @@ bool eeprom_read_block(uint16_t address, uint8_t *byte_ptr, uint16_t data_length
 	return true;
 }
 
-bool eeprom_write_block(uint16_t address, uint8_t *byte_ptr, uint16_t data_length)
+
+/* Function to write any length starting from a specific address, skipping
+ * what the device already holds: each page is read back and compared, and
+ * only the span from the first to the last changed byte is written.
+ * The optional statistics are cleared first. */
+bool eeprom_ctx_update_block(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_update_stats_t *stats_ptr)
 {
-	while( data_length > 0 )
-	{
-		uint16_t chunk_size = PAGE_SIZE - (address & PAGE_MASK);
-		if( chunk_size > data_length )
-			chunk_size = data_length;
-		if( !eeprom_write_page( address, byte_ptr, chunk_size ) )
-			return false;
+	uint8_t page[PAGE_SIZE];
+	eeprom_update_stats_t stats = {0, 0, 0, 0};
+	uint16_t chunk_size;
+	uint16_t first;
+	uint16_t last;
+	uint16_t i;
+	bool success = true;
+
+	while (success && (data_length > 0)) {
+		chunk_size = page_length(address, data_length);
+
+		/* a read during the previous write cycle would be NACKed */
+		success = eeprom_ctx_wait_ready(ctx)
+				&& (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, ctx->cfg.device, address, page, chunk_size));
+
+		if (success) {
+			first = chunk_size;
+			last = 0;
+			for (i = 0; i < chunk_size; i++) {
+				if (page[i] != byte_ptr[i]) {
+					if (first == chunk_size) {
+						first = i;
+					}
+					last = i;
+				}
+			}
 
-		/* wait for eeprom to become responsive again */
-		while( true )
-		{
-			i2c_send_start(I2C1);
-			while((I2C_SR1(I2C1) & I2C_SR1_SB) == 0);
-			i2c_send_7bit_address(I2C1, ADDRESS_BYTE, I2C_READ);
-			while ((I2C_SR1(I2C1) & (I2C_SR1_ADDR | I2C_SR1_AF)) == 0);
-			bool ack = ( I2C_SR1(I2C1) & I2C_SR1_ADDR ) != 0;
-			(void)I2C_SR2(I2C1);
-			/* send stop */
-			i2c_send_stop(I2C1);
-			while ((I2C_SR2(I2C1) & (I2C_SR2_BUSY | I2C_SR2_MSL)) != 0);
-			if( ack )
-				break;
-			else
-				I2C_SR1(I2C1) = ~I2C_SR1_AF;
+			if (first == chunk_size) {
+				stats.pages_skipped++;
+			} else {
+				if ((0 == first) && ((chunk_size - 1) == last)) {
+					stats.pages_rewritten++;
+				} else {
+					stats.pages_partial++;
+				}
+				stats.bytes_written += (last - first + 1);
+				success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_WRITE, ctx->cfg.device, address + first, &byte_ptr[first], (last - first + 1)));
+			}
 		}
 
 		address += chunk_size;
 		byte_ptr += chunk_size;
 		data_length -= chunk_size;
 	}
+
+	if (stats_ptr != NULL) {
+		*stats_ptr = stats;
+	}
+
+	return success && eeprom_ctx_wait_ready(ctx);
+}
+
+
+/* Function to write a record: the data followed by its CRC, page by page.
+ * The CRC shares the last data page, so it costs no extra write cycle
+ * unless the data ends on a page boundary. Return false on a record and
+ * CRC longer than a read transfer or beyond the array, as the read. */
+bool eeprom_ctx_write_record(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	uint8_t page[PAGE_SIZE];
+	uint8_t trailer[EEPROM_RECORD_CRC_SIZE];
+	uint32_t crc;
+	uint32_t total_length = (uint32_t)data_length + EEPROM_RECORD_CRC_SIZE;
+	uint32_t offset = 0;
+	uint16_t chunk_size;
+	uint8_t *chunk_ptr;
+	uint16_t i;
+
+	if ((total_length > 0xFFFF) || (((uint32_t)address + total_length) > EEPROM_SIZE)) {
+		return false;
+	}
+
+	crc = eeprom_crc_block(byte_ptr, data_length);
+	trailer[0] = (uint8_t)(crc >> 24);
+	trailer[1] = (uint8_t)(crc >> 16);
+	trailer[2] = (uint8_t)(crc >> 8);
+	trailer[3] = (uint8_t)crc;
+
+	while (offset < total_length) {
+		chunk_size = page_length(address, (uint16_t)(total_length - offset));
+		if ((offset + chunk_size) <= data_length) {
+			chunk_ptr = &byte_ptr[offset];
+		} else {
+			/* page holding the CRC */
+			for (i = 0; i < chunk_size; i++) {
+				page[i] = ((offset + i) < data_length) ? byte_ptr[offset + i]
+													   : trailer[offset + i - data_length];
+			}
+			chunk_ptr = page;
+		}
+		if (!eeprom_ctx_write_page(ctx, address, chunk_ptr, chunk_size)
+		|| !eeprom_ctx_wait_ready(ctx)) {
+			return false;
+		}
+		address += chunk_size;
+		offset += chunk_size;
+	}
+
 	return true;
 }
 
 
+/* Function to read a record with a single sequential read: the CRC is
+ * computed in the I2C interrupt while the bytes arrive, no second pass.
+ * Return false on a record and CRC longer than a transfer or beyond the
+ * array, on a bus error or with EEPROM_ST_CRC status on a wrong CRC. */
+bool eeprom_ctx_read_record(eeprom_ctx_t *ctx, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	uint32_t total_length = (uint32_t)data_length + EEPROM_RECORD_CRC_SIZE;
 
-/* ------------ Local functions implementation -------------- */
+	if ((total_length > 0xFFFF) || (((uint32_t)address + total_length) > EEPROM_SIZE)) {
+		return false;
+	}
 
-void i2c1_ev_isr(void)
+	return (EEPROM_ST_DONE == run_transfer(ctx, XFER_RECORD, ctx->cfg.device, address, byte_ptr,
+										   (uint16_t)total_length));
+}
+
+
+/* Function to get the CRC of a device range without copying it out */
+bool eeprom_ctx_checksum_range(eeprom_ctx_t *ctx, eeprom_addr_t address, uint16_t data_length, uint32_t *crc_ptr)
+{
+	bool success = true;
+
+	*crc_ptr = EEPROM_CRC_INIT;
+
+	if (data_length > 0) {
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_CHECKSUM, ctx->cfg.device, address, NULL, data_length));
+		if (success) {
+			*crc_ptr = ctx->xfer.crc;
+		}
+	}
+
+	return success;
+}
+
+
+/* Function to read several regions, each to its own buffer. The segments
+ * are taken by address: the ones following each other, or separated by a
+ * few bytes, are read by one sequential read scattered to the buffers.
+ * Return false with more than EEPROM_IOV_MAX segments or one beyond the
+ * array. */
+bool eeprom_ctx_readv(eeprom_ctx_t *ctx, const eeprom_iovec_t *iov_ptr, uint8_t iov_count)
+{
+	uint8_t order[EEPROM_IOV_MAX];
+	piece_t pieces[EEPROM_IOV_PIECES];
+	uint8_t gap[EEPROM_READV_GAP_MAX];
+	uint8_t piece_count = 0;
+	eeprom_addr_t start = 0;
+	uint32_t end = 0;
+	const eeprom_iovec_t *seg_ptr;
+	uint8_t i;
+	bool success;
+
+	success = iov_sort(iov_ptr, iov_count, order);
+
+	for (i = 0; success && (i < iov_count); i++) {
+		seg_ptr = &iov_ptr[order[i]];
+		if (0 == seg_ptr->data_length) {
+			continue;
+		}
+		if ((piece_count > 0) && (seg_ptr->address >= end)
+		&& ((seg_ptr->address - end) <= EEPROM_READV_GAP_MAX)
+		&& ((seg_ptr->address + seg_ptr->data_length - start) <= UINT16_MAX)) {
+			/* same sequential read: the gap goes to the scratch buffer */
+			if (seg_ptr->address > end) {
+				pieces[piece_count].data_ptr = gap;
+				pieces[piece_count].data_length = (uint16_t)(seg_ptr->address - end);
+				piece_count++;
+			}
+		} else {
+			/* overlap or far away: a new read */
+			if (piece_count > 0) {
+				success = (EEPROM_ST_DONE == run_pieces(ctx, XFER_READ, ctx->cfg.device, start, pieces, piece_count));
+			}
+			piece_count = 0;
+			start = seg_ptr->address;
+		}
+		pieces[piece_count].data_ptr = seg_ptr->data_ptr;
+		pieces[piece_count].data_length = seg_ptr->data_length;
+		piece_count++;
+		end = (uint32_t)seg_ptr->address + seg_ptr->data_length;
+	}
+
+	if (success && (piece_count > 0)) {
+		success = (EEPROM_ST_DONE == run_pieces(ctx, XFER_READ, ctx->cfg.device, start, pieces, piece_count));
+	}
+
+	return success;
+}
+
+
+/* Function to write several regions from their own buffers. The segments
+ * are taken by address and all the ones falling in a page are written by
+ * one page write gathered from the buffers: one write cycle per page
+ * touched instead of one per segment. The bytes between two segments of a
+ * page are read back first and written again unchanged.
+ * Return false with more than EEPROM_IOV_MAX segments, one beyond the
+ * array or overlapping segments. */
+bool eeprom_ctx_writev(eeprom_ctx_t *ctx, const eeprom_iovec_t *iov_ptr, uint8_t iov_count)
+{
+	uint8_t order[EEPROM_IOV_MAX];
+	piece_t pieces[EEPROM_IOV_PIECES];
+	uint8_t page[PAGE_SIZE];
+	uint8_t piece_count;
+	bool gaps;
+	uint32_t page_start;
+	uint32_t first;
+	uint32_t end;
+	uint32_t address;
+	uint16_t offset = 0;
+	uint16_t chunk_size;
+	const eeprom_iovec_t *seg_ptr;
+	uint8_t i;
+	bool success;
+
+	success = iov_sort(iov_ptr, iov_count, order);
+
+	/* overlapping segments: the result would depend on the write order */
+	end = 0;
+	for (i = 0; success && (i < iov_count); i++) {
+		seg_ptr = &iov_ptr[order[i]];
+		if (seg_ptr->data_length > 0) {
+			success = (seg_ptr->address >= end);
+			end = (uint32_t)seg_ptr->address + seg_ptr->data_length;
+		}
+	}
+
+	i = 0;
+	while (success && (i < iov_count)) {
+		seg_ptr = &iov_ptr[order[i]];
+		if (0 == seg_ptr->data_length) {
+			i++;
+			continue;
+		}
+
+		/* gather the segments of the page of the next byte to write */
+		first = (uint32_t)seg_ptr->address + offset;
+		page_start = first & ~(uint32_t)PAGE_MASK;
+		end = first;
+		piece_count = 0;
+		gaps = false;
+		while (i < iov_count) {
+			seg_ptr = &iov_ptr[order[i]];
+			address = (uint32_t)seg_ptr->address + offset;
+			if (0 == seg_ptr->data_length) {
+				i++;
+				continue;
+			}
+			if (address >= (page_start + PAGE_SIZE)) {
+				break;
+			}
+			if (address > end) {
+				pieces[piece_count].data_ptr = &page[end - page_start];
+				pieces[piece_count].data_length = (uint16_t)(address - end);
+				piece_count++;
+				gaps = true;
+			}
+			chunk_size = page_length((eeprom_addr_t)address, seg_ptr->data_length - offset);
+			pieces[piece_count].data_ptr = &seg_ptr->data_ptr[offset];
+			pieces[piece_count].data_length = chunk_size;
+			piece_count++;
+			end = address + chunk_size;
+			offset += chunk_size;
+			if (offset < seg_ptr->data_length) {
+				/* the segment goes on in the next page */
+				break;
+			}
+			offset = 0;
+			i++;
+		}
+
+		/* the gaps keep the device content: one read of the whole span, a
+		 * read during the previous write cycle would be NACKed */
+		if (gaps) {
+			success = eeprom_ctx_wait_ready(ctx)
+					&& (EEPROM_ST_DONE == run_transfer(ctx, XFER_READ, ctx->cfg.device, (eeprom_addr_t)first,
+													   &page[first - page_start], (uint16_t)(end - first)));
+		}
+		success = success
+				&& (EEPROM_ST_DONE == run_pieces(ctx, XFER_WRITE, ctx->cfg.device, (eeprom_addr_t)first, pieces, piece_count))
+				&& eeprom_ctx_wait_ready(ctx);
+	}
+
+	return success;
+}
+
+
+/* Function to compare a device range to a buffer without copying it out:
+ * each byte is compared as it arrives and the read is cut a few bytes
+ * after the first difference. The offset of the first different byte is
+ * stored, data_length if there is none.
+ * Return false on a bus error. */
+bool eeprom_ctx_compare_block(eeprom_ctx_t *ctx, eeprom_addr_t address, const uint8_t *byte_ptr, uint16_t data_length, uint16_t *offset_ptr)
+{
+	bool success = true;
+
+	*offset_ptr = data_length;
+
+	if (data_length > 0) {
+		/* the buffer is only read by a compare transfer */
+		success = (EEPROM_ST_DONE == run_transfer(ctx, XFER_COMPARE, ctx->cfg.device, address, (uint8_t *)byte_ptr, data_length));
+		if (success) {
+			*offset_ptr = ctx->xfer.compare_offset;
+		}
+	}
+
+	return success;
+}
+
+
+/* Function to get the CRC of a buffer, the same as eeprom_checksum_range
+ * on the device. Software table only: the CRC unit may be in use by the
+ * I2C interrupt. */
+uint32_t eeprom_crc_block(const uint8_t *byte_ptr, uint16_t data_length)
+{
+	uint32_t crc = EEPROM_CRC_INIT;
+
+	while (data_length > 0) {
+		crc = crc_step(crc, *byte_ptr);
+		byte_ptr++;
+		data_length--;
+	}
+
+	return crc;
+}
+
+
+/* Single device functions: the same as the eeprom_ctx_ ones on the default
+ * context, see above */
+
+bool eeprom_write_page_async(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return eeprom_ctx_write_page_async(default_ctx, address, data_ptr, data_length, cb_ptr);
+}
+
+
+bool eeprom_read_page_async(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return eeprom_ctx_read_page_async(default_ctx, address, byte_ptr, data_length, cb_ptr);
+}
+
+
+bool eeprom_read_block_async(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return eeprom_ctx_read_block_async(default_ctx, address, byte_ptr, data_length, cb_ptr);
+}
+
+
+bool eeprom_probe_async(eeprom_cb_ptr_t cb_ptr)
+{
+	return eeprom_ctx_probe_async(default_ctx, cb_ptr);
+}
+
+
+bool eeprom_write_block_async(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return eeprom_ctx_write_block_async(default_ctx, address, data_ptr, data_length, cb_ptr);
+}
+
+
+bool eeprom_write_block_busy(void)
+{
+	return eeprom_ctx_write_block_busy(default_ctx);
+}
+
+
+bool eeprom_wait_ready(void)
+{
+	return eeprom_ctx_wait_ready(default_ctx);
+}
+
+
+bool eeprom_dev_wait_ready(uint8_t device)
+{
+	return eeprom_ctx_dev_wait_ready(default_ctx, device);
+}
+
+
+void eeprom_get_twr_stats(eeprom_twr_stats_t *stats_ptr)
+{
+	eeprom_ctx_get_twr_stats(default_ctx, stats_ptr);
+}
+
+
+/* Function to get the performance counters of the default context */
+void eeprom_get_perf_stats(eeprom_perf_stats_t *stats_ptr)
+{
+	eeprom_ctx_get_perf_stats(default_ctx, stats_ptr);
+}
+
+
+/* Function to clear the performance counters of the default context */
+void eeprom_reset_perf_stats(void)
+{
+	eeprom_ctx_reset_perf_stats(default_ctx);
+}
+
+
+void eeprom_set_write_hook(eeprom_write_hook_t hook_ptr)
+{
+	eeprom_ctx_set_write_hook(default_ctx, hook_ptr);
+}
+
+
+uint8_t eeprom_get_status(void)
+{
+	return eeprom_ctx_get_status(default_ctx);
+}
+
+
+bool eeprom_write_byte(eeprom_addr_t address, uint8_t data)
+{
+	return eeprom_ctx_write_byte(default_ctx, address, data);
+}
+
+
+bool eeprom_write_page(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_write_page(default_ctx, address, data_ptr, data_length);
+}
+
+
+bool eeprom_read_byte(eeprom_addr_t address, uint8_t *byte_ptr)
+{
+	return eeprom_ctx_read_byte(default_ctx, address, byte_ptr);
+}
+
+
+bool eeprom_read_page(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_read_page(default_ctx, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_dev_write_page(uint8_t device, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_dev_write_page(default_ctx, device, address, data_ptr, data_length);
+}
+
+
+bool eeprom_dev_read_block(uint8_t device, eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_dev_read_block(default_ctx, device, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_read_block(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_read_block(default_ctx, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_write_block(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_write_block(default_ctx, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_update_block(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length, eeprom_update_stats_t *stats_ptr)
+{
+	return eeprom_ctx_update_block(default_ctx, address, byte_ptr, data_length, stats_ptr);
+}
+
+
+bool eeprom_write_record(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_write_record(default_ctx, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_read_record(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	return eeprom_ctx_read_record(default_ctx, address, byte_ptr, data_length);
+}
+
+
+bool eeprom_checksum_range(eeprom_addr_t address, uint16_t data_length, uint32_t *crc_ptr)
+{
+	return eeprom_ctx_checksum_range(default_ctx, address, data_length, crc_ptr);
+}
+
+
+bool eeprom_compare_block(eeprom_addr_t address, const uint8_t *byte_ptr, uint16_t data_length, uint16_t *offset_ptr)
+{
+	return eeprom_ctx_compare_block(default_ctx, address, byte_ptr, data_length, offset_ptr);
+}
+
+
+bool eeprom_readv(const eeprom_iovec_t *iov_ptr, uint8_t iov_count)
+{
+	return eeprom_ctx_readv(default_ctx, iov_ptr, iov_count);
+}
+
+
+bool eeprom_writev(const eeprom_iovec_t *iov_ptr, uint8_t iov_count)
+{
+	return eeprom_ctx_writev(default_ctx, iov_ptr, iov_count);
+}
+
+
+/* ------------ Local functions implementation -------------- */
+
+
+/* Order the segments of a scatter/gather call by address (insertion sort,
+ * a few segments). Return false with too many segments or one beyond the
+ * end of the array. */
+static bool iov_sort(const eeprom_iovec_t *iov_ptr, uint8_t iov_count, uint8_t *order)
+{
+	uint8_t i;
+	uint8_t j;
+	uint8_t index;
+
+	if (iov_count > EEPROM_IOV_MAX) {
+		return false;
+	}
+
+	for (i = 0; i < iov_count; i++) {
+		if (((uint32_t)iov_ptr[i].address + iov_ptr[i].data_length) > EEPROM_SIZE) {
+			return false;
+		}
+		index = i;
+		for (j = i; (j > 0) && (iov_ptr[order[j - 1]].address > iov_ptr[index].address); j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = index;
+	}
+
+	return true;
+}
+
+
+/* Start writing the current page chunk of the block */
+static void block_write_page(eeprom_ctx_t *ctx)
+{
+	ctx->block.chunk_size = page_length(ctx->block.address, ctx->block.data_length);
+
+	ctx->block.state = BLOCK_ST_WRITE;
+	if (!start_transfer(ctx, XFER_WRITE, ctx->cfg.device, ctx->block.address, ctx->block.data_ptr, ctx->block.chunk_size, true, NULL)) {
+		/* engine busy: retry at next tick */
+		ctx->block.state = BLOCK_ST_NEXT;
+	}
+}
+
+
+/* Page chunk written (I2C interrupt): the device write cycle starts now */
+static void block_page_done(eeprom_ctx_t *ctx, uint8_t status)
+{
+	if (EEPROM_ST_DONE == status) {
+		ctx->block.address += ctx->block.chunk_size;
+		ctx->block.data_ptr += ctx->block.chunk_size;
+		ctx->block.data_length -= ctx->block.chunk_size;
+
+		ctx->block.state = BLOCK_ST_CYCLE;
+	} else {
+		block_end(ctx, status);
+	}
+}
+
+
+/* ACK polling done (I2C interrupt) */
+static void block_probe_done(eeprom_ctx_t *ctx, uint8_t status)
+{
+	twr_probe_done(ctx, ctx->cfg.device, status);
+
+	if (EEPROM_ST_DONE == status) {
+		/* write cycle completed */
+		if (ctx->block.data_length > 0) {
+			block_write_page(ctx);
+		} else {
+			block_end(ctx, EEPROM_ST_DONE);
+		}
+	} else if ((EEPROM_ST_NACK == status)
+	&& (ctx->twr.dev[ctx->cfg.device].nack_us < EEPROM_TWR_TIMEOUT_US)) {
+		/* device still busy in its internal write cycle */
+		ctx->block.state = BLOCK_ST_CYCLE;
+	} else {
+		/* do not wait again for a device that did not answer */
+		ctx->twr.dev[ctx->cfg.device].pending = false;
+		block_end(ctx, status);
+	}
+}
+
+
+/* End the block write and notify the user */
+static void block_end(eeprom_ctx_t *ctx, uint8_t status)
+{
+	ctx->block.state = BLOCK_ST_IDLE;
+
+	if (ctx->block.cb_ptr != NULL) {
+		ctx->block.cb_ptr(status);
+	}
+}
+
+
+/* RTOS callback: move the block writes of all the buses on from the states
+ * parked by the interrupts. It re-arms itself for the next tick until the
+ * last block ends. */
+static void block_tick(void)
+{
+	eeprom_ctx_t *ctx;
+	bool active = false;
+	uint8_t bus;
+
+	for (bus = 0; bus < EEPROM_BUSES; bus++) {
+		ctx = &bus_ctx[bus];
+
+		switch (ctx->block.state) {
+		case BLOCK_ST_CYCLE:
+		{
+			/* no probe before the predicted end of the write cycle */
+			if (twr_elapsed_us(ctx, ctx->cfg.device) >= ctx->twr.stats.twr_avg_us) {
+				ctx->block.state = BLOCK_ST_PROBE;
+				if (!start_transfer(ctx, XFER_PROBE, ctx->cfg.device, 0, NULL, 0, true, NULL)) {
+					/* engine busy: retry at next tick */
+					ctx->block.state = BLOCK_ST_CYCLE;
+				}
+			}
+			break;
+		}
+		case BLOCK_ST_NEXT:
+		{
+			block_write_page(ctx);
+			break;
+		}
+		default:
+		{
+			/* transfer on the bus or block ended */
+			break;
+		}
+		}
+
+		if (BLOCK_ST_IDLE != ctx->block.state) {
+			active = true;
+		}
+	}
+
+	if (active) {
+		rtos_set_callback(EEPROM_WRITE_CB_ID, RTOS_CB_TYPE_SINGLE, 0, &block_tick);
+	}
+}
+
+/* Function to limit a transfer length to the end of the addressed page */
+static uint16_t page_length(eeprom_addr_t address, uint16_t data_length)
+{
+	/* 32-bit: the next page of the last one is past a 16-bit address */
+	uint32_t start_of_next_page = ((uint32_t)address & ~(uint32_t)PAGE_MASK) + PAGE_SIZE;
+	if( (uint32_t)address + data_length > start_of_next_page )
+		data_length = (uint16_t)(start_of_next_page - address);
+
+	return data_length;
+}
+
+
+/* Function to claim the transfer engine and send the first START.
+ * Return false if another transfer is ongoing. */
+static bool start_transfer(eeprom_ctx_t *ctx, uint8_t type, uint8_t device, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, bool block, eeprom_cb_ptr_t cb_ptr)
+{
+	piece_t piece = {data_ptr, data_length};
+
+	return start_pieces(ctx, type, device, address, &piece, 1, block, cb_ptr);
+}
+
+
+/* Function to start a transfer whose data phase moves several buffers in
+ * sequence. A single buffer is copied, more are followed by the interrupts
+ * and must stay valid until the completion. */
+static bool start_pieces(eeprom_ctx_t *ctx, uint8_t type, uint8_t device, eeprom_addr_t address, const piece_t *piece_ptr, uint8_t piece_count, bool block, eeprom_cb_ptr_t cb_ptr)
+{
+	bool claimed = false;
+	uint32_t irq_mask;
+	uint16_t data_length = 0;
+	uint8_t i;
+
+	for (i = 0; i < piece_count; i++) {
+		data_length += piece_ptr[i].data_length;
+	}
+
+	/* claim the engine: a completion callback may start a transfer too */
+	irq_mask = cm_mask_interrupts(1);
+	if (XFER_ST_IDLE == ctx->xfer.state) {
+		ctx->xfer.state = XFER_ST_START;
+		claimed = true;
+	}
+	cm_mask_interrupts(irq_mask);
+
+	if (claimed) {
+		ctx->xfer.status = EEPROM_ST_BUSY;
+		ctx->xfer.type = type;
+		ctx->xfer.device = device;
+		ctx->xfer.address_byte = ADDRESS_BYTE(device, address);
+		ctx->xfer.address = address;
+		for (i = 0; i < EEPROM_ADDRESS_BYTES; i++) {
+			ctx->xfer.mem_address[i] = (uint8_t)(address >> (8 * (EEPROM_ADDRESS_BYTES - 1 - i)));
+		}
+		ctx->xfer.mem_address_index = 0;
+		ctx->xfer.data_ptr = piece_ptr[0].data_ptr;
+		ctx->xfer.data_length = data_length;
+		ctx->xfer.buffer_ptr = piece_ptr[0].data_ptr;
+		ctx->xfer.buffer_length = data_length;
+		ctx->xfer.pieces = (piece_count > 1) ? piece_ptr : NULL;
+		ctx->xfer.piece_count = piece_count;
+		ctx->xfer.piece_ptr = piece_ptr;
+		ctx->xfer.piece_left = piece_ptr[0].data_length;
+		/* the CRC is computed on the bytes moved by the CPU, a DMA stream
+		 * moves one buffer */
+		ctx->xfer.dma = (EEPROM_MODE_DMA == ctx->cfg.mode)
+				&& ((XFER_WRITE == type) || (XFER_READ == type))
+				&& (data_length >= EEPROM_DMA_MIN_LENGTH)
+				&& (1 == piece_count);
+		ctx->xfer.block = block;
+		ctx->xfer.cb_ptr = cb_ptr;
+		ctx->xfer.crc_length = 0;
+		ctx->xfer.crc_hw = false;
+		ctx->xfer.compare_diff = false;
+		ctx->xfer.compare_offset = data_length;
+		if ((XFER_CHECKSUM == type) || (XFER_RECORD == type)) {
+			ctx->xfer.crc_length = (XFER_RECORD == type) ? (data_length - EEPROM_RECORD_CRC_SIZE) : data_length;
+			ctx->xfer.crc = EEPROM_CRC_INIT;
+			ctx->xfer.crc_word_bytes = 0;
+			ctx->xfer.crc_trailer = 0;
+#if EEPROM_CFG_CRC_HW
+			/* one CRC unit for all the buses: the transfers started while
+			 * it is in use compute their CRC by the software table */
+			irq_mask = cm_mask_interrupts(1);
+			if (NULL == crc_owner) {
+				crc_owner = ctx;
+				ctx->xfer.crc_hw = true;
+			}
+			cm_mask_interrupts(irq_mask);
+			if (ctx->xfer.crc_hw) {
+				crc_reset();
+			}
+#endif
+		}
+
+		/* device counter at the address: no memory address phase, the read
+		 * starts with the device address + R */
+		if ((XFER_WRITE != type) && (XFER_PROBE != type)
+		&& ctx->cursor[device].valid && (ctx->cursor[device].address == address)) {
+			ctx->xfer.state = XFER_ST_RESTART;
+		}
+
+		/* a previous STOP must be on the bus before a new START is requested */
+		ctx->xfer.stop_spins = 0;
+		while ((I2C_CR1(ctx->hw->i2c) & I2C_CR1_STOP) != 0) {
+			ctx->xfer.stop_spins++;
+		}
+
+		/* the rest of the transfer is driven by the event interrupt */
+		ctx->xfer.events = 0;
+		ctx->xfer.start_cycles = dwt_read_cycle_counter();
+		i2c_enable_interrupt(ctx->hw->i2c, I2C_CR2_ITEVTEN);
+		i2c_send_start(ctx->hw->i2c);
+	}
+
+	return claimed;
+}
+
+
+/* Function to run a transfer and wait for its completion */
+static uint8_t run_transfer(eeprom_ctx_t *ctx, uint8_t type, uint8_t device, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	piece_t piece = {data_ptr, data_length};
+
+	return run_pieces(ctx, type, device, address, &piece, 1);
+}
+
+
+/* Function to run a gather/scatter transfer and wait for its completion */
+static uint8_t run_pieces(eeprom_ctx_t *ctx, uint8_t type, uint8_t device, eeprom_addr_t address, const piece_t *piece_ptr, uint8_t piece_count)
+{
+	/* wait for a free engine */
+	while (!start_pieces(ctx, type, device, address, piece_ptr, piece_count, false, NULL)) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+
+	/* wait for transfer completion */
+	while (ctx->xfer.state != XFER_ST_IDLE) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+
+	return ctx->xfer.status;
+}
+
+
+/* Function to release the engine and notify the transfer result */
+static void end_transfer(eeprom_ctx_t *ctx, uint8_t status)
+{
+	eeprom_cb_ptr_t cb_ptr = ctx->xfer.cb_ptr;
+	bool block = ctx->xfer.block;
+	uint8_t type = ctx->xfer.type;
+
+	if (ctx->xfer.dma) {
+		/* aborted while DMA was moving data */
+		dma_stop(ctx);
+	}
+	i2c_disable_interrupt(ctx->hw->i2c, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+	/* the device counter follows the bytes read, wrapping at the end of
+	 * the array; after a write it is in the written page, unknown after a
+	 * failure */
+	if ((EEPROM_ST_DONE == status) && (XFER_PROBE == ctx->xfer.type)) {
+		/* address frame only: counter unchanged */
+	} else if ((EEPROM_ST_DONE == status) && (XFER_WRITE != ctx->xfer.type)) {
+		ctx->cursor[ctx->xfer.device].address = (eeprom_addr_t)((ctx->xfer.address + ctx->xfer.buffer_length)
+																& (EEPROM_SIZE - 1));
+		ctx->cursor[ctx->xfer.device].valid = true;
+	} else {
+		ctx->cursor[ctx->xfer.device].valid = false;
+	}
+	if ((XFER_WRITE == ctx->xfer.type) && (EEPROM_ST_DONE == status)) {
+		/* STOP requested: the device write cycle starts now */
+		ctx->twr.dev[ctx->xfer.device].start_cycles = dwt_read_cycle_counter();
+		ctx->twr.dev[ctx->xfer.device].first_probe = true;
+		ctx->twr.dev[ctx->xfer.device].nack_us = 0;
+		ctx->twr.dev[ctx->xfer.device].pending = true;
+	}
+	/* the observers follow the address space of the context device */
+	if ((XFER_WRITE == ctx->xfer.type) && (ctx->cfg.device == ctx->xfer.device)
+	&& (ctx->write_hook_ptr != NULL)) {
+		if (NULL == ctx->xfer.pieces) {
+			(*ctx->write_hook_ptr)(ctx->xfer.address, ctx->xfer.buffer_ptr, ctx->xfer.buffer_length, status);
+		} else {
+			/* one notification per buffer, at its place in the page */
+			eeprom_addr_t address = ctx->xfer.address;
+			uint8_t i;
+			for (i = 0; i < ctx->xfer.piece_count; i++) {
+				(*ctx->write_hook_ptr)(address, ctx->xfer.pieces[i].data_ptr, ctx->xfer.pieces[i].data_length, status);
+				address += ctx->xfer.pieces[i].data_length;
+			}
+		}
+	}
+	if (((XFER_CHECKSUM == ctx->xfer.type) || (XFER_RECORD == ctx->xfer.type))
+	&& (EEPROM_ST_DONE == status)) {
+		crc_end(ctx);
+		if ((XFER_RECORD == ctx->xfer.type) && (ctx->xfer.crc != ctx->xfer.crc_trailer)) {
+			status = EEPROM_ST_CRC;
+		}
+	}
+#if EEPROM_CFG_CRC_HW
+	if (ctx->xfer.crc_hw) {
+		ctx->xfer.crc_hw = false;
+		crc_owner = NULL;
+	}
+#endif
+	perf_end(ctx, status);
+	ctx->xfer.status = status;
+	/* release the engine as last operation: the callback may start a new transfer */
+	ctx->xfer.state = XFER_ST_IDLE;
+
+	if (block) {
+		if (XFER_WRITE == type) {
+			block_page_done(ctx, status);
+		} else {
+			block_probe_done(ctx, status);
+		}
+	} else if (cb_ptr != NULL) {
+		(*cb_ptr)(status);
+	}
+}
+
+
+/* Account the transfer ending in the performance counters. The engine is
+ * still owned, so this is the only writer. */
+static void perf_end(eeprom_ctx_t *ctx, uint8_t status)
+{
+	eeprom_perf_op_t *op_ptr = &ctx->perf.stats.ops[perf_ops_array[ctx->xfer.type]];
+	uint32_t latency_us = (dwt_read_cycle_counter() - ctx->xfer.start_cycles) / (rcc_ahb_frequency / 1000000);
+	uint8_t bucket = 0;
+
+	/* log2 bucket: position of the highest bit set */
+	if (latency_us > 1) {
+		bucket = (uint8_t)(31 - __builtin_clz(latency_us));
+		if (bucket >= EEPROM_PERF_BUCKETS) {
+			bucket = EEPROM_PERF_BUCKETS - 1;
+		}
+	}
+
+	ctx->perf.seq++;
+	PERF_BARRIER();
+	op_ptr->transfers++;
+	if (EEPROM_ST_NACK == status) {
+		op_ptr->nacks++;
+	} else if (EEPROM_ST_ERROR == status) {
+		op_ptr->errors++;
+	} else {
+		/* done, or read with a wrong CRC: the bytes moved all the same */
+		op_ptr->bytes += ctx->xfer.buffer_length;
+	}
+	op_ptr->events += ctx->xfer.events;
+	op_ptr->latency[bucket]++;
+	ctx->perf.stats.stop_spins += ctx->xfer.stop_spins;
+	if ((NULL == ctx->xfer.cb_ptr) && !ctx->xfer.block) {
+		ctx->perf.stats.blocking_us += latency_us;
+	}
+	PERF_BARRIER();
+	ctx->perf.seq++;
+}
+
+
+/* Move to the next data byte, entering the next buffer of a gather/scatter
+ * transfer at the end of the current one */
+static void data_next(eeprom_ctx_t *ctx)
+{
+	ctx->xfer.data_ptr++;
+	ctx->xfer.data_length--;
+	if (ctx->xfer.pieces != NULL) {
+		ctx->xfer.piece_left--;
+		if ((0 == ctx->xfer.piece_left) && (ctx->xfer.data_length > 0)) {
+			ctx->xfer.piece_ptr++;
+			ctx->xfer.data_ptr = ctx->xfer.piece_ptr->data_ptr;
+			ctx->xfer.piece_left = ctx->xfer.piece_ptr->data_length;
+		}
+	}
+}
+
+
+/* Store a received byte: record and checksum reads feed the CRC first,
+ * then collect the record CRC */
+static void rx_byte(eeprom_ctx_t *ctx, uint8_t data)
+{
+	if (ctx->xfer.crc_length > 0) {
+		crc_byte(ctx, data);
+		ctx->xfer.crc_length--;
+		if (ctx->xfer.data_ptr != NULL) {
+			*ctx->xfer.data_ptr = data;
+			ctx->xfer.data_ptr++;
+		}
+		ctx->xfer.data_length--;
+	} else if (XFER_RECORD == ctx->xfer.type) {
+		ctx->xfer.crc_trailer = (ctx->xfer.crc_trailer << 8) | data;
+		ctx->xfer.data_length--;
+	} else if (XFER_COMPARE == ctx->xfer.type) {
+		if (!ctx->xfer.compare_diff && (*ctx->xfer.data_ptr != data)) {
+			ctx->xfer.compare_diff = true;
+			ctx->xfer.compare_offset = ctx->xfer.buffer_length - ctx->xfer.data_length;
+			if (ctx->xfer.data_length > 4) {
+				/* cut the read: the three bytes left run the usual NACK and
+				 * STOP sequence, the device counter stops after them */
+				ctx->xfer.buffer_length -= ctx->xfer.data_length - 4;
+				ctx->xfer.data_length = 4;
+			}
+		}
+		ctx->xfer.data_ptr++;
+		ctx->xfer.data_length--;
+	} else {
+		*ctx->xfer.data_ptr = data;
+		data_next(ctx);
+	}
+}
+
+
+/* CRC of one more byte by the software table */
+static uint32_t crc_step(uint32_t crc, uint8_t data)
+{
+	return (crc << 8) ^ crc_table[(uint8_t)(crc >> 24) ^ data];
+}
+
+
+/* Feed a received byte to the CRC of the transfer */
+static void crc_byte(eeprom_ctx_t *ctx, uint8_t data)
+{
+	if (ctx->xfer.crc_hw) {
+		ctx->xfer.crc_word = (ctx->xfer.crc_word << 8) | data;
+		ctx->xfer.crc_word_bytes++;
+		if (4 == ctx->xfer.crc_word_bytes) {
+			ctx->xfer.crc = crc_calculate(ctx->xfer.crc_word);
+			ctx->xfer.crc_word_bytes = 0;
+		}
+	} else {
+		ctx->xfer.crc = crc_step(ctx->xfer.crc, data);
+	}
+}
+
+
+/* Complete the CRC of the transfer with the bytes short of a word */
+static void crc_end(eeprom_ctx_t *ctx)
+{
+	while (ctx->xfer.crc_word_bytes > 0) {
+		ctx->xfer.crc_word_bytes--;
+		ctx->xfer.crc = crc_step(ctx->xfer.crc, (uint8_t)(ctx->xfer.crc_word >> (8 * ctx->xfer.crc_word_bytes)));
+	}
+}
+
+
+/* Time elapsed since the end of the last write */
+static uint32_t twr_elapsed_us(eeprom_ctx_t *ctx, uint8_t device)
+{
+	return (dwt_read_cycle_counter() - ctx->twr.dev[device].start_cycles) / (rcc_ahb_frequency / 1000000);
+}
+
+
+/* Busy wait without using the bus */
+static void twr_delay_us(uint32_t delay_us)
+{
+	uint32_t start_cycles = dwt_read_cycle_counter();
+	uint32_t delay_cycles = delay_us * (rcc_ahb_frequency / 1000000);
+
+	while ((dwt_read_cycle_counter() - start_cycles) < delay_cycles) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+}
+
+
+/* Account an ACK polling probe and learn the write cycle time from it */
+static void twr_probe_done(eeprom_ctx_t *ctx, uint8_t device, uint8_t status)
+{
+	uint32_t elapsed_us = twr_elapsed_us(ctx, device);
+	uint32_t measured_us;
+
+	ctx->twr.stats.probes++;
+
+	if (EEPROM_ST_NACK == status) {
+		ctx->twr.stats.nacks++;
+		ctx->twr.dev[device].first_probe = false;
+		ctx->twr.dev[device].nack_us = elapsed_us;
+	} else if ((EEPROM_ST_DONE == status) && ctx->twr.dev[device].pending) {
+		ctx->twr.dev[device].pending = false;
+		ctx->twr.stats.cycles++;
+		if (ctx->twr.dev[device].first_probe) {
+			/* ready at the first probe: the elapsed time only bounds the
+			 * write cycle, so shorten the prediction to follow faster parts */
+			measured_us = elapsed_us;
+			ctx->twr.stats.twr_avg_us -= ctx->twr.stats.twr_avg_us >> EEPROM_TWR_SHRINK_SHIFT;
+			if (ctx->twr.stats.twr_avg_us < EEPROM_TWR_MIN_US) {
+				ctx->twr.stats.twr_avg_us = EEPROM_TWR_MIN_US;
+			}
+		} else {
+			/* the write cycle ended between the last two probes */
+			measured_us = ctx->twr.dev[device].nack_us + ((elapsed_us - ctx->twr.dev[device].nack_us) >> 1);
+			ctx->twr.stats.twr_avg_us = ctx->twr.stats.twr_avg_us
+								- (ctx->twr.stats.twr_avg_us >> EEPROM_TWR_AVG_SHIFT)
+								+ (measured_us >> EEPROM_TWR_AVG_SHIFT);
+		}
+		if (measured_us > ctx->twr.stats.twr_max_us) {
+			ctx->twr.stats.twr_max_us = measured_us;
+		}
+	} else {
+		/* bus error */
+	}
+}
+
+
+/* I2C event interrupt: transfer engine state machine of the bus */
+static void ev_isr(eeprom_ctx_t *ctx)
+{
+	uint32_t sr1 = I2C_SR1(ctx->hw->i2c);
+
+	ctx->xfer.events++;
+
+	switch (ctx->xfer.state) {
+	case XFER_ST_START:
+	case XFER_ST_RESTART:
+	{
+		/* START on the bus: send device address */
+		if ((sr1 & I2C_SR1_SB) != 0) {
+			if (XFER_ST_START == ctx->xfer.state) {
+				i2c_send_7bit_address(ctx->hw->i2c, ctx->xfer.address_byte, I2C_WRITE);
+				ctx->xfer.state = XFER_ST_ADDR_WR;
+			} else {
+				i2c_send_7bit_address(ctx->hw->i2c, ctx->xfer.address_byte, I2C_READ);
+				ctx->xfer.state = XFER_ST_ADDR_RD;
+			}
+		}
+		break;
+	}
+	case XFER_ST_ADDR_WR:
+	{
+		/* device acknowledged: clear ADDR reading SR2 */
+		if ((sr1 & I2C_SR1_ADDR) != 0) {
+			(void)I2C_SR2(ctx->hw->i2c);
+			if (XFER_PROBE == ctx->xfer.type) {
+				/* probe only: the device is ready */
+				i2c_send_stop(ctx->hw->i2c);
+				end_transfer(ctx, EEPROM_ST_DONE);
+			} else {
+				/* send memory address MSB, the rest on TxE */
+				i2c_send_data(ctx->hw->i2c, ctx->xfer.mem_address[0]);
+				ctx->xfer.mem_address_index = 1;
+				ctx->xfer.state = XFER_ST_TX;
+				if ((1 == sizeof(ctx->xfer.mem_address))
+				&& ctx->xfer.dma && (XFER_WRITE == ctx->xfer.type)) {
+					/* one byte address sent: data bytes fed by DMA */
+					dma_start(ctx, ctx->hw->dma_tx_stream, DMA_SxCR_DIR_MEM_TO_PERIPHERAL,
+							ctx->xfer.data_ptr, ctx->xfer.data_length);
+					ctx->xfer.data_length = 0;
+				} else {
+					i2c_enable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+				}
+			}
+		}
+		break;
+	}
+	case XFER_ST_TX:
+	{
+		if (ctx->xfer.mem_address_index < sizeof(ctx->xfer.mem_address)) {
+			/* send next memory address byte */
+			if ((sr1 & I2C_SR1_TxE) != 0) {
+				i2c_send_data(ctx->hw->i2c, ctx->xfer.mem_address[ctx->xfer.mem_address_index]);
+				ctx->xfer.mem_address_index++;
+				if ((ctx->xfer.mem_address_index == sizeof(ctx->xfer.mem_address))
+				&& ctx->xfer.dma && (XFER_WRITE == ctx->xfer.type)) {
+					/* data bytes fed by DMA on TxE, BTF after its end */
+					i2c_disable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+					dma_start(ctx, ctx->hw->dma_tx_stream, DMA_SxCR_DIR_MEM_TO_PERIPHERAL,
+							ctx->xfer.data_ptr, ctx->xfer.data_length);
+					ctx->xfer.data_length = 0;
+				}
+			}
+		} else if (ctx->xfer.dma && (XFER_WRITE == ctx->xfer.type)) {
+			/* DMA still feeding data bytes */
+		} else if ((XFER_WRITE == ctx->xfer.type) && (ctx->xfer.data_length > 0)) {
+			/* send next data byte */
+			if ((sr1 & I2C_SR1_TxE) != 0) {
+				i2c_send_data(ctx->hw->i2c, *ctx->xfer.data_ptr);
+				data_next(ctx);
+			}
+		} else if ((sr1 & I2C_SR1_BTF) != 0) {
+			/* last byte shifted out */
+			if (XFER_WRITE != ctx->xfer.type) {
+				/* repeated START for the read phase */
+				i2c_send_start(ctx->hw->i2c);
+				ctx->xfer.state = XFER_ST_RESTART;
+			} else {
+				i2c_send_stop(ctx->hw->i2c);
+				end_transfer(ctx, EEPROM_ST_DONE);
+			}
+		} else {
+			/* all bytes queued: wait for BTF only */
+			i2c_disable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+		}
+		break;
+	}
+	case XFER_ST_ADDR_RD:
+	{
+		if ((sr1 & I2C_SR1_ADDR) != 0) {
+			if (ctx->xfer.dma) {
+				/* DMA stores the bytes, LAST NACKs the final one */
+				i2c_enable_ack(ctx->hw->i2c);
+				i2c_set_dma_last_transfer(ctx->hw->i2c);
+				dma_start(ctx, ctx->hw->dma_rx_stream, DMA_SxCR_DIR_PERIPHERAL_TO_MEM,
+						ctx->xfer.data_ptr, ctx->xfer.data_length);
+				(void)I2C_SR2(ctx->hw->i2c);
+			} else if (1 == ctx->xfer.data_length) {
+				/* single byte: NACK it and STOP right after ADDR clearing */
+				i2c_disable_ack(ctx->hw->i2c);
+				(void)I2C_SR2(ctx->hw->i2c);
+				i2c_send_stop(ctx->hw->i2c);
+				i2c_enable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+			} else if (2 == ctx->xfer.data_length) {
+				/* two bytes: ACK applies to the next byte (POS), so the
+				 * first byte is ACKed and the second one NACKed */
+				i2c_enable_ack(ctx->hw->i2c);
+				i2c_nack_next(ctx->hw->i2c);
+				(void)I2C_SR2(ctx->hw->i2c);
+				i2c_disable_ack(ctx->hw->i2c);
+			} else {
+				/* N bytes: RxNE until three bytes are left, then BTF */
+				i2c_enable_ack(ctx->hw->i2c);
+				(void)I2C_SR2(ctx->hw->i2c);
+				if (ctx->xfer.data_length > 3) {
+					i2c_enable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+				}
+			}
+			ctx->xfer.state = XFER_ST_RX;
+		}
+		break;
+	}
+	case XFER_ST_RX:
+	{
+		if (ctx->xfer.dma) {
+			/* end of transfer notified by DMA */
+		} else if (ctx->xfer.data_length > 3) {
+			/* read on RxNE */
+			if ((sr1 & I2C_SR1_RxNE) != 0) {
+				rx_byte(ctx, i2c_get_data(ctx->hw->i2c));
+				if (3 == ctx->xfer.data_length) {
+					/* tail: wait for BTF with N-2 in DR and N-1 in shift register */
+					i2c_disable_interrupt(ctx->hw->i2c, I2C_CR2_ITBUFEN);
+				}
+			}
+		} else if (1 == ctx->xfer.data_length) {
+			/* single byte transfer: already NACKed and STOPped */
+			if ((sr1 & I2C_SR1_RxNE) != 0) {
+				rx_byte(ctx, i2c_get_data(ctx->hw->i2c));
+				end_transfer(ctx, EEPROM_ST_DONE);
+			}
+		} else if ((sr1 & I2C_SR1_BTF) != 0) {
+			if (3 == ctx->xfer.data_length) {
+				/* NACK byte N, which is received when N-2 is read */
+				i2c_disable_ack(ctx->hw->i2c);
+				rx_byte(ctx, i2c_get_data(ctx->hw->i2c));
+			} else {
+				/* last two bytes in DR and shift register: STOP and read both */
+				i2c_send_stop(ctx->hw->i2c);
+				rx_byte(ctx, i2c_get_data(ctx->hw->i2c));
+				rx_byte(ctx, i2c_get_data(ctx->hw->i2c));
+				i2c_nack_current(ctx->hw->i2c);
+				end_transfer(ctx, EEPROM_ST_DONE);
+			}
+		}
+		break;
+	}
+	default:
+	{
+		/* spurious event: mask it */
+		i2c_disable_interrupt(ctx->hw->i2c, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+		break;
+	}
+	}
+}
+
+
+/* I2C error interrupt: abort the ongoing transfer of the bus */
+static void er_isr(eeprom_ctx_t *ctx)
+{
+	uint32_t sr1 = I2C_SR1(ctx->hw->i2c);
+	uint8_t i;
+
+	/* clear error flags */
+	I2C_SR1(ctx->hw->i2c) = ~(sr1 & I2C_SR1_ERR_MASK);
+
+	/* after an arbitration loss the peripheral is already in slave mode */
+	if ((sr1 & I2C_SR1_ARLO) == 0) {
+		i2c_send_stop(ctx->hw->i2c);
+	}
+
+	if ((sr1 & (I2C_SR1_ARLO | I2C_SR1_BERR)) != 0) {
+		/* another master on the bus: it may have moved any counter */
+		for (i = 0; i < EEPROM_DEVICES; i++) {
+			ctx->cursor[i].valid = false;
+		}
+	}
+
+	if (ctx->xfer.state != XFER_ST_IDLE) {
+		if ((sr1 & I2C_SR1_AF) != 0) {
+			end_transfer(ctx, EEPROM_ST_NACK);
+		} else {
+			end_transfer(ctx, EEPROM_ST_ERROR);
+		}
+	}
+}
+
+
+
+
+/* Function to start a DMA1 stream on the I2C data register of the bus */
+static void dma_start(eeprom_ctx_t *ctx, uint8_t stream, uint32_t direction, uint8_t *data_ptr, uint16_t data_length)
+{
+	dma_stream_reset(EEPROM_DMA, stream);
+	dma_channel_select(EEPROM_DMA, stream, ctx->hw->dma_channel);
+	dma_set_transfer_mode(EEPROM_DMA, stream, direction);
+	dma_set_priority(EEPROM_DMA, stream, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(EEPROM_DMA, stream, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(EEPROM_DMA, stream, DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(EEPROM_DMA, stream);
+	dma_set_peripheral_address(EEPROM_DMA, stream, (uintptr_t)&I2C_DR(ctx->hw->i2c));
+	dma_set_memory_address(EEPROM_DMA, stream, (uintptr_t)data_ptr);
+	dma_set_number_of_data(EEPROM_DMA, stream, data_length);
+	dma_enable_transfer_complete_interrupt(EEPROM_DMA, stream);
+	dma_enable_stream(EEPROM_DMA, stream);
+	/* DMA requests on TxE/RxNE */
+	i2c_enable_dma(ctx->hw->i2c);
+}
+
+
+/* Function to stop both DMA1 streams and the I2C DMA requests of the bus */
+static void dma_stop(eeprom_ctx_t *ctx)
+{
+	i2c_disable_dma(ctx->hw->i2c);
+	i2c_clear_dma_last_transfer(ctx->hw->i2c);
+	dma_disable_stream(EEPROM_DMA, ctx->hw->dma_rx_stream);
+	dma_disable_stream(EEPROM_DMA, ctx->hw->dma_tx_stream);
+	ctx->xfer.dma = false;
+}
+
+
+/* DMA1 receive stream interrupt: receive completed */
+static void dma_rx_isr(eeprom_ctx_t *ctx)
+{
+	if (dma_get_interrupt_flag(EEPROM_DMA, ctx->hw->dma_rx_stream, DMA_TCIF)) {
+		dma_clear_interrupt_flags(EEPROM_DMA, ctx->hw->dma_rx_stream, DMA_TCIF);
+		/* last byte already NACKed */
+		i2c_send_stop(ctx->hw->i2c);
+		dma_stop(ctx);
+		ctx->xfer.data_length = 0;
+		end_transfer(ctx, EEPROM_ST_DONE);
+	}
+}
+
+
+/* DMA1 transmit stream interrupt: transmit data queued */
+static void dma_tx_isr(eeprom_ctx_t *ctx)
+{
+	if (dma_get_interrupt_flag(EEPROM_DMA, ctx->hw->dma_tx_stream, DMA_TCIF)) {
+		dma_clear_interrupt_flags(EEPROM_DMA, ctx->hw->dma_tx_stream, DMA_TCIF);
+		/* the event interrupt sends STOP on BTF */
+		dma_stop(ctx);
+	}
+}
+
+/* GPIO port clock: the port registers and the clock enable bits follow
+ * the same order */
+static enum rcc_periph_clken gpio_clock(uint32_t port)
+{
+	return (enum rcc_periph_clken)(RCC_GPIOA + ((port - GPIOA) / (GPIOB - GPIOA)));
+}
+
+
+/* I2C1 event interrupt */
+void i2c1_ev_isr(void)
+{
+	ev_isr(&bus_ctx[0]);
+}
+
+
+/* I2C1 error interrupt */
+void i2c1_er_isr(void)
+{
+	er_isr(&bus_ctx[0]);
+}
+
+
+/* I2C2 event interrupt */
+void i2c2_ev_isr(void)
+{
+	ev_isr(&bus_ctx[1]);
+}
+
+
+/* I2C2 error interrupt */
+void i2c2_er_isr(void)
+{
+	er_isr(&bus_ctx[1]);
+}
+
+
+/* I2C3 event interrupt */
+void i2c3_ev_isr(void)
+{
+	ev_isr(&bus_ctx[2]);
+}
+
+
+/* I2C3 error interrupt */
+void i2c3_er_isr(void)
+{
+	er_isr(&bus_ctx[2]);
+}
+
+
+/* DMA1 stream 0 interrupt: I2C1 receive */
+void dma1_stream0_isr(void)
+{
+	dma_rx_isr(&bus_ctx[0]);
+}
+
+
+/* DMA1 stream 6 interrupt: I2C1 transmit */
+void dma1_stream6_isr(void)
+{
+	dma_tx_isr(&bus_ctx[0]);
+}
+
+
+/* DMA1 stream 3 interrupt: I2C2 receive */
+void dma1_stream3_isr(void)
+{
+	dma_rx_isr(&bus_ctx[1]);
+}
+
+
+/* DMA1 stream 7 interrupt: I2C2 transmit */
+void dma1_stream7_isr(void)
+{
+	dma_tx_isr(&bus_ctx[1]);
+}
+
+
+/* DMA1 stream 2 interrupt: I2C3 receive */
+void dma1_stream2_isr(void)
+{
+	dma_rx_isr(&bus_ctx[2]);
+}
+
+
+/* DMA1 stream 4 interrupt: I2C3 transmit */
+void dma1_stream4_isr(void)
 {
-	gpio_set(GPIOD, GPIO14);
+	dma_tx_isr(&bus_ctx[2]);
 }
 
 
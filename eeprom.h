@@ -23,22 +23,291 @@
 */
 
 
+#ifndef _EEPROM_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_INCLUDED_		/* one time. */
 
 
 /* ----------- Exported constants ------------- */
 
-#define PAGE_SIZE		0x40
+/* Device types of the 24Cxx family */
+#define EEPROM_24C02	1
+#define EEPROM_24C04	2
+#define EEPROM_24C08	3
+#define EEPROM_24C16	4
+#define EEPROM_24C32	5
+#define EEPROM_24C64	6
+#define EEPROM_24C128	7
+#define EEPROM_24C256	8
+#define EEPROM_24C512	9
+#define EEPROM_24CM01	10
+#define EEPROM_24CM02	11
+
+/* Device type the driver is built for */
+#ifndef EEPROM_CFG_DEVICE
+#define EEPROM_CFG_DEVICE	EEPROM_24C256
+#endif
+
+/* Geometry: page size, array size, memory address bytes and address bits
+ * sent as block select bits in the device address, in place of the
+ * lowest address pins */
+#if (EEPROM_CFG_DEVICE == EEPROM_24C02)
+#define PAGE_SIZE				0x08
+#define EEPROM_SIZE				0x100
+#define EEPROM_ADDRESS_BYTES	1
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C04)
+#define PAGE_SIZE				0x10
+#define EEPROM_SIZE				0x200
+#define EEPROM_ADDRESS_BYTES	1
+#define EEPROM_BLOCK_BITS		1
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C08)
+#define PAGE_SIZE				0x10
+#define EEPROM_SIZE				0x400
+#define EEPROM_ADDRESS_BYTES	1
+#define EEPROM_BLOCK_BITS		2
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C16)
+#define PAGE_SIZE				0x10
+#define EEPROM_SIZE				0x800
+#define EEPROM_ADDRESS_BYTES	1
+#define EEPROM_BLOCK_BITS		3
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C32)
+#define PAGE_SIZE				0x20
+#define EEPROM_SIZE				0x1000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C64)
+#define PAGE_SIZE				0x20
+#define EEPROM_SIZE				0x2000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C128)
+#define PAGE_SIZE				0x40
+#define EEPROM_SIZE				0x4000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C256)
+#define PAGE_SIZE				0x40
+#define EEPROM_SIZE				0x8000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24C512)
+#define PAGE_SIZE				0x80
+#define EEPROM_SIZE				0x10000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		0
+#elif (EEPROM_CFG_DEVICE == EEPROM_24CM01)
+#define PAGE_SIZE				0x100
+#define EEPROM_SIZE				0x20000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		1
+#elif (EEPROM_CFG_DEVICE == EEPROM_24CM02)
+#define PAGE_SIZE				0x100
+#define EEPROM_SIZE				0x40000
+#define EEPROM_ADDRESS_BYTES	2
+#define EEPROM_BLOCK_BITS		2
+#else
+#error "EEPROM_CFG_DEVICE: unknown device type"
+#endif
+
 #define PAGE_MASK		(PAGE_SIZE-1)
+#define EEPROM_PAGES	(EEPROM_SIZE / PAGE_SIZE)
+
+/* Devices on one bus: the address pins left by the block select bits */
+#define EEPROM_DEVICES	(8 >> EEPROM_BLOCK_BITS)
+
+/* Record framing: CRC-32 (MPEG-2) appended to the data, MSB first */
+#define EEPROM_RECORD_CRC_SIZE	4
+
+/* Segments of one scatter/gather call */
+#define EEPROM_IOV_MAX			16
+
+/* Latency histogram buckets: bucket n counts the transfers of 2^n to
+ * 2^(n+1) - 1 us, the first one those below 2 us, the last one the
+ * longer ones */
+#define EEPROM_PERF_BUCKETS		16
+
+/* Operation types of the performance counters */
+enum {
+	EEPROM_PERF_WRITE,		/* page and byte writes */
+	EEPROM_PERF_READ,		/* plain reads */
+	EEPROM_PERF_PROBE,		/* ACK polling address frames */
+	EEPROM_PERF_CHECK,		/* checksum, record and compare reads */
+	EEPROM_PERF_OPS
+};
+
+/* Data transfer modes */
+enum {
+	EEPROM_MODE_IRQ,	/* data bytes moved by the CPU in the I2C interrupt */
+	EEPROM_MODE_DMA		/* data bytes moved by DMA1 */
+};
+
+/* Bus speeds */
+enum {
+	EEPROM_SPEED_100K,	/* standard mode */
+	EEPROM_SPEED_400K,	/* fast mode */
+	EEPROM_SPEED_1M		/* fast mode plus: 1 MHz parts on an I2C peripheral
+						 * rated for it, the STM32F4 one runs standard mode */
+};
+
+/* Bus speed of the default context */
+#ifndef EEPROM_CFG_SPEED
+#define EEPROM_CFG_SPEED	EEPROM_SPEED_400K
+#endif
+
+/* Transfer engine status */
+enum {
+	EEPROM_ST_IDLE,		/* no transfer requested yet */
+	EEPROM_ST_BUSY,		/* transfer ongoing */
+	EEPROM_ST_DONE,		/* last transfer completed successfully */
+	EEPROM_ST_NACK,		/* last transfer not acknowledged by the device */
+	EEPROM_ST_ERROR,	/* last transfer aborted by a bus error */
+	EEPROM_ST_CRC		/* last record read with a wrong CRC */
+};
+
+/* ----------- Exported types ------------- */
+
+/* Memory address: 16 bits up to 64 KB arrays */
+#if (EEPROM_SIZE > 0x10000)
+typedef uint32_t eeprom_addr_t;
+#else
+typedef uint16_t eeprom_addr_t;
+#endif
+
+/* Bus context: transfer engine of one I2C peripheral, opaque */
+typedef struct eeprom_ctx eeprom_ctx_t;
+
+/* Bus configuration */
+typedef struct {
+	uint32_t i2c;		/* I2C peripheral: I2C1, I2C2 or I2C3 */
+	uint32_t scl_port;	/* SCL pin, alternate function 4 */
+	uint16_t scl_pin;
+	uint32_t sda_port;	/* SDA pin, alternate function 4 */
+	uint16_t sda_pin;
+	uint8_t speed;		/* bus speed */
+	uint8_t mode;		/* data transfer mode */
+	uint8_t device;		/* address pins of the device, below EEPROM_DEVICES */
+} eeprom_bus_cfg_t;
+
+/* Pointer to transfer completion callback. It is called from the I2C
+ * interrupt with the final transfer status. */
+typedef void (*eeprom_cb_ptr_t)(uint8_t);
+
+/* Pointer to write observer: address, data and length of a write and its
+ * final status. It is called from the I2C interrupt. */
+typedef void (*eeprom_write_hook_t)(eeprom_addr_t, uint8_t *, uint16_t, uint8_t);
+
+/* Write cycle predictor statistics */
+typedef struct {
+	uint32_t twr_avg_us;	/* learned write cycle time: delay of the first probe */
+	uint32_t twr_max_us;	/* longest write cycle seen */
+	uint32_t cycles;		/* write cycles waited */
+	uint32_t probes;		/* ACK polling address frames sent */
+	uint32_t nacks;			/* ACK polling address frames NACKed */
+} eeprom_twr_stats_t;
+
+/* Performance counters of one operation type */
+typedef struct {
+	uint32_t transfers;		/* transfers ended, whatever the result */
+	uint32_t nacks;			/* transfers not acknowledged: busy or absent device */
+	uint32_t errors;		/* transfers aborted by a bus error */
+	uint32_t bytes;			/* data bytes moved by the completed transfers */
+	uint32_t events;		/* I2C event interrupts served */
+	uint32_t latency[EEPROM_PERF_BUCKETS];	/* transfers by log2 of the latency in us */
+} eeprom_perf_op_t;
+
+/* Performance counters of a bus, always on */
+typedef struct {
+	eeprom_perf_op_t ops[EEPROM_PERF_OPS];	/* by EEPROM_PERF_x */
+	uint32_t stop_spins;	/* loops waiting for the previous STOP before a START */
+	uint32_t blocking_us;	/* time of the transfers with no callback, spent by
+							 * the blocking calls waiting for the completion */
+} eeprom_perf_stats_t;
+
+/* Scatter/gather segment: device region and the caller buffer holding it */
+typedef struct {
+	eeprom_addr_t address;	/* first byte in the device */
+	uint8_t *data_ptr;		/* caller buffer */
+	uint16_t data_length;	/* bytes */
+} eeprom_iovec_t;
+
+/* Update statistics */
+typedef struct {
+	uint16_t pages_skipped;		/* pages already holding the data */
+	uint16_t pages_partial;		/* pages written from the first to the last changed byte */
+	uint16_t pages_rewritten;	/* pages written in full */
+	uint16_t bytes_written;		/* bytes sent to the device */
+} eeprom_update_stats_t;
 
 /* ----------- Exported functions prototypes ------------- */
 
 extern void eeprom_init(void);
-extern bool eeprom_write_byte(uint16_t, uint8_t);
-extern bool eeprom_write_page(uint16_t, uint8_t *, uint16_t);
-extern bool eeprom_write_block(uint16_t, uint8_t *, uint16_t);
-extern bool eeprom_read_byte(uint16_t, uint8_t *);
-extern bool eeprom_read_page(uint16_t, uint8_t *, uint16_t);
-extern bool eeprom_read_block(uint16_t, uint8_t *, uint16_t);
+extern void eeprom_init_mode(uint8_t);
+extern bool eeprom_init_speed(uint8_t);
+extern bool eeprom_write_page_async(eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_read_page_async(eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_read_block_async(eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_probe_async(eeprom_cb_ptr_t);
+extern bool eeprom_write_block_async(eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_write_block_busy(void);
+extern bool eeprom_wait_ready(void);
+extern bool eeprom_dev_wait_ready(uint8_t);
+extern void eeprom_get_twr_stats(eeprom_twr_stats_t *);
+extern void eeprom_get_perf_stats(eeprom_perf_stats_t *);
+extern void eeprom_reset_perf_stats(void);
+extern void eeprom_set_write_hook(eeprom_write_hook_t);
+extern uint8_t eeprom_get_status(void);
+extern bool eeprom_write_byte(eeprom_addr_t, uint8_t);
+extern bool eeprom_write_page(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_write_block(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_update_block(eeprom_addr_t, uint8_t *, uint16_t, eeprom_update_stats_t *);
+extern bool eeprom_read_byte(eeprom_addr_t, uint8_t *);
+extern bool eeprom_read_page(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_read_block(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_dev_write_page(uint8_t, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_dev_read_block(uint8_t, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_write_record(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_read_record(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_checksum_range(eeprom_addr_t, uint16_t, uint32_t *);
+extern bool eeprom_compare_block(eeprom_addr_t, const uint8_t *, uint16_t, uint16_t *);
+extern bool eeprom_readv(const eeprom_iovec_t *, uint8_t);
+extern bool eeprom_writev(const eeprom_iovec_t *, uint8_t);
+extern uint32_t eeprom_crc_block(const uint8_t *, uint16_t);
+
+extern eeprom_ctx_t *eeprom_ctx_init(const eeprom_bus_cfg_t *);
+extern eeprom_ctx_t *eeprom_default_ctx(void);
+extern bool eeprom_ctx_write_page_async(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_ctx_read_page_async(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_ctx_read_block_async(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_ctx_probe_async(eeprom_ctx_t *, eeprom_cb_ptr_t);
+extern bool eeprom_ctx_write_block_async(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_ctx_write_block_busy(eeprom_ctx_t *);
+extern bool eeprom_ctx_wait_ready(eeprom_ctx_t *);
+extern bool eeprom_ctx_dev_wait_ready(eeprom_ctx_t *, uint8_t);
+extern void eeprom_ctx_get_twr_stats(eeprom_ctx_t *, eeprom_twr_stats_t *);
+extern void eeprom_ctx_get_perf_stats(eeprom_ctx_t *, eeprom_perf_stats_t *);
+extern void eeprom_ctx_reset_perf_stats(eeprom_ctx_t *);
+extern void eeprom_ctx_set_write_hook(eeprom_ctx_t *, eeprom_write_hook_t);
+extern uint8_t eeprom_ctx_get_status(eeprom_ctx_t *);
+extern bool eeprom_ctx_write_byte(eeprom_ctx_t *, eeprom_addr_t, uint8_t);
+extern bool eeprom_ctx_write_page(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_write_block(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_update_block(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t, eeprom_update_stats_t *);
+extern bool eeprom_ctx_read_byte(eeprom_ctx_t *, eeprom_addr_t, uint8_t *);
+extern bool eeprom_ctx_read_page(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_read_block(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_dev_write_page(eeprom_ctx_t *, uint8_t, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_dev_read_block(eeprom_ctx_t *, uint8_t, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_write_record(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_read_record(eeprom_ctx_t *, eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_ctx_checksum_range(eeprom_ctx_t *, eeprom_addr_t, uint16_t, uint32_t *);
+extern bool eeprom_ctx_compare_block(eeprom_ctx_t *, eeprom_addr_t, const uint8_t *, uint16_t, uint16_t *);
+extern bool eeprom_ctx_readv(eeprom_ctx_t *, const eeprom_iovec_t *, uint8_t);
+extern bool eeprom_ctx_writev(eeprom_ctx_t *, const eeprom_iovec_t *, uint8_t);
+
+
+
+
+#endif
 
 
 
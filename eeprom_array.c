@@ -0,0 +1,204 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Device array: 2 to 8 devices of the same bus, address pins 0 to N-1,
+ * seen as one address space striped by pages. Stripe S of the logical
+ * space is stored by device S % N, so consecutive stripes go to different
+ * devices: a page is written to the next device while the previous ones
+ * are still in their internal write cycle, and a device is waited only
+ * when its turn comes again. The write bandwidth grows with the devices
+ * until the bus is busy all the time.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "eeprom.h"
+#include "eeprom_array.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Longest sequential read of one transfer */
+#define ARRAY_READ_MAX		0xFFFF
+
+#if (EEPROM_DEVICES < 2)
+#error "EEPROM_CFG_DEVICE: the block select bits leave no address pins for an array"
+#endif
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Devices and stripe unit in pages */
+static uint8_t array_devices = 1;
+static uint16_t array_stripe_pages = 1;
+
+/* Devices written since the last sync */
+static uint8_t array_written = 0;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint8_t map_address(uint32_t, eeprom_addr_t *, uint32_t *);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to set the devices of the array and the stripe unit in pages,
+ * a divider of the device pages. Return false if not valid. */
+bool eeprom_array_init(uint8_t devices, uint16_t stripe_pages)
+{
+	bool success = false;
+
+	if ((devices > 0) && (devices <= EEPROM_DEVICES)
+	&& (stripe_pages > 0) && (0 == (EEPROM_PAGES % stripe_pages))) {
+		array_devices = devices;
+		array_stripe_pages = stripe_pages;
+		array_written = 0;
+		success = true;
+	}
+
+	return success;
+}
+
+
+/* Function to get the size of the logical address space */
+uint32_t eeprom_array_size(void)
+{
+	return (uint32_t)array_devices * EEPROM_SIZE;
+}
+
+
+/* Function to write any length of the logical space, page by page. A
+ * device is waited only before its next page, the others keep writing. */
+bool eeprom_array_write(uint32_t address, uint8_t *byte_ptr, uint32_t data_length)
+{
+	eeprom_addr_t device_address;
+	uint32_t stripe_left;
+	uint16_t chunk_size;
+	uint8_t device;
+
+	if ((address + data_length) > eeprom_array_size()) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		device = map_address(address, &device_address, &stripe_left);
+		chunk_size = PAGE_SIZE - (device_address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = (uint16_t)data_length;
+		}
+		if (!eeprom_dev_wait_ready(device)
+		|| !eeprom_dev_write_page(device, device_address, byte_ptr, chunk_size)) {
+			return false;
+		}
+		array_written |= (uint8_t)(1 << device);
+		address += chunk_size;
+		byte_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return eeprom_array_sync();
+}
+
+
+/* Function to read any length of the logical space: one sequential read
+ * for each stripe, or for each 64 KiB of a longer stripe, after the end
+ * of the write cycle of its device only */
+bool eeprom_array_read(uint32_t address, uint8_t *byte_ptr, uint32_t data_length)
+{
+	eeprom_addr_t device_address;
+	uint32_t chunk_size;
+	uint8_t device;
+
+	if ((address + data_length) > eeprom_array_size()) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		device = map_address(address, &device_address, &chunk_size);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		if (chunk_size > ARRAY_READ_MAX) {
+			chunk_size = ARRAY_READ_MAX;
+		}
+		if (!eeprom_dev_wait_ready(device)
+		|| !eeprom_dev_read_block(device, device_address, byte_ptr, (uint16_t)chunk_size)) {
+			return false;
+		}
+		address += chunk_size;
+		byte_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Function to wait for the end of the write cycles of all the devices */
+bool eeprom_array_sync(void)
+{
+	bool success = true;
+	uint8_t device;
+
+	for (device = 0; device < array_devices; device++) {
+		if ((array_written & (1 << device)) != 0) {
+			success = eeprom_dev_wait_ready(device) && success;
+		}
+	}
+	array_written = 0;
+
+	return success;
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Device and device address of a logical address, bytes left in its stripe */
+static uint8_t map_address(uint32_t address, eeprom_addr_t *device_address_ptr, uint32_t *stripe_left_ptr)
+{
+	uint32_t stripe_size = (uint32_t)array_stripe_pages * PAGE_SIZE;
+	uint32_t stripe = address / stripe_size;
+	uint32_t offset = address % stripe_size;
+
+	*device_address_ptr = (eeprom_addr_t)((stripe / array_devices) * stripe_size + offset);
+	*stripe_left_ptr = stripe_size - offset;
+
+	return (uint8_t)(stripe % array_devices);
+}
+
+
+
+
+/* End of file */
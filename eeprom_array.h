@@ -0,0 +1,46 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_ARRAY_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_ARRAY_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_array_init(uint8_t, uint16_t);
+extern uint32_t eeprom_array_size(void);
+extern bool eeprom_array_write(uint32_t, uint8_t *, uint32_t);
+extern bool eeprom_array_read(uint32_t, uint8_t *, uint32_t);
+extern bool eeprom_array_sync(void);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
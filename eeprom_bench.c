@@ -0,0 +1,264 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include "eeprom.h"
+#include "eeprom_bench.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+#if (EEPROM_BENCH_START & PAGE_MASK) != 0
+#error "EEPROM_BENCH_START shall be page aligned"
+#endif
+
+/* The largest transfer may start at the last byte of a page */
+#if ((EEPROM_BENCH_START + EEPROM_BENCH_SIZE_MAX + PAGE_SIZE) > EEPROM_SIZE)
+#error "EEPROM_BENCH_SIZE_MAX: range beyond the end of the array"
+#endif
+
+/* Bytes moved by the iterations of a sweep case: the large transfers get
+ * fewer iterations, down to the minimum */
+#define BENCH_CASE_BYTES		8192
+#define BENCH_ITERATIONS_MIN	4
+
+/* Bit times of a data byte: 8 bits and the acknowledge */
+#define BENCH_BYTE_BITS			9
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Start offsets in the page of the sweep: aligned, just after the boundary,
+ * mid page and last byte */
+static const uint16_t bench_offsets[] = {0, 1, PAGE_SIZE / 2, PAGE_SIZE - 1};
+
+/* SCL period, by EEPROM_SPEED_x */
+static const uint32_t bench_bit_ns[] = {10000, 2500, 1000};
+
+/* Data of the transfers */
+static uint8_t bench_buffer[EEPROM_BENCH_SIZE_MAX];
+
+/* Latencies of the case in progress, in DWT cycles */
+static uint32_t bench_samples[EEPROM_BENCH_SAMPLES];
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static bool bench_valid(const eeprom_bench_case_t *);
+static bool bench_op(uint8_t, eeprom_addr_t, uint16_t);
+static uint32_t bench_percentile(uint8_t, uint8_t);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to time one case: the default context is set to the case bus
+ * speed, then the operation is repeated at the same address. Each latency
+ * is taken by the DWT cycle counter.
+ * Return false on an invalid case or a device error. */
+bool eeprom_bench_run(const eeprom_bench_case_t *case_ptr, eeprom_bench_result_t *result_ptr)
+{
+	eeprom_addr_t address = (eeprom_addr_t)(EEPROM_BENCH_START + case_ptr->offset);
+	uint32_t cycles_per_us = rcc_ahb_frequency / 1000000;
+	uint64_t total_cycles = 0;
+	uint64_t total_us;
+	uint64_t data_bits;
+	uint32_t start_cycles;
+	uint16_t i;
+	bool success;
+
+	success = bench_valid(case_ptr)
+			&& eeprom_init_speed(case_ptr->speed)
+			&& eeprom_wait_ready();
+
+	for (i = 0; success && (i < case_ptr->size); i++) {
+		bench_buffer[i] = (uint8_t)(i ^ case_ptr->offset);
+	}
+
+	for (i = 0; success && (i < case_ptr->iterations); i++) {
+		start_cycles = dwt_read_cycle_counter();
+		success = bench_op(case_ptr->op, address, case_ptr->size);
+		bench_samples[i] = dwt_read_cycle_counter() - start_cycles;
+		total_cycles += bench_samples[i];
+	}
+
+	if (success) {
+		total_us = total_cycles / cycles_per_us;
+		if (0 == total_us) {
+			total_us = 1;
+		}
+		data_bits = (uint64_t)case_ptr->iterations * case_ptr->size * BENCH_BYTE_BITS;
+
+		result_ptr->bench_case = *case_ptr;
+		result_ptr->ops_per_s = (uint32_t)(((uint64_t)case_ptr->iterations * 1000000) / total_us);
+		result_ptr->bytes_per_s = (uint32_t)(((uint64_t)case_ptr->iterations * case_ptr->size * 1000000) / total_us);
+		result_ptr->p50_us = bench_percentile(case_ptr->iterations, 50) / cycles_per_us;
+		result_ptr->p99_us = bench_percentile(case_ptr->iterations, 99) / cycles_per_us;
+		result_ptr->overhead_pct = (uint32_t)((total_us * 1000 * 100) / (data_bits * bench_bit_ns[case_ptr->speed]));
+	}
+
+	return success;
+}
+
+
+/* Function to run the sweep: bus speeds up to EEPROM_BENCH_SPEED_LAST,
+ * operations, sizes from 1 byte to EEPROM_BENCH_SIZE_MAX by powers of two
+ * and start offsets in the page. The cases an operation does not take,
+ * e.g. a page write across the page boundary, are skipped. Each result
+ * goes to the sink as soon as it is taken. The default context is left at
+ * EEPROM_CFG_SPEED in the default mode.
+ * Return false on a device error. */
+bool eeprom_bench_sweep(eeprom_bench_sink_t sink_ptr)
+{
+	eeprom_bench_case_t bench_case;
+	eeprom_bench_result_t result;
+	uint32_t iterations;
+	uint32_t size;
+	uint8_t speed;
+	uint8_t op;
+	uint8_t i;
+	bool success = true;
+
+	for (speed = EEPROM_SPEED_100K; success && (speed <= EEPROM_BENCH_SPEED_LAST); speed++) {
+		for (op = 0; success && (op < EEPROM_BENCH_OPS); op++) {
+			for (size = 1; success && (size <= EEPROM_BENCH_SIZE_MAX); size <<= 1) {
+				iterations = BENCH_CASE_BYTES / size;
+				if (iterations > EEPROM_BENCH_SAMPLES) {
+					iterations = EEPROM_BENCH_SAMPLES;
+				} else if (iterations < BENCH_ITERATIONS_MIN) {
+					iterations = BENCH_ITERATIONS_MIN;
+				}
+
+				for (i = 0; success && (i < (sizeof(bench_offsets) / sizeof(bench_offsets[0]))); i++) {
+					bench_case.op = op;
+					bench_case.speed = speed;
+					bench_case.size = (uint16_t)size;
+					bench_case.offset = bench_offsets[i];
+					bench_case.iterations = (uint8_t)iterations;
+
+					if (bench_valid(&bench_case)) {
+						success = eeprom_bench_run(&bench_case, &result);
+						if (success) {
+							sink_ptr(&result);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	(void)eeprom_init_speed(EEPROM_CFG_SPEED);
+
+	return success;
+}
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Check a case: the byte read moves one byte and the page operations stay
+ * in their page */
+static bool bench_valid(const eeprom_bench_case_t *case_ptr)
+{
+	bool valid = (case_ptr->op < EEPROM_BENCH_OPS)
+			&& (case_ptr->speed <= EEPROM_SPEED_1M)
+			&& (case_ptr->size > 0) && (case_ptr->size <= EEPROM_BENCH_SIZE_MAX)
+			&& (case_ptr->offset < PAGE_SIZE)
+			&& (case_ptr->iterations > 0) && (case_ptr->iterations <= EEPROM_BENCH_SAMPLES);
+
+	if (EEPROM_BENCH_READ_BYTE == case_ptr->op) {
+		valid = valid && (1 == case_ptr->size);
+	} else if ((EEPROM_BENCH_READ_PAGE == case_ptr->op) || (EEPROM_BENCH_WRITE_PAGE == case_ptr->op)) {
+		valid = valid && ((case_ptr->offset + case_ptr->size) <= PAGE_SIZE);
+	} else {
+		/* any length */
+	}
+
+	return valid;
+}
+
+
+/* Run one operation: a write ends with its write cycle */
+static bool bench_op(uint8_t op, eeprom_addr_t address, uint16_t size)
+{
+	bool success;
+
+	switch (op) {
+	case EEPROM_BENCH_READ_BYTE:
+		success = eeprom_read_byte(address, bench_buffer);
+		break;
+	case EEPROM_BENCH_READ_PAGE:
+		success = eeprom_read_page(address, bench_buffer, size);
+		break;
+	case EEPROM_BENCH_READ_BLOCK:
+		success = eeprom_read_block(address, bench_buffer, size);
+		break;
+	case EEPROM_BENCH_WRITE_PAGE:
+		success = eeprom_write_page(address, bench_buffer, size) && eeprom_wait_ready();
+		break;
+	default:
+		/* the block write waits for each write cycle */
+		success = eeprom_write_block(address, bench_buffer, size);
+		break;
+	}
+
+	return success;
+}
+
+
+/* Sort the samples and take a percentile by the nearest rank */
+static uint32_t bench_percentile(uint8_t count, uint8_t percent)
+{
+	uint32_t sample;
+	uint8_t i;
+	uint8_t j;
+
+	for (i = 1; i < count; i++) {
+		sample = bench_samples[i];
+		for (j = i; (j > 0) && (bench_samples[j - 1] > sample); j--) {
+			bench_samples[j] = bench_samples[j - 1];
+		}
+		bench_samples[j] = sample;
+	}
+
+	return bench_samples[(((uint16_t)count * percent) + 99) / 100 - 1];
+}
+
+
+
+
+/* End of file */
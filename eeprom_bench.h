@@ -0,0 +1,101 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _EEPROM_BENCH_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_BENCH_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Device range used by the benchmark: its content is overwritten */
+#ifndef EEPROM_BENCH_START
+#define EEPROM_BENCH_START		0x0000
+#endif
+
+/* Largest transfer of the sweep */
+#ifndef EEPROM_BENCH_SIZE_MAX
+#if (EEPROM_SIZE >= 0x2000)
+#define EEPROM_BENCH_SIZE_MAX	4096
+#else
+#define EEPROM_BENCH_SIZE_MAX	(EEPROM_SIZE / 2)
+#endif
+#endif
+
+/* Last bus speed of the sweep: the STM32F4 I2C peripheral tops at fast
+ * mode */
+#ifndef EEPROM_BENCH_SPEED_LAST
+#define EEPROM_BENCH_SPEED_LAST	EEPROM_SPEED_400K
+#endif
+
+/* Latency samples of one case */
+#define EEPROM_BENCH_SAMPLES	32
+
+/* Operations */
+enum {
+	EEPROM_BENCH_READ_BYTE,		/* eeprom_read_byte, one byte only */
+	EEPROM_BENCH_READ_PAGE,		/* eeprom_read_page, within a page */
+	EEPROM_BENCH_READ_BLOCK,	/* eeprom_read_block */
+	EEPROM_BENCH_WRITE_PAGE,	/* eeprom_write_page, within a page */
+	EEPROM_BENCH_WRITE_BLOCK,	/* eeprom_write_block */
+	EEPROM_BENCH_OPS
+};
+
+/* ----------- Exported types ------------- */
+
+/* Benchmark case */
+typedef struct {
+	uint8_t op;				/* EEPROM_BENCH_x operation */
+	uint8_t speed;			/* EEPROM_SPEED_x bus speed */
+	uint16_t size;			/* bytes per operation */
+	uint16_t offset;		/* first byte offset in its page */
+	uint8_t iterations;		/* timed operations, up to EEPROM_BENCH_SAMPLES */
+} eeprom_bench_case_t;
+
+/* Benchmark result: a write is timed up to the end of its write cycle */
+typedef struct {
+	eeprom_bench_case_t bench_case;
+	uint32_t ops_per_s;
+	uint32_t bytes_per_s;
+	uint32_t p50_us;			/* median latency */
+	uint32_t p99_us;			/* 99th percentile latency */
+	uint32_t overhead_pct;		/* time against the data bits alone on the
+								 * bus, in percent: 100 is the bus limit */
+} eeprom_bench_result_t;
+
+/* Pointer to result sink, called once per case of a sweep */
+typedef void (*eeprom_bench_sink_t)(const eeprom_bench_result_t *);
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_bench_run(const eeprom_bench_case_t *, eeprom_bench_result_t *);
+extern bool eeprom_bench_sweep(eeprom_bench_sink_t);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
@@ -0,0 +1,499 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeprom.h"
+#include "eeprom_cache.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+#if (EEPROM_CACHE_PAGES < 1) || (EEPROM_CACHE_PAGES > 32)
+#error "EEPROM_CACHE_PAGES shall be in 1..32: one dirty bit per page"
+#endif
+
+#if (EEPROM_CACHE_PREFETCH >= EEPROM_CACHE_PAGES)
+#error "EEPROM_CACHE_PREFETCH shall leave a slot to the requested page"
+#endif
+
+/* No slot selected */
+#define CACHE_NO_SLOT				0xFF
+
+/* No page read yet */
+#define CACHE_NO_PAGE				0xFFFF
+
+/* Hook executed while waiting for a page flush */
+#ifndef EEPROM_CFG_IDLE_HOOK
+#define EEPROM_CFG_IDLE_HOOK()
+#endif
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Cached pages: a dirty page holds data not yet written to the device */
+static struct {
+	volatile bool valid;		/* slot holds a page */
+	uint16_t page;				/* page number */
+	bool prefetched;			/* read ahead and not used yet */
+	uint32_t stamp;				/* last use, for LRU replacement */
+	uint8_t data[PAGE_SIZE];	/* whole page image */
+} cache_slots[EEPROM_CACHE_PAGES];
+
+/* Dirty pages bitmap, one bit per slot */
+static uint32_t cache_dirty_bitmap;
+
+/* Slot written in background and result of its page write */
+static volatile uint8_t cache_flush_slot = CACHE_NO_SLOT;
+static volatile uint8_t cache_flush_status = EEPROM_ST_IDLE;
+
+/* Next slot checked by the background flush */
+static uint8_t cache_flush_next;
+
+/* Use counter stamping the slots */
+static uint32_t cache_clock;
+
+/* Last page read, to detect sequential access */
+static uint16_t cache_last_page = CACHE_NO_PAGE;
+
+/* Requested page and read ahead pages, read in one transaction */
+static uint8_t cache_staging[(1 + EEPROM_CACHE_PREFETCH) * PAGE_SIZE];
+
+/* Counters */
+static eeprom_cache_stats_t cache_stats;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint8_t find_slot(uint16_t);
+static uint8_t alloc_slot(uint16_t);
+static uint8_t load_pages(uint16_t, bool);
+static void touch_slot(uint8_t);
+static bool write_slot(uint8_t);
+static void wait_flush(void);
+static void flush_check(void);
+static void flush_done(uint8_t);
+static void write_hook(eeprom_addr_t, uint8_t *, uint16_t, uint8_t);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to init the cache: all slots free. Writes done through the
+ * driver directly are reported to the cache from now on. */
+void eeprom_cache_init(void)
+{
+	uint8_t slot;
+
+	for (slot = 0; slot < EEPROM_CACHE_PAGES; slot++) {
+		cache_slots[slot].valid = false;
+	}
+	cache_dirty_bitmap = 0;
+	cache_flush_slot = CACHE_NO_SLOT;
+	cache_flush_status = EEPROM_ST_IDLE;
+	cache_flush_next = 0;
+	cache_clock = 0;
+	cache_last_page = CACHE_NO_PAGE;
+	eeprom_cache_reset_stats();
+
+	eeprom_set_write_hook(&write_hook);
+}
+
+
+/* RTOS task: write one dirty page per call in background. The page write
+ * runs on the interrupts; its write cycle is over by the next call. */
+void eeprom_cache_task(void)
+{
+	uint8_t slot;
+	uint8_t i;
+
+	if (CACHE_NO_SLOT == cache_flush_slot) {
+		flush_check();
+
+		for (i = 0; i < EEPROM_CACHE_PAGES; i++) {
+			slot = (uint8_t)((cache_flush_next + i) % EEPROM_CACHE_PAGES);
+			if ((cache_dirty_bitmap & (1u << slot)) != 0) {
+				/* the previous write cycle shall be over */
+				if (eeprom_wait_ready()) {
+					cache_flush_next = slot;
+					cache_flush_slot = slot;
+					cache_flush_status = EEPROM_ST_BUSY;
+					/* a write to the page from now on makes it dirty again */
+					cache_dirty_bitmap &= ~(1u << slot);
+					if (!eeprom_write_page_async((eeprom_addr_t)(cache_slots[slot].page * PAGE_SIZE),
+												cache_slots[slot].data, PAGE_SIZE, &flush_done)) {
+						/* engine busy: retry at next call */
+						cache_dirty_bitmap |= (1u << slot);
+						cache_flush_slot = CACHE_NO_SLOT;
+						cache_flush_status = EEPROM_ST_IDLE;
+					}
+				}
+				break;
+			}
+		}
+	}
+}
+
+
+/* Function to write any length starting from a specific address. The data
+ * is written to the cached pages only, the device is updated by the
+ * background flush. Missing pages are loaded first unless fully written. */
+bool eeprom_cache_write(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+	uint16_t page;
+	uint8_t slot;
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		page = address / PAGE_SIZE;
+
+		slot = find_slot(page);
+		if (CACHE_NO_SLOT == slot) {
+			if (chunk_size < PAGE_SIZE) {
+				slot = load_pages(page, false);
+			} else {
+				slot = alloc_slot(page);
+			}
+			if (CACHE_NO_SLOT == slot) {
+				return false;
+			}
+		}
+		cache_slots[slot].prefetched = false;
+		touch_slot(slot);
+
+		memcpy(&cache_slots[slot].data[address & PAGE_MASK], data_ptr, chunk_size);
+		/* a page written in full holds its data with no load */
+		cache_slots[slot].valid = true;
+		cache_dirty_bitmap |= (1u << slot);
+
+		address += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Function to read any length starting from a specific address. Missing
+ * pages are loaded into the cache; on sequential access the following
+ * EEPROM_CACHE_PREFETCH pages are read ahead in the same transaction. */
+bool eeprom_cache_read(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+	uint16_t page;
+	uint8_t slot;
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		page = address / PAGE_SIZE;
+
+		slot = find_slot(page);
+		if (slot != CACHE_NO_SLOT) {
+			cache_stats.hits++;
+			if (cache_slots[slot].prefetched) {
+				cache_stats.prefetch_hits++;
+				cache_slots[slot].prefetched = false;
+			}
+		} else {
+			cache_stats.misses++;
+			slot = load_pages(page, (page == (uint16_t)(cache_last_page + 1)));
+			if (CACHE_NO_SLOT == slot) {
+				return false;
+			}
+		}
+		touch_slot(slot);
+		cache_last_page = page;
+
+		memcpy(data_ptr, &cache_slots[slot].data[address & PAGE_MASK], chunk_size);
+
+		address += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Function to write all the dirty pages to the device, e.g. before
+ * shutdown. It returns when the last write cycle is over. */
+bool eeprom_cache_flush(void)
+{
+	bool success = true;
+	uint8_t slot;
+
+	wait_flush();
+	for (slot = 0; slot < EEPROM_CACHE_PAGES; slot++) {
+		if ((cache_dirty_bitmap & (1u << slot)) != 0) {
+			success = write_slot(slot) && success;
+		}
+	}
+
+	return eeprom_wait_ready() && success;
+}
+
+
+/* Function to get the number of pages not yet written to the device,
+ * including the one written in background */
+uint8_t eeprom_cache_dirty_pages(void)
+{
+	uint32_t bitmap = cache_dirty_bitmap;
+	uint8_t flush_slot = cache_flush_slot;
+	uint8_t count = 0;
+
+	if (flush_slot != CACHE_NO_SLOT) {
+		bitmap |= (1u << flush_slot);
+	}
+
+	while (bitmap != 0) {
+		bitmap &= bitmap - 1;
+		count++;
+	}
+
+	return count;
+}
+
+
+/* Function to get the cache counters */
+void eeprom_cache_get_stats(eeprom_cache_stats_t *stats_ptr)
+{
+	*stats_ptr = cache_stats;
+}
+
+
+/* Function to clear the cache counters */
+void eeprom_cache_reset_stats(void)
+{
+	memset(&cache_stats, 0, sizeof(cache_stats));
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Get the slot holding a page */
+static uint8_t find_slot(uint16_t page)
+{
+	uint8_t slot;
+
+	for (slot = 0; slot < EEPROM_CACHE_PAGES; slot++) {
+		if (cache_slots[slot].valid && (cache_slots[slot].page == page)) {
+			return slot;
+		}
+	}
+
+	return CACHE_NO_SLOT;
+}
+
+
+/* Get a slot for a page: a free one, else the least recently used one,
+ * written back first if dirty. The slot content is not loaded. */
+static uint8_t alloc_slot(uint16_t page)
+{
+	uint8_t slot = CACHE_NO_SLOT;
+	uint8_t i;
+
+	for (i = 0; i < EEPROM_CACHE_PAGES; i++) {
+		if (!cache_slots[i].valid) {
+			slot = i;
+			break;
+		}
+		if ((CACHE_NO_SLOT == slot)
+		|| ((cache_clock - cache_slots[i].stamp) > (cache_clock - cache_slots[slot].stamp))) {
+			slot = i;
+		}
+	}
+
+	if (cache_slots[slot].valid) {
+		cache_stats.evictions++;
+		wait_flush();
+		if ((cache_dirty_bitmap & (1u << slot)) != 0) {
+			cache_stats.write_backs++;
+			if (!write_slot(slot)) {
+				return CACHE_NO_SLOT;
+			}
+		}
+		/* invalid while refilled: the write hook skips it */
+		cache_slots[slot].valid = false;
+	}
+
+	cache_slots[slot].page = page;
+	cache_slots[slot].prefetched = false;
+	touch_slot(slot);
+
+	return slot;
+}
+
+
+/* Load a page, and the missing pages after it when read ahead, with one
+ * sequential read. Return the slot of the requested page. */
+static uint8_t load_pages(uint16_t page, bool read_ahead)
+{
+	uint8_t pages = 1;
+	uint8_t slot = CACHE_NO_SLOT;
+	uint8_t first_slot = CACHE_NO_SLOT;
+	uint8_t i;
+
+	if (read_ahead) {
+		while ((pages <= EEPROM_CACHE_PREFETCH)
+		&& ((page + pages) < EEPROM_PAGES)
+		&& (CACHE_NO_SLOT == find_slot(page + pages))) {
+			pages++;
+		}
+	}
+
+	wait_flush();
+	if (!eeprom_wait_ready()
+	|| !eeprom_read_block((eeprom_addr_t)(page * PAGE_SIZE), cache_staging, (uint16_t)(pages * PAGE_SIZE))) {
+		return CACHE_NO_SLOT;
+	}
+
+	for (i = 0; i < pages; i++) {
+		slot = alloc_slot((uint16_t)(page + i));
+		if (CACHE_NO_SLOT == slot) {
+			break;
+		}
+		memcpy(cache_slots[slot].data, &cache_staging[i * PAGE_SIZE], PAGE_SIZE);
+		cache_slots[slot].prefetched = (i > 0);
+		cache_slots[slot].valid = true;
+		if (0 == i) {
+			first_slot = slot;
+		} else {
+			cache_stats.prefetches++;
+		}
+	}
+
+	return first_slot;
+}
+
+
+/* Mark a slot as the most recently used */
+static void touch_slot(uint8_t slot)
+{
+	cache_clock++;
+	cache_slots[slot].stamp = cache_clock;
+}
+
+
+/* Write a dirty page and clean it */
+static bool write_slot(uint8_t slot)
+{
+	bool success = eeprom_wait_ready()
+				&& eeprom_write_page((eeprom_addr_t)(cache_slots[slot].page * PAGE_SIZE),
+									cache_slots[slot].data, PAGE_SIZE);
+
+	if (success) {
+		cache_dirty_bitmap &= ~(1u << slot);
+	}
+
+	return success;
+}
+
+
+/* Wait for the end of the background page write */
+static void wait_flush(void)
+{
+	while (cache_flush_slot != CACHE_NO_SLOT) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+	flush_check();
+}
+
+
+/* Account the end of the background page write */
+static void flush_check(void)
+{
+	if (cache_flush_status != EEPROM_ST_IDLE) {
+		/* keep the page dirty if the write failed */
+		if (cache_flush_status != EEPROM_ST_DONE) {
+			cache_dirty_bitmap |= (1u << cache_flush_next);
+		}
+		cache_flush_next = (uint8_t)((cache_flush_next + 1) % EEPROM_CACHE_PAGES);
+		cache_flush_status = EEPROM_ST_IDLE;
+	}
+}
+
+
+/* Background page write done (I2C interrupt) */
+static void flush_done(uint8_t status)
+{
+	cache_flush_status = status;
+	cache_flush_slot = CACHE_NO_SLOT;
+}
+
+
+/* Write done through the driver (I2C interrupt): update the cached pages
+ * it covers, or drop the clean ones if the device content is unknown */
+static void write_hook(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, uint8_t status)
+{
+	uint16_t chunk_size;
+	uint8_t *cached_ptr;
+	uint8_t slot;
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+
+		slot = find_slot(address / PAGE_SIZE);
+		if (slot != CACHE_NO_SLOT) {
+			cached_ptr = &cache_slots[slot].data[address & PAGE_MASK];
+			if (cached_ptr == data_ptr) {
+				/* page written back by the cache itself */
+			} else if (EEPROM_ST_DONE == status) {
+				memcpy(cached_ptr, data_ptr, chunk_size);
+			} else if (0 == (cache_dirty_bitmap & (1u << slot))) {
+				cache_slots[slot].valid = false;
+			} else {
+				/* dirty: the whole page will be written again */
+			}
+		}
+
+		address += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,73 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_CACHE_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_CACHE_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Number of pages held in RAM */
+#ifndef EEPROM_CACHE_PAGES
+#define EEPROM_CACHE_PAGES		4
+#endif
+
+/* Pages read ahead on sequential access */
+#ifndef EEPROM_CACHE_PREFETCH
+#define EEPROM_CACHE_PREFETCH	1
+#endif
+
+/* ----------- Exported types ------------- */
+
+/* Cache counters */
+typedef struct {
+	uint32_t hits;				/* pages read from RAM */
+	uint32_t misses;			/* pages read from the device */
+	uint32_t prefetches;		/* pages read ahead */
+	uint32_t prefetch_hits;		/* pages read ahead and then used */
+	uint32_t evictions;			/* pages replaced */
+	uint32_t write_backs;		/* dirty pages written on replacement */
+} eeprom_cache_stats_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern void eeprom_cache_init(void);
+extern void eeprom_cache_task(void);
+extern bool eeprom_cache_write(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_cache_read(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_cache_flush(void);
+extern uint8_t eeprom_cache_dirty_pages(void);
+extern void eeprom_cache_get_stats(eeprom_cache_stats_t *);
+extern void eeprom_cache_reset_stats(void);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
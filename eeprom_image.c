@@ -0,0 +1,197 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "eeprom.h"
+#include "eeprom_image.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+#if (EEPROM_IMAGE_CHUNK < PAGE_SIZE) || (EEPROM_IMAGE_CHUNK > 0x8000)
+#error "EEPROM_IMAGE_CHUNK shall hold a page and fit a transfer"
+#endif
+
+/* Hook executed while waiting for a transfer */
+#ifndef EEPROM_CFG_IDLE_HOOK
+#define EEPROM_CFG_IDLE_HOOK()
+#endif
+
+
+
+
+/* ------------- Local typedef definitions ------------- */
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Ping-pong buffers: one on the bus, the other one at the sink or source */
+static uint8_t image_buffer[2][EEPROM_IMAGE_CHUNK];
+
+/* Result of the transfer on the bus */
+static volatile uint8_t image_status = EEPROM_ST_IDLE;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static void transfer_done(uint8_t);
+static bool wait_transfer(void);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to dump a device range to a sink. Each chunk is read by one
+ * sequential read while the sink takes the previous one: the bus does not
+ * wait for the sink, and the reads after the first one are current
+ * address reads.
+ * Return false on a range beyond the array, a device error or a sink
+ * stop. */
+bool eeprom_image_dump(eeprom_addr_t address, uint32_t length, eeprom_image_sink_t sink_ptr)
+{
+	uint8_t buffer = 0;
+	uint16_t chunk_size;
+	uint16_t next_size;
+	bool reading = false;
+	bool success;
+
+	if (((uint32_t)address + length) > EEPROM_SIZE) {
+		return false;
+	}
+
+	chunk_size = (length > EEPROM_IMAGE_CHUNK) ? EEPROM_IMAGE_CHUNK : (uint16_t)length;
+	image_status = EEPROM_ST_BUSY;
+	success = eeprom_wait_ready()
+			&& ((0 == length) || eeprom_read_block_async(address, image_buffer[buffer], chunk_size, &transfer_done));
+	reading = success && (length > 0);
+
+	while (success && (length > 0)) {
+		/* chunk in the buffer: start the next one in the other buffer */
+		success = wait_transfer();
+		reading = false;
+		length -= chunk_size;
+		if (success && (length > 0)) {
+			next_size = (length > EEPROM_IMAGE_CHUNK) ? EEPROM_IMAGE_CHUNK : (uint16_t)length;
+			image_status = EEPROM_ST_BUSY;
+			success = eeprom_read_block_async((eeprom_addr_t)(address + chunk_size), image_buffer[buffer ^ 1],
+											  next_size, &transfer_done);
+			reading = success;
+		} else {
+			next_size = 0;
+		}
+
+		success = success && (*sink_ptr)(address, image_buffer[buffer], chunk_size);
+
+		address += chunk_size;
+		chunk_size = next_size;
+		buffer ^= 1;
+	}
+
+	/* a sink stop leaves a read on the bus in its buffer */
+	if (reading) {
+		(void)wait_transfer();
+	}
+
+	return success;
+}
+
+
+/* Function to restore a device range from a source, one page write per
+ * page. The source stages the next page in the other buffer while the
+ * current one is on the bus and in its write cycle.
+ * Return false on a range beyond the array, a device error or a source
+ * stop. It returns when the last write cycle is over. */
+bool eeprom_image_restore(eeprom_addr_t address, uint32_t length, eeprom_image_source_t source_ptr)
+{
+	uint8_t buffer = 0;
+	uint16_t chunk_size;
+	uint16_t next_size;
+	bool success;
+
+	if (((uint32_t)address + length) > EEPROM_SIZE) {
+		return false;
+	}
+
+	chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+	if (chunk_size > length) {
+		chunk_size = (uint16_t)length;
+	}
+	success = (0 == length) || (*source_ptr)(address, image_buffer[buffer], chunk_size);
+
+	while (success && (length > 0)) {
+		/* the previous page shall be out of its write cycle */
+		image_status = EEPROM_ST_BUSY;
+		success = eeprom_wait_ready()
+				&& eeprom_write_page_async(address, image_buffer[buffer], chunk_size, &transfer_done);
+		if (success) {
+			length -= chunk_size;
+			address += chunk_size;
+			buffer ^= 1;
+
+			/* stage the next page meanwhile */
+			next_size = (length > PAGE_SIZE) ? PAGE_SIZE : (uint16_t)length;
+			success = (0 == next_size) || (*source_ptr)(address, image_buffer[buffer], next_size);
+
+			success = wait_transfer() && success;
+			chunk_size = next_size;
+		}
+	}
+
+	return eeprom_wait_ready() && success;
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Transfer done (I2C interrupt) */
+static void transfer_done(uint8_t status)
+{
+	image_status = status;
+}
+
+
+/* Wait for the end of the transfer on the bus */
+static bool wait_transfer(void)
+{
+	while (EEPROM_ST_BUSY == image_status) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+
+	return (EEPROM_ST_DONE == image_status);
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,61 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_IMAGE_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_IMAGE_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Bytes of a dump read: two buffers of this size are used, one filled by
+ * the bus while the other one is given to the sink */
+#ifndef EEPROM_IMAGE_CHUNK
+#define EEPROM_IMAGE_CHUNK		(4 * PAGE_SIZE)
+#endif
+
+/* ----------- Exported types ------------- */
+
+/* Pointer to dump sink: it takes the bytes of a device range, in address
+ * order. Return false to stop the dump. */
+typedef bool (*eeprom_image_sink_t)(eeprom_addr_t, const uint8_t *, uint16_t);
+
+/* Pointer to restore source: it fills the buffer with the bytes of a
+ * device range, in address order. Return false to stop the restore. */
+typedef bool (*eeprom_image_source_t)(eeprom_addr_t, uint8_t *, uint16_t);
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_image_dump(eeprom_addr_t, uint32_t, eeprom_image_sink_t);
+extern bool eeprom_image_restore(eeprom_addr_t, uint32_t, eeprom_image_source_t);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
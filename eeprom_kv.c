@@ -0,0 +1,475 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Log-structured key/value store. The region is a circular log of pages,
+ * from the tail (oldest) to the head (being filled). Each page starts
+ * with a header and holds records appended one after the other:
+ *
+ *   header: magic | seq (2) | tail seq (2) | crc
+ *   record: key | length | value (length) | crc
+ *
+ * A set appends a record to the head; the newest record of a key wins.
+ * When the free pages run out, the live records of the tail page are
+ * moved to the head and the tail page becomes free, so the cold values
+ * travel with the log and every page wears at the same rate.
+ * All values are kept in RAM: a get costs no bus traffic. The mount reads
+ * each page header once and each live page once.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeprom.h"
+#include "eeprom_kv.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Page header */
+#define KV_MAGIC				0x4B
+#define KV_HEADER_SIZE			6
+
+/* Record: key, length, value, crc */
+#define KV_RECORD_SIZE(len)		(3 + (len))
+#define KV_RECORD_MAX			KV_RECORD_SIZE(EEPROM_KV_VALUE_MAX)
+
+/* First byte after the last record */
+#define KV_END_KEY				0xFF
+
+/* Free pages kept for the collection of the tail page */
+#define KV_RESERVE_PAGES		1
+
+/* A page wastes less than a record at its end: all the values shall fit
+ * in the pages not used by the reserve and the head */
+#define KV_PAGE_PAYLOAD			(PAGE_SIZE - KV_HEADER_SIZE - KV_RECORD_MAX)
+
+#if (EEPROM_KV_START & PAGE_MASK) != 0
+#error "EEPROM_KV_START shall be page aligned"
+#endif
+
+#if (EEPROM_KV_START + EEPROM_KV_PAGES * PAGE_SIZE) > EEPROM_SIZE
+#error "EEPROM_KV_START: region beyond the end of the array"
+#endif
+
+#if (EEPROM_KV_PAGES < 4) || (EEPROM_KV_PAGES > 255)
+#error "EEPROM_KV_PAGES shall be in 4..255"
+#endif
+
+#if (EEPROM_KV_KEYS > KV_END_KEY)
+#error "EEPROM_KV_KEYS shall be lower than the end key"
+#endif
+
+#if (EEPROM_KV_KEYS * KV_RECORD_MAX) > ((EEPROM_KV_PAGES - KV_RESERVE_PAGES - 2) * KV_PAGE_PAYLOAD)
+#error "EEPROM_KV_PAGES too small for EEPROM_KV_KEYS values"
+#endif
+
+/* Page of the region holding no record of a key */
+#define KV_NO_PAGE				0xFF
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* RAM index: the value of each key and the page of its record */
+static struct {
+	uint8_t length;						/* 0: key not set */
+	uint8_t page;						/* region page of the newest record */
+	uint8_t value[EEPROM_KV_VALUE_MAX];
+} kv_index[EEPROM_KV_KEYS];
+
+/* Sequence number of each log page */
+static uint16_t kv_page_seq[EEPROM_KV_PAGES];
+
+/* Oldest and newest log pages, first free byte of the newest one */
+static uint8_t kv_tail;
+static uint8_t kv_head;
+static uint16_t kv_head_offset;
+
+/* Store usable */
+static bool kv_mounted = false;
+
+/* Page image for headers and mount */
+static uint8_t kv_page_buffer[PAGE_SIZE];
+
+/* Counters */
+static eeprom_kv_stats_t kv_stats;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint8_t crc8(const uint8_t *, uint8_t);
+static eeprom_addr_t page_address(uint8_t);
+static uint8_t used_pages(void);
+static bool open_page(void);
+static bool append(uint8_t, uint8_t *, uint8_t, bool);
+static bool collect_tail(void);
+static void reset_index(void);
+static bool read_header(uint8_t, uint16_t *, uint16_t *);
+static void replay_page(uint8_t, bool);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to create an empty store: the headers of the previous content
+ * are invalidated and the first page is opened */
+bool eeprom_kv_format(void)
+{
+	uint8_t zero = 0;
+	uint8_t page;
+	bool success = true;
+
+	kv_mounted = false;
+
+	for (page = 0; success && (page < EEPROM_KV_PAGES); page++) {
+		success = eeprom_wait_ready()
+				&& eeprom_write_byte(page_address(page), zero);
+	}
+
+	if (success) {
+		reset_index();
+		/* page 0 is opened after the last one */
+		kv_head = EEPROM_KV_PAGES - 1;
+		kv_tail = 0;
+		kv_page_seq[kv_head] = 0;
+		kv_page_seq[kv_tail] = 1;
+		success = open_page();
+		kv_mounted = success;
+	}
+
+	return success;
+}
+
+
+/* Function to load the store at boot: find the head page from the page
+ * headers, then replay the live pages from the tail to the head. The mount
+ * reads at most twice the region. Return false on an unformatted region. */
+bool eeprom_kv_mount(void)
+{
+	uint16_t seq;
+	uint16_t tail_seq;
+	uint16_t head_seq = 0;
+	uint16_t pages;
+	uint8_t page;
+	bool found = false;
+	uint16_t i;
+
+	kv_mounted = false;
+	kv_stats.mount_reads = 0;
+	reset_index();
+
+	if (!eeprom_wait_ready()) {
+		return false;
+	}
+
+	/* the head has the newest sequence number */
+	for (page = 0; page < EEPROM_KV_PAGES; page++) {
+		if (read_header(page, &seq, &tail_seq)
+		&& (!found || ((int16_t)(seq - head_seq) > 0))) {
+			found = true;
+			kv_head = page;
+			head_seq = seq;
+		}
+	}
+	if (!found || !read_header(kv_head, &seq, &tail_seq)) {
+		return false;
+	}
+
+	/* the head header tells the tail at the time it was opened */
+	pages = (uint16_t)(head_seq - tail_seq) + 1;
+	if (pages > EEPROM_KV_PAGES) {
+		return false;
+	}
+	kv_tail = (uint8_t)((kv_head + EEPROM_KV_PAGES - (pages - 1)) % EEPROM_KV_PAGES);
+
+	for (i = 0; i < pages; i++) {
+		page = (uint8_t)((kv_tail + i) % EEPROM_KV_PAGES);
+		kv_page_seq[page] = (uint16_t)(tail_seq + i);
+		kv_stats.mount_reads++;
+		if (eeprom_read_page(page_address(page), kv_page_buffer, PAGE_SIZE)
+		&& (KV_MAGIC == kv_page_buffer[0])
+		&& (0 == crc8(kv_page_buffer, KV_HEADER_SIZE))
+		&& ((uint16_t)(kv_page_buffer[1] | (kv_page_buffer[2] << 8)) == kv_page_seq[page])) {
+			replay_page(page, (page == kv_head));
+		}
+	}
+
+	kv_mounted = true;
+
+	return true;
+}
+
+
+/* Function to set the value of a key. An unchanged value is not written. */
+bool eeprom_kv_set(uint8_t key, uint8_t *value_ptr, uint8_t length)
+{
+	bool success = false;
+
+	if (kv_mounted
+	&& (key < EEPROM_KV_KEYS)
+	&& (length > 0)
+	&& (length <= EEPROM_KV_VALUE_MAX)) {
+		if ((kv_index[key].length == length)
+		&& (memcmp(kv_index[key].value, value_ptr, length) == 0)) {
+			kv_stats.unchanged++;
+			success = true;
+		} else {
+			success = append(key, value_ptr, length, false);
+		}
+	}
+
+	return success;
+}
+
+
+/* Function to get the value of a key from RAM. The buffer shall hold
+ * EEPROM_KV_VALUE_MAX bytes. Return false if the key is not set. */
+bool eeprom_kv_get(uint8_t key, uint8_t *value_ptr, uint8_t *length_ptr)
+{
+	bool success = false;
+
+	if (kv_mounted
+	&& (key < EEPROM_KV_KEYS)
+	&& (kv_index[key].length > 0)) {
+		memcpy(value_ptr, kv_index[key].value, kv_index[key].length);
+		*length_ptr = kv_index[key].length;
+		success = true;
+	}
+
+	return success;
+}
+
+
+/* Function to get the store counters */
+void eeprom_kv_get_stats(eeprom_kv_stats_t *stats_ptr)
+{
+	*stats_ptr = kv_stats;
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* CRC-8, polynomial 0x07 */
+static uint8_t crc8(const uint8_t *data_ptr, uint8_t data_length)
+{
+	uint8_t crc = 0;
+	uint8_t bit;
+
+	while (data_length > 0) {
+		crc ^= *data_ptr++;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+		data_length--;
+	}
+
+	return crc;
+}
+
+
+/* Device address of a region page */
+static eeprom_addr_t page_address(uint8_t page)
+{
+	return (eeprom_addr_t)(EEPROM_KV_START + page * PAGE_SIZE);
+}
+
+
+/* Pages from the tail to the head */
+static uint8_t used_pages(void)
+{
+	return (uint8_t)(((kv_head + EEPROM_KV_PAGES - kv_tail) % EEPROM_KV_PAGES) + 1);
+}
+
+
+/* Open the page after the head: its header is written with the rest of
+ * the page cleared, in one page write */
+static bool open_page(void)
+{
+	uint8_t page = (uint8_t)((kv_head + 1) % EEPROM_KV_PAGES);
+	uint16_t seq = kv_page_seq[kv_head] + 1;
+
+	memset(kv_page_buffer, KV_END_KEY, PAGE_SIZE);
+	kv_page_buffer[0] = KV_MAGIC;
+	kv_page_buffer[1] = (uint8_t)seq;
+	kv_page_buffer[2] = (uint8_t)(seq >> 8);
+	kv_page_buffer[3] = (uint8_t)kv_page_seq[kv_tail];
+	kv_page_buffer[4] = (uint8_t)(kv_page_seq[kv_tail] >> 8);
+	kv_page_buffer[5] = crc8(kv_page_buffer, KV_HEADER_SIZE - 1);
+
+	if (!eeprom_wait_ready()
+	|| !eeprom_write_page(page_address(page), kv_page_buffer, PAGE_SIZE)) {
+		return false;
+	}
+
+	kv_page_seq[page] = seq;
+	kv_head = page;
+	kv_head_offset = KV_HEADER_SIZE;
+	kv_stats.page_opens++;
+
+	return true;
+}
+
+
+/* Append a record to the head and index it. A record not fitting in the
+ * head opens the next page, collecting the tail first unless the append
+ * is a move of the collection itself, which uses the reserve. */
+static bool append(uint8_t key, uint8_t *value_ptr, uint8_t length, bool moving)
+{
+	uint8_t record[KV_RECORD_MAX + 1];
+	uint8_t record_size = KV_RECORD_SIZE(length);
+	uint8_t write_size = record_size;
+
+	if ((kv_head_offset + record_size) > PAGE_SIZE) {
+		while (!moving && ((used_pages() + 1 + KV_RESERVE_PAGES) > EEPROM_KV_PAGES)) {
+			if (!collect_tail()) {
+				return false;
+			}
+		}
+		if (!open_page()) {
+			return false;
+		}
+	}
+
+	record[0] = key;
+	record[1] = length;
+	memcpy(&record[2], value_ptr, length);
+	record[record_size - 1] = crc8(record, record_size - 1);
+	/* end mark: a torn record left behind is not parsed past the new one */
+	if ((kv_head_offset + record_size) < PAGE_SIZE) {
+		record[record_size] = KV_END_KEY;
+		write_size++;
+	}
+
+	if (!eeprom_wait_ready()
+	|| !eeprom_write_page(page_address(kv_head) + kv_head_offset, record, write_size)) {
+		return false;
+	}
+
+	kv_head_offset += record_size;
+	kv_index[key].length = length;
+	kv_index[key].page = kv_head;
+	if (kv_index[key].value != value_ptr) {
+		memcpy(kv_index[key].value, value_ptr, length);
+	}
+	kv_stats.records++;
+
+	return true;
+}
+
+
+/* Move the live records of the tail page to the head and free it */
+static bool collect_tail(void)
+{
+	uint8_t key;
+
+	for (key = 0; key < EEPROM_KV_KEYS; key++) {
+		if ((kv_index[key].length > 0)
+		&& (kv_index[key].page == kv_tail)) {
+			if (!append(key, kv_index[key].value, kv_index[key].length, true)) {
+				return false;
+			}
+			kv_stats.gc_moves++;
+		}
+	}
+
+	kv_tail = (uint8_t)((kv_tail + 1) % EEPROM_KV_PAGES);
+	kv_stats.gc_pages++;
+
+	return true;
+}
+
+
+/* Clear the RAM index */
+static void reset_index(void)
+{
+	uint8_t key;
+
+	for (key = 0; key < EEPROM_KV_KEYS; key++) {
+		kv_index[key].length = 0;
+		kv_index[key].page = KV_NO_PAGE;
+	}
+}
+
+
+/* Read and check a page header */
+static bool read_header(uint8_t page, uint16_t *seq_ptr, uint16_t *tail_seq_ptr)
+{
+	uint8_t header[KV_HEADER_SIZE];
+	bool valid;
+
+	kv_stats.mount_reads++;
+	valid = eeprom_read_page(page_address(page), header, KV_HEADER_SIZE)
+			&& (KV_MAGIC == header[0])
+			&& (0 == crc8(header, KV_HEADER_SIZE));
+
+	if (valid) {
+		*seq_ptr = (uint16_t)(header[1] | (header[2] << 8));
+		*tail_seq_ptr = (uint16_t)(header[3] | (header[4] << 8));
+	}
+
+	return valid;
+}
+
+
+/* Index the records of a page read in the page buffer, up to the end mark
+ * or the first damaged record. The head continues after the last one. */
+static void replay_page(uint8_t page, bool head)
+{
+	uint16_t offset = KV_HEADER_SIZE;
+	uint8_t key;
+	uint8_t length;
+
+	while ((offset + KV_RECORD_SIZE(1)) <= PAGE_SIZE) {
+		key = kv_page_buffer[offset];
+		length = kv_page_buffer[offset + 1];
+		if ((key >= EEPROM_KV_KEYS)
+		|| (0 == length)
+		|| (length > EEPROM_KV_VALUE_MAX)
+		|| ((offset + KV_RECORD_SIZE(length)) > PAGE_SIZE)
+		|| (crc8(&kv_page_buffer[offset], KV_RECORD_SIZE(length)) != 0)) {
+			break;
+		}
+		kv_index[key].length = length;
+		kv_index[key].page = page;
+		memcpy(kv_index[key].value, &kv_page_buffer[offset + 2], length);
+		offset += KV_RECORD_SIZE(length);
+	}
+
+	if (head) {
+		kv_head_offset = offset;
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,79 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_KV_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_KV_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* EEPROM region of the log: first address (page aligned) and pages.
+ * By default the last eighth of the array */
+#ifndef EEPROM_KV_PAGES
+#define EEPROM_KV_PAGES			(EEPROM_PAGES / 8)
+#endif
+#ifndef EEPROM_KV_START
+#define EEPROM_KV_START			(EEPROM_SIZE - EEPROM_KV_PAGES * PAGE_SIZE)
+#endif
+
+/* Keys: 0 to EEPROM_KV_KEYS - 1. Fewer by default on 32-byte pages */
+#ifndef EEPROM_KV_KEYS
+#define EEPROM_KV_KEYS			((PAGE_SIZE >= 64) ? 48 : 16)
+#endif
+
+/* Longest value in bytes */
+#ifndef EEPROM_KV_VALUE_MAX
+#define EEPROM_KV_VALUE_MAX		((PAGE_SIZE >= 64) ? 16 : 8)
+#endif
+
+/* ----------- Exported types ------------- */
+
+/* Store counters */
+typedef struct {
+	uint32_t records;			/* records appended, moves included */
+	uint32_t unchanged;			/* sets skipped: value already stored */
+	uint32_t page_opens;		/* log pages opened */
+	uint32_t gc_pages;			/* pages collected */
+	uint32_t gc_moves;			/* live records moved by the collection */
+	uint16_t mount_reads;		/* read transactions of the last mount */
+} eeprom_kv_stats_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_kv_format(void);
+extern bool eeprom_kv_mount(void);
+extern bool eeprom_kv_set(uint8_t, uint8_t *, uint8_t);
+extern bool eeprom_kv_get(uint8_t, uint8_t *, uint8_t *);
+extern void eeprom_kv_get_stats(eeprom_kv_stats_t *);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
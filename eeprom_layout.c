@@ -0,0 +1,138 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Factory data layout, shared by the firmware and the host image builder
+ * (host/mkimage.c): both write the items by the same functions, so the
+ * image burnt by the programmer is the one the firmware would write.
+ *
+ *   item: data (size) | CRC-32 MPEG-2, MSB first (eeprom_write_record)
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "eeprom.h"
+#include "eeprom_kv.h"
+#include "eeprom_txn.h"
+#include "eeprom_layout.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Items one after the other, each from a page boundary */
+#define LAYOUT_SERIAL_ADDRESS		EEPROM_LAYOUT_START
+#define LAYOUT_BOARD_ADDRESS		(LAYOUT_SERIAL_ADDRESS + EEPROM_LAYOUT_ITEM_PAGES(EEPROM_LAYOUT_SERIAL_SIZE) * PAGE_SIZE)
+#define LAYOUT_CALIBRATION_ADDRESS	(LAYOUT_BOARD_ADDRESS + EEPROM_LAYOUT_ITEM_PAGES(EEPROM_LAYOUT_BOARD_SIZE) * PAGE_SIZE)
+#define LAYOUT_END					(EEPROM_LAYOUT_START + EEPROM_LAYOUT_PAGES * PAGE_SIZE)
+
+/* Regions of the other modules */
+#define LAYOUT_JOURNAL_END			(EEPROM_TXN_JOURNAL_START + EEPROM_TXN_JOURNAL_PAGES * PAGE_SIZE)
+#define LAYOUT_KV_END				(EEPROM_KV_START + EEPROM_KV_PAGES * PAGE_SIZE)
+
+#if (EEPROM_LAYOUT_START & PAGE_MASK) != 0
+#error "EEPROM_LAYOUT_START shall be page aligned"
+#endif
+
+#if (LAYOUT_END > EEPROM_SIZE)
+#error "EEPROM_LAYOUT_START: region beyond the end of the array"
+#endif
+
+#if (EEPROM_LAYOUT_START < LAYOUT_JOURNAL_END) && (EEPROM_TXN_JOURNAL_START < LAYOUT_END)
+#error "EEPROM_LAYOUT_START: region over the transaction journal"
+#endif
+
+#if (EEPROM_LAYOUT_START < LAYOUT_KV_END) && (EEPROM_KV_START < LAYOUT_END)
+#error "EEPROM_LAYOUT_START: region over the key/value log"
+#endif
+
+
+
+
+/* ----------- Exported variables ------------- */
+
+/* Factory items, by item index */
+const eeprom_layout_item_t eeprom_layout_items[EEPROM_LAYOUT_ITEMS] = {
+	{LAYOUT_SERIAL_ADDRESS, EEPROM_LAYOUT_SERIAL_SIZE},
+	{LAYOUT_BOARD_ADDRESS, EEPROM_LAYOUT_BOARD_SIZE},
+	{LAYOUT_CALIBRATION_ADDRESS, EEPROM_LAYOUT_CALIBRATION_SIZE}
+};
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to write a factory item: data of the item size, framed by
+ * its CRC */
+bool eeprom_layout_write(uint8_t item, uint8_t *data_ptr, uint16_t data_length)
+{
+	if ((item >= EEPROM_LAYOUT_ITEMS) || (data_length != eeprom_layout_items[item].size)) {
+		return false;
+	}
+
+	return eeprom_write_record(eeprom_layout_items[item].address, data_ptr, data_length);
+}
+
+
+/* Function to verify a factory item with no read buffer: the CRC of the
+ * data is computed while it is read and compared with the stored one.
+ * Return false on a bus error or a wrong CRC, e.g. an erased item. */
+bool eeprom_layout_verify(uint8_t item)
+{
+	uint8_t trailer[EEPROM_RECORD_CRC_SIZE];
+	uint32_t crc;
+
+	if ((item >= EEPROM_LAYOUT_ITEMS)
+	|| !eeprom_checksum_range(eeprom_layout_items[item].address, eeprom_layout_items[item].size, &crc)
+	|| !eeprom_read_block(eeprom_layout_items[item].address + eeprom_layout_items[item].size,
+						  trailer, EEPROM_RECORD_CRC_SIZE)) {
+		return false;
+	}
+
+	return (trailer[0] == (uint8_t)(crc >> 24)) && (trailer[1] == (uint8_t)(crc >> 16))
+		&& (trailer[2] == (uint8_t)(crc >> 8)) && (trailer[3] == (uint8_t)crc);
+}
+
+
+/* Function to verify all the factory items, e.g. at first boot */
+bool eeprom_layout_verify_all(void)
+{
+	bool success = true;
+	uint8_t item;
+
+	for (item = 0; success && (item < EEPROM_LAYOUT_ITEMS); item++) {
+		success = eeprom_layout_verify(item);
+	}
+
+	return success;
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,86 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_LAYOUT_INCLUDED_	/* switch to read the header file only */
+#define _EEPROM_LAYOUT_INCLUDED_	/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Factory item sizes, CRC excluded */
+#define EEPROM_LAYOUT_SERIAL_SIZE		16
+#define EEPROM_LAYOUT_BOARD_SIZE		32
+#define EEPROM_LAYOUT_CALIBRATION_SIZE	256
+
+/* Pages of the factory region: the items one after the other, each with
+ * its CRC from a page boundary */
+#define EEPROM_LAYOUT_ITEM_PAGES(size)	(((size) + EEPROM_RECORD_CRC_SIZE + PAGE_MASK) / PAGE_SIZE)
+#define EEPROM_LAYOUT_PAGES		(EEPROM_LAYOUT_ITEM_PAGES(EEPROM_LAYOUT_SERIAL_SIZE) \
+								 + EEPROM_LAYOUT_ITEM_PAGES(EEPROM_LAYOUT_BOARD_SIZE) \
+								 + EEPROM_LAYOUT_ITEM_PAGES(EEPROM_LAYOUT_CALIBRATION_SIZE))
+
+/* Factory region: first address (page aligned). By default the region
+ * ends below the default transaction journal, from a multiple of 8 pages */
+#ifndef EEPROM_LAYOUT_START
+#define EEPROM_LAYOUT_START		(EEPROM_SIZE - EEPROM_SIZE / 8 - 8 * PAGE_SIZE \
+								 - ((EEPROM_LAYOUT_PAGES + 7) / 8) * 8 * PAGE_SIZE)
+#endif
+
+/* Factory items: provisioned by the image builder or by the firmware,
+ * verified at first boot */
+enum {
+	EEPROM_LAYOUT_SERIAL,		/* serial number */
+	EEPROM_LAYOUT_BOARD,		/* board revision and options */
+	EEPROM_LAYOUT_CALIBRATION,	/* calibration table */
+	EEPROM_LAYOUT_ITEMS
+};
+
+/* ----------- Exported types ------------- */
+
+/* Factory item: a record of fixed size, data followed by its CRC */
+typedef struct {
+	eeprom_addr_t address;		/* first byte of the record */
+	uint16_t size;				/* data bytes, CRC excluded */
+} eeprom_layout_item_t;
+
+/* ----------- Exported variables ------------- */
+
+extern const eeprom_layout_item_t eeprom_layout_items[EEPROM_LAYOUT_ITEMS];
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_layout_write(uint8_t, uint8_t *, uint16_t);
+extern bool eeprom_layout_verify(uint8_t);
+extern bool eeprom_layout_verify_all(void);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
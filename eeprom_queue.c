@@ -0,0 +1,471 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rtos.h"
+#include "eeprom.h"
+#include "eeprom_queue.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* RTOS callback flushing the queue */
+#define EEPROM_QUEUE_CB_ID			RTOS_CFG_CB_ID_EEPROM_QUEUE
+
+/* No entry selected */
+#define QUEUE_NO_ENTRY				0xFF
+
+/* Hook executed while waiting for a page write */
+#ifndef EEPROM_CFG_IDLE_HOOK
+#define EEPROM_CFG_IDLE_HOOK()
+#endif
+
+
+/* ------------- Local typedef definitions ------------- */
+
+/* Entry states */
+enum {
+	QUEUE_ST_FREE,			/* no page */
+	QUEUE_ST_PENDING,		/* collecting writes to its page */
+	QUEUE_ST_WRITING		/* page write on the bus */
+};
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Pending pages: the bytes to write are flagged in the valid bitmap */
+static struct {
+	volatile uint8_t state;			/* entry state */
+	uint16_t page;					/* page number */
+	uint32_t seq;					/* submission order */
+	uint8_t valid[PAGE_SIZE / 8];	/* bytes to write, one bit each */
+	uint8_t data[PAGE_SIZE];		/* page data */
+} queue_entries[EEPROM_QUEUE_PAGES];
+
+/* Submission counter ordering the entries */
+static uint32_t queue_seq;
+
+/* Flush callback armed */
+static bool queue_armed;
+
+/* Entry written in background and result of its page write */
+static volatile uint8_t queue_writing = QUEUE_NO_ENTRY;
+
+/* Device content between two pending ranges */
+static uint8_t queue_fill[PAGE_SIZE];
+
+/* Counters */
+static eeprom_queue_stats_t queue_stats;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint8_t find_entry(uint16_t);
+static uint8_t next_entry(uint16_t, uint8_t);
+static uint8_t oldest_entry(void);
+static uint8_t alloc_entry(uint16_t);
+static bool prepare_entry(uint8_t, uint16_t *, uint16_t *);
+static bool write_entry(uint8_t);
+static void wait_write(void);
+static void write_done(uint8_t);
+static void queue_tick(void);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to init the queue: no pending writes */
+void eeprom_queue_init(void)
+{
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		queue_entries[entry].state = QUEUE_ST_FREE;
+	}
+	queue_seq = 0;
+	queue_armed = false;
+	queue_writing = QUEUE_NO_ENTRY;
+	eeprom_queue_reset_stats();
+}
+
+
+/* Function to submit a write of any length starting from a specific
+ * address. It is merged with the pending writes to the same pages, later
+ * bytes replacing earlier ones, and written after EEPROM_QUEUE_HOLD_MS
+ * with one page write per page. The data is copied. */
+bool eeprom_queue_write(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+	uint16_t offset;
+	uint8_t entry;
+	uint16_t i;
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+
+		entry = find_entry(address / PAGE_SIZE);
+		if (QUEUE_NO_ENTRY == entry) {
+			entry = alloc_entry(address / PAGE_SIZE);
+			if (QUEUE_NO_ENTRY == entry) {
+				return false;
+			}
+		}
+
+		offset = (uint16_t)(address & PAGE_MASK);
+		memcpy(&queue_entries[entry].data[offset], data_ptr, chunk_size);
+		for (i = 0; i < chunk_size; i++) {
+			queue_entries[entry].valid[(offset + i) >> 3] |= (uint8_t)(1u << ((offset + i) & 7));
+		}
+		queue_stats.requests++;
+
+		address += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	if (!queue_armed) {
+		queue_armed = true;
+		rtos_set_callback(EEPROM_QUEUE_CB_ID, RTOS_CB_TYPE_SINGLE, EEPROM_QUEUE_HOLD_MS, &queue_tick);
+	}
+
+	return true;
+}
+
+
+/* Function to read any length starting from a specific address, with the
+ * pending writes applied */
+bool eeprom_queue_read(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+	uint16_t offset;
+	uint8_t entry;
+	uint16_t i;
+
+	wait_write();
+	if (!eeprom_wait_ready()
+	|| !eeprom_read_block(address, data_ptr, data_length)) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+
+		/* apply the entries of the page in submission order */
+		offset = (uint16_t)(address & PAGE_MASK);
+		entry = QUEUE_NO_ENTRY;
+		do {
+			entry = next_entry(address / PAGE_SIZE, entry);
+			if (entry != QUEUE_NO_ENTRY) {
+				for (i = 0; i < chunk_size; i++) {
+					if ((queue_entries[entry].valid[(offset + i) >> 3] & (1u << ((offset + i) & 7))) != 0) {
+						data_ptr[i] = queue_entries[entry].data[offset + i];
+					}
+				}
+			}
+		} while (entry != QUEUE_NO_ENTRY);
+
+		address += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Function to write all the pending pages now, e.g. before shutdown.
+ * It returns when the last write cycle is over. */
+bool eeprom_queue_sync(void)
+{
+	bool success = true;
+	uint8_t entry;
+
+	wait_write();
+	entry = oldest_entry();
+	while (success && (entry != QUEUE_NO_ENTRY)) {
+		success = write_entry(entry);
+		entry = oldest_entry();
+	}
+
+	return eeprom_wait_ready() && success;
+}
+
+
+/* Function to get the number of pages not yet written to the device */
+uint8_t eeprom_queue_pending(void)
+{
+	uint8_t count = 0;
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		if (queue_entries[entry].state != QUEUE_ST_FREE) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+/* Function to get the queue counters */
+void eeprom_queue_get_stats(eeprom_queue_stats_t *stats_ptr)
+{
+	*stats_ptr = queue_stats;
+	stats_ptr->saved_cycles = (queue_stats.requests > queue_stats.page_writes) ?
+							(queue_stats.requests - queue_stats.page_writes) : 0;
+}
+
+
+/* Function to clear the queue counters */
+void eeprom_queue_reset_stats(void)
+{
+	memset(&queue_stats, 0, sizeof(queue_stats));
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Get the entry collecting the writes to a page: the newest one, since
+ * an older entry of the page may wait for a retry */
+static uint8_t find_entry(uint16_t page)
+{
+	uint8_t found = QUEUE_NO_ENTRY;
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		if ((QUEUE_ST_PENDING == queue_entries[entry].state)
+		&& (queue_entries[entry].page == page)
+		&& ((QUEUE_NO_ENTRY == found)
+			|| ((int32_t)(queue_entries[entry].seq - queue_entries[found].seq) > 0))) {
+			found = entry;
+		}
+	}
+
+	return found;
+}
+
+
+/* Get the pending entry of a page submitted first after a given one, or
+ * the first one if none is given */
+static uint8_t next_entry(uint16_t page, uint8_t previous)
+{
+	uint8_t found = QUEUE_NO_ENTRY;
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		if ((QUEUE_ST_PENDING == queue_entries[entry].state)
+		&& (queue_entries[entry].page == page)
+		&& ((QUEUE_NO_ENTRY == previous)
+			|| ((int32_t)(queue_entries[entry].seq - queue_entries[previous].seq) > 0))
+		&& ((QUEUE_NO_ENTRY == found)
+			|| ((int32_t)(queue_entries[entry].seq - queue_entries[found].seq) < 0))) {
+			found = entry;
+		}
+	}
+
+	return found;
+}
+
+
+/* Get the pending entry submitted first */
+static uint8_t oldest_entry(void)
+{
+	uint8_t oldest = QUEUE_NO_ENTRY;
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		if ((QUEUE_ST_PENDING == queue_entries[entry].state)
+		&& ((QUEUE_NO_ENTRY == oldest)
+			|| ((int32_t)(queue_entries[entry].seq - queue_entries[oldest].seq) < 0))) {
+			oldest = entry;
+		}
+	}
+
+	return oldest;
+}
+
+
+/* Get a free entry for a page. When the queue is full the oldest page is
+ * written first. A page being written gets a new entry, written after it. */
+static uint8_t alloc_entry(uint16_t page)
+{
+	uint8_t entry;
+
+	for (entry = 0; entry < EEPROM_QUEUE_PAGES; entry++) {
+		if (QUEUE_ST_FREE == queue_entries[entry].state) {
+			break;
+		}
+	}
+
+	if (EEPROM_QUEUE_PAGES == entry) {
+		wait_write();
+		entry = oldest_entry();
+		if ((QUEUE_NO_ENTRY == entry) || !write_entry(entry)) {
+			return QUEUE_NO_ENTRY;
+		}
+	}
+
+	queue_seq++;
+	queue_entries[entry].page = page;
+	queue_entries[entry].seq = queue_seq;
+	memset(queue_entries[entry].valid, 0, sizeof(queue_entries[entry].valid));
+	queue_entries[entry].state = QUEUE_ST_PENDING;
+
+	return entry;
+}
+
+
+/* Get the span of an entry from its first to its last pending byte. The
+ * bytes in between that are not pending are read from the device. */
+static bool prepare_entry(uint8_t entry, uint16_t *first_ptr, uint16_t *length_ptr)
+{
+	uint16_t first = PAGE_SIZE;
+	uint16_t last = 0;
+	bool gaps = false;
+	uint16_t i;
+
+	for (i = 0; i < PAGE_SIZE; i++) {
+		if ((queue_entries[entry].valid[i >> 3] & (1u << (i & 7))) != 0) {
+			/* a byte not pending since the first one is a hole */
+			gaps = gaps || ((first < PAGE_SIZE) && ((last + 1) != i));
+			if (first == PAGE_SIZE) {
+				first = i;
+			}
+			last = i;
+		}
+	}
+
+	if (gaps) {
+		queue_stats.fill_reads++;
+		if (!eeprom_wait_ready()
+		|| !eeprom_read_page((eeprom_addr_t)(queue_entries[entry].page * PAGE_SIZE + first),
+							&queue_fill[first], (uint16_t)(last - first + 1))) {
+			return false;
+		}
+		for (i = first; i <= last; i++) {
+			if (0 == (queue_entries[entry].valid[i >> 3] & (1u << (i & 7)))) {
+				queue_entries[entry].data[i] = queue_fill[i];
+			}
+		}
+	}
+
+	*first_ptr = first;
+	*length_ptr = (uint16_t)(last - first + 1);
+
+	return true;
+}
+
+
+/* Write a pending entry and wait for the end of the transfer */
+static bool write_entry(uint8_t entry)
+{
+	uint16_t first;
+	uint16_t length;
+	bool success;
+
+	success = prepare_entry(entry, &first, &length)
+			&& eeprom_wait_ready()
+			&& eeprom_write_page((eeprom_addr_t)(queue_entries[entry].page * PAGE_SIZE + first),
+								&queue_entries[entry].data[first], length);
+	if (success) {
+		queue_stats.page_writes++;
+		queue_entries[entry].state = QUEUE_ST_FREE;
+	}
+
+	return success;
+}
+
+
+/* Wait for the end of the background page write */
+static void wait_write(void)
+{
+	while (queue_writing != QUEUE_NO_ENTRY) {
+		EEPROM_CFG_IDLE_HOOK();
+	}
+}
+
+
+/* Background page write done (I2C interrupt): the entry is freed, or
+ * retried at the next tick if the write failed */
+static void write_done(uint8_t status)
+{
+	queue_entries[queue_writing].state = (EEPROM_ST_DONE == status) ? QUEUE_ST_FREE : QUEUE_ST_PENDING;
+	queue_writing = QUEUE_NO_ENTRY;
+}
+
+
+/* RTOS callback: write the oldest pending page, one per tick, and re-arm
+ * until the queue is empty. The write cycle of a page is over by the next
+ * tick. */
+static void queue_tick(void)
+{
+	uint16_t first;
+	uint16_t length;
+	uint8_t entry;
+
+	if (QUEUE_NO_ENTRY == queue_writing) {
+		entry = oldest_entry();
+		if ((entry != QUEUE_NO_ENTRY)
+		&& prepare_entry(entry, &first, &length)
+		&& eeprom_wait_ready()) {
+			queue_entries[entry].state = QUEUE_ST_WRITING;
+			queue_writing = entry;
+			if (eeprom_write_page_async((eeprom_addr_t)(queue_entries[entry].page * PAGE_SIZE + first),
+										&queue_entries[entry].data[first], length, &write_done)) {
+				queue_stats.page_writes++;
+			} else {
+				/* engine busy: retry at next tick */
+				queue_writing = QUEUE_NO_ENTRY;
+				queue_entries[entry].state = QUEUE_ST_PENDING;
+			}
+		}
+	}
+
+	if (eeprom_queue_pending() > 0) {
+		rtos_set_callback(EEPROM_QUEUE_CB_ID, RTOS_CB_TYPE_SINGLE, 0, &queue_tick);
+	} else {
+		queue_armed = false;
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,70 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_QUEUE_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_QUEUE_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Pages pending at the same time */
+#ifndef EEPROM_QUEUE_PAGES
+#define EEPROM_QUEUE_PAGES		8
+#endif
+
+/* Time a write waits in the queue for other writes to the same page */
+#ifndef EEPROM_QUEUE_HOLD_MS
+#define EEPROM_QUEUE_HOLD_MS	20
+#endif
+
+/* ----------- Exported types ------------- */
+
+/* Queue counters */
+typedef struct {
+	uint32_t requests;			/* page chunks submitted: one write cycle each if written directly */
+	uint32_t page_writes;		/* page writes issued */
+	uint32_t fill_reads;		/* reads of the bytes between two pending ranges */
+	uint32_t saved_cycles;		/* write cycles saved by merging */
+} eeprom_queue_stats_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern void eeprom_queue_init(void);
+extern bool eeprom_queue_write(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_queue_read(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_queue_sync(void);
+extern uint8_t eeprom_queue_pending(void);
+extern void eeprom_queue_get_stats(eeprom_queue_stats_t *);
+extern void eeprom_queue_reset_stats(void);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
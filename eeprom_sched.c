@@ -0,0 +1,402 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include "rtos.h"
+#include "eeprom.h"
+#include "eeprom_sched.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* RTOS callback running the requests */
+#define EEPROM_SCHED_CB_ID			RTOS_CFG_CB_ID_EEPROM_SCHED
+
+/* No request selected */
+#define SCHED_NO_REQUEST			0xFF
+
+/* Ticks a request is NACKed before it fails: longer than the device
+ * write cycle */
+#define SCHED_NACK_MAX				4
+
+/* Hook executed while waiting for a transfer */
+#ifndef EEPROM_CFG_IDLE_HOOK
+#define EEPROM_CFG_IDLE_HOOK()
+#endif
+
+
+/* ------------- Local typedef definitions ------------- */
+
+/* Request states */
+enum {
+	SCHED_ST_FREE,			/* no request */
+	SCHED_ST_WAITING,		/* waiting for its next transfer */
+	SCHED_ST_RUNNING		/* transfer on the bus */
+};
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Requests: a write moves one page per transfer, a read all its bytes */
+static struct {
+	volatile uint8_t state;			/* request state */
+	uint8_t cls;					/* request class */
+	bool write;						/* write or read */
+	eeprom_addr_t address;			/* next byte to transfer */
+	uint8_t *data_ptr;				/* caller data of the next byte */
+	uint16_t data_length;			/* bytes left */
+	uint16_t chunk_size;			/* bytes of the transfer on the bus */
+	uint8_t nacks;					/* ticks NACKed in a row */
+	uint32_t start_cycles;			/* DWT cycle counter at the submission */
+	eeprom_cb_ptr_t cb_ptr;			/* completion callback */
+} sched_requests[EEPROM_SCHED_DEPTH];
+
+/* Request with a transfer on the bus */
+static volatile uint8_t sched_running = SCHED_NO_REQUEST;
+
+/* Elevator position: the byte after the last transfer */
+static eeprom_addr_t sched_head;
+
+/* Tick callback armed */
+static bool sched_armed;
+
+/* Counters and sum of the latencies of each class */
+static eeprom_sched_stats_t sched_stats;
+static uint64_t sched_latency_us[EEPROM_SCHED_CLASSES];
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static bool submit(uint8_t, bool, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+static uint8_t next_request(void);
+static void step(void);
+static void transfer_done(uint8_t);
+static void complete(uint8_t, uint8_t);
+static void sched_tick(void);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to init the scheduler: no requests */
+void eeprom_sched_init(void)
+{
+	uint8_t request;
+
+	for (request = 0; request < EEPROM_SCHED_DEPTH; request++) {
+		sched_requests[request].state = SCHED_ST_FREE;
+	}
+	sched_running = SCHED_NO_REQUEST;
+	sched_head = 0;
+	sched_armed = false;
+	eeprom_sched_reset_stats();
+}
+
+
+/* Function to submit a read of any length starting from a specific
+ * address. The buffer is filled when the callback is called with the
+ * final status. Return false if the queue is full. */
+bool eeprom_sched_read(uint8_t cls, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return submit(cls, false, address, data_ptr, data_length, cb_ptr);
+}
+
+
+/* Function to submit a write of any length starting from a specific
+ * address, one page per transfer. The data is not copied: it shall stay
+ * valid until the callback is called with the final status.
+ * Return false if the queue is full. */
+bool eeprom_sched_write(uint8_t cls, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	return submit(cls, true, address, data_ptr, data_length, cb_ptr);
+}
+
+
+/* Function to run all the requests now, e.g. before shutdown, waiting for
+ * the device between the transfers instead of the next tick.
+ * It returns when the last write cycle is over. */
+bool eeprom_sched_sync(void)
+{
+	while (eeprom_sched_depth() > 0) {
+		if (SCHED_NO_REQUEST == sched_running) {
+			/* a NACK would only count a retry: the result comes with the
+			 * request */
+			(void)eeprom_wait_ready();
+			step();
+		}
+		EEPROM_CFG_IDLE_HOOK();
+	}
+
+	return eeprom_wait_ready();
+}
+
+
+/* Function to get the number of requests waiting or running */
+uint8_t eeprom_sched_depth(void)
+{
+	uint8_t count = 0;
+	uint8_t request;
+
+	for (request = 0; request < EEPROM_SCHED_DEPTH; request++) {
+		if (sched_requests[request].state != SCHED_ST_FREE) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+/* Function to get the scheduler counters */
+void eeprom_sched_get_stats(eeprom_sched_stats_t *stats_ptr)
+{
+	uint32_t done;
+	uint8_t cls;
+
+	*stats_ptr = sched_stats;
+	stats_ptr->depth = eeprom_sched_depth();
+	for (cls = 0; cls < EEPROM_SCHED_CLASSES; cls++) {
+		done = sched_stats.cls[cls].completed + sched_stats.cls[cls].failed;
+		stats_ptr->cls[cls].latency_avg_us = (done > 0) ? (uint32_t)(sched_latency_us[cls] / done) : 0;
+	}
+}
+
+
+/* Function to clear the scheduler counters */
+void eeprom_sched_reset_stats(void)
+{
+	memset(&sched_stats, 0, sizeof(sched_stats));
+	memset(sched_latency_us, 0, sizeof(sched_latency_us));
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Queue a request and arm the tick callback */
+static bool submit(uint8_t cls, bool write, eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length, eeprom_cb_ptr_t cb_ptr)
+{
+	uint8_t depth;
+	uint8_t request;
+
+	if ((cls >= EEPROM_SCHED_CLASSES) || (0 == data_length)
+	|| (((uint32_t)address + data_length) > EEPROM_SIZE)) {
+		return false;
+	}
+
+	for (request = 0; request < EEPROM_SCHED_DEPTH; request++) {
+		if (SCHED_ST_FREE == sched_requests[request].state) {
+			break;
+		}
+	}
+	if (EEPROM_SCHED_DEPTH == request) {
+		return false;
+	}
+
+	sched_requests[request].cls = cls;
+	sched_requests[request].write = write;
+	sched_requests[request].address = address;
+	sched_requests[request].data_ptr = data_ptr;
+	sched_requests[request].data_length = data_length;
+	sched_requests[request].nacks = 0;
+	sched_requests[request].start_cycles = dwt_read_cycle_counter();
+	sched_requests[request].cb_ptr = cb_ptr;
+	/* visible to the completion callback as last operation */
+	sched_requests[request].state = SCHED_ST_WAITING;
+
+	sched_stats.cls[cls].requests++;
+	depth = eeprom_sched_depth();
+	if (depth > sched_stats.depth_max) {
+		sched_stats.depth_max = depth;
+	}
+
+	if (!sched_armed) {
+		sched_armed = true;
+		rtos_set_callback(EEPROM_SCHED_CB_ID, RTOS_CB_TYPE_SINGLE, 0, &sched_tick);
+	}
+
+	return true;
+}
+
+
+/* Get the request to run next: the first class with a waiting request,
+ * and in it the lowest address from the elevator position on, wrapping
+ * to the lowest address (C-SCAN). A write in progress continues at the
+ * elevator position, so it goes on unless an urgent request is waiting. */
+static uint8_t next_request(void)
+{
+	uint8_t found = SCHED_NO_REQUEST;
+	bool found_ahead = false;
+	bool ahead;
+	uint8_t request;
+
+	for (request = 0; request < EEPROM_SCHED_DEPTH; request++) {
+		if (SCHED_ST_WAITING == sched_requests[request].state) {
+			ahead = (sched_requests[request].address >= sched_head);
+			if ((SCHED_NO_REQUEST == found)
+			|| (sched_requests[request].cls < sched_requests[found].cls)
+			|| ((sched_requests[request].cls == sched_requests[found].cls)
+				&& ((ahead && !found_ahead)
+					|| ((ahead == found_ahead)
+						&& (sched_requests[request].address < sched_requests[found].address))))) {
+				found = request;
+				found_ahead = ahead;
+			}
+		}
+	}
+
+	return found;
+}
+
+
+/* Start the next transfer if the engine is free. Called by the tick and
+ * by the completion callback after a read: the device is ready. */
+static void step(void)
+{
+	uint32_t irq_mask;
+	uint8_t request = SCHED_NO_REQUEST;
+	bool started;
+
+	/* claim the scheduler: the completion callback may step too */
+	irq_mask = cm_mask_interrupts(1);
+	if (SCHED_NO_REQUEST == sched_running) {
+		request = next_request();
+		if (request != SCHED_NO_REQUEST) {
+			sched_requests[request].state = SCHED_ST_RUNNING;
+			sched_running = request;
+		}
+	}
+	cm_mask_interrupts(irq_mask);
+
+	if (request != SCHED_NO_REQUEST) {
+		if (sched_requests[request].write) {
+			sched_requests[request].chunk_size = PAGE_SIZE - (sched_requests[request].address & PAGE_MASK);
+			if (sched_requests[request].chunk_size > sched_requests[request].data_length) {
+				sched_requests[request].chunk_size = sched_requests[request].data_length;
+			}
+			started = eeprom_write_page_async(sched_requests[request].address, sched_requests[request].data_ptr,
+											  sched_requests[request].chunk_size, &transfer_done);
+		} else {
+			sched_requests[request].chunk_size = sched_requests[request].data_length;
+			started = eeprom_read_block_async(sched_requests[request].address, sched_requests[request].data_ptr,
+											  sched_requests[request].chunk_size, &transfer_done);
+		}
+		if (!started) {
+			/* engine used by another module: retry at next tick */
+			sched_requests[request].state = SCHED_ST_WAITING;
+			sched_running = SCHED_NO_REQUEST;
+		}
+	}
+}
+
+
+/* Transfer done (I2C interrupt). A NACK means the device is in the write
+ * cycle of the previous page: the same transfer is retried at next tick. */
+static void transfer_done(uint8_t status)
+{
+	uint8_t request = sched_running;
+	bool write = sched_requests[request].write;
+
+	if (EEPROM_ST_DONE == status) {
+		sched_requests[request].address += sched_requests[request].chunk_size;
+		sched_requests[request].data_ptr += sched_requests[request].chunk_size;
+		sched_requests[request].data_length -= sched_requests[request].chunk_size;
+		sched_requests[request].nacks = 0;
+		sched_head = sched_requests[request].address;
+		if (0 == sched_requests[request].data_length) {
+			complete(request, EEPROM_ST_DONE);
+		} else {
+			sched_requests[request].state = SCHED_ST_WAITING;
+		}
+	} else if ((EEPROM_ST_NACK == status) && (sched_requests[request].nacks < SCHED_NACK_MAX)) {
+		sched_requests[request].nacks++;
+		sched_requests[request].state = SCHED_ST_WAITING;
+	} else {
+		complete(request, status);
+	}
+	sched_running = SCHED_NO_REQUEST;
+
+	/* no write cycle after a read: the next request can start now */
+	if ((EEPROM_ST_DONE == status) && !write) {
+		step();
+	}
+}
+
+
+/* Count a finished request, release it and notify the caller */
+static void complete(uint8_t request, uint8_t status)
+{
+	eeprom_cb_ptr_t cb_ptr = sched_requests[request].cb_ptr;
+	uint8_t cls = sched_requests[request].cls;
+	uint32_t latency_us;
+
+	latency_us = (dwt_read_cycle_counter() - sched_requests[request].start_cycles) / (rcc_ahb_frequency / 1000000);
+	sched_latency_us[cls] += latency_us;
+	if (latency_us > sched_stats.cls[cls].latency_max_us) {
+		sched_stats.cls[cls].latency_max_us = latency_us;
+	}
+	if (EEPROM_ST_DONE == status) {
+		sched_stats.cls[cls].completed++;
+	} else {
+		sched_stats.cls[cls].failed++;
+	}
+
+	/* released first: the callback may submit a new request */
+	sched_requests[request].state = SCHED_ST_FREE;
+	if (cb_ptr != NULL) {
+		(*cb_ptr)(status);
+	}
+}
+
+
+/* RTOS callback: start the next transfer, one write per tick so that the
+ * write cycle of a page is over by the next one, and re-arm until all the
+ * requests are done */
+static void sched_tick(void)
+{
+	step();
+
+	if (eeprom_sched_depth() > 0) {
+		rtos_set_callback(EEPROM_SCHED_CB_ID, RTOS_CB_TYPE_SINGLE, 0, &sched_tick);
+	} else {
+		sched_armed = false;
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,82 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_SCHED_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_SCHED_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Requests waiting or running at the same time */
+#ifndef EEPROM_SCHED_DEPTH
+#define EEPROM_SCHED_DEPTH		8
+#endif
+
+/* Request classes: an urgent request runs before any background one,
+ * between two page writes of a long background write */
+enum {
+	EEPROM_SCHED_URGENT,
+	EEPROM_SCHED_BACKGROUND,
+	EEPROM_SCHED_CLASSES
+};
+
+/* ----------- Exported types ------------- */
+
+/* Counters of a request class. Latency: from the submission to the
+ * completion callback. */
+typedef struct {
+	uint32_t requests;			/* requests submitted */
+	uint32_t completed;			/* requests completed successfully */
+	uint32_t failed;			/* requests completed with an error */
+	uint32_t latency_avg_us;	/* mean latency of the completed requests */
+	uint32_t latency_max_us;	/* longest latency */
+} eeprom_sched_class_stats_t;
+
+/* Scheduler counters */
+typedef struct {
+	uint8_t depth;				/* requests waiting or running */
+	uint8_t depth_max;			/* most requests at the same time */
+	eeprom_sched_class_stats_t cls[EEPROM_SCHED_CLASSES];
+} eeprom_sched_stats_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern void eeprom_sched_init(void);
+extern bool eeprom_sched_read(uint8_t, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_sched_write(uint8_t, eeprom_addr_t, uint8_t *, uint16_t, eeprom_cb_ptr_t);
+extern bool eeprom_sched_sync(void);
+extern uint8_t eeprom_sched_depth(void);
+extern void eeprom_sched_get_stats(eeprom_sched_stats_t *);
+extern void eeprom_sched_reset_stats(void);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
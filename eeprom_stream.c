@@ -0,0 +1,258 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeprom.h"
+#include "eeprom_stream.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+
+
+
+/* ------------- Local typedef definitions ------------- */
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint16_t chunk_room(const eeprom_stream_t *);
+static bool write_buffer(eeprom_stream_t *);
+static bool read_buffer(eeprom_stream_t *);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to open a stream on a device region of any length. A write
+ * stream collects the bytes up to the end of a page and writes the page
+ * at once: one write cycle per page. A read stream fetches a page worth
+ * of bytes per sequential read.
+ * Return false on a region beyond the array. */
+bool eeprom_stream_open(eeprom_stream_t *stream_ptr, uint8_t mode, eeprom_addr_t address, uint32_t length)
+{
+	if (((EEPROM_STREAM_WRITE != mode) && (EEPROM_STREAM_READ != mode))
+	|| (((uint32_t)address + length) > EEPROM_SIZE)) {
+		stream_ptr->mode = EEPROM_STREAM_CLOSED;
+		return false;
+	}
+
+	stream_ptr->mode = mode;
+	stream_ptr->address = address;
+	stream_ptr->end = (uint32_t)address + length;
+	stream_ptr->fill = 0;
+	stream_ptr->offset = 0;
+
+	return true;
+}
+
+
+/* Function to append bytes to a write stream. A full page is written and
+ * the write cycle runs while the next one is collected.
+ * Return false past the end of the region or on a device error: the
+ * bytes before are in the stream. */
+bool eeprom_stream_write(eeprom_stream_t *stream_ptr, const uint8_t *data_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+
+	if (EEPROM_STREAM_WRITE != stream_ptr->mode) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		chunk_size = chunk_room(stream_ptr) - stream_ptr->fill;
+		if (0 == chunk_size) {
+			/* end of the region */
+			return false;
+		}
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		memcpy(&stream_ptr->buffer[stream_ptr->fill], data_ptr, chunk_size);
+		stream_ptr->fill += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+
+		if ((stream_ptr->fill == chunk_room(stream_ptr)) && !write_buffer(stream_ptr)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/* Function to get bytes from a read stream. The number of bytes got is
+ * less than the requested one at the end of the region.
+ * Return false on a device error. */
+bool eeprom_stream_read(eeprom_stream_t *stream_ptr, uint8_t *data_ptr, uint16_t data_length, uint16_t *read_ptr)
+{
+	uint16_t chunk_size;
+
+	*read_ptr = 0;
+	if (EEPROM_STREAM_READ != stream_ptr->mode) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		if (stream_ptr->offset == stream_ptr->fill) {
+			if (!read_buffer(stream_ptr)) {
+				return false;
+			}
+			if (0 == stream_ptr->fill) {
+				/* end of the region */
+				break;
+			}
+		}
+		chunk_size = stream_ptr->fill - stream_ptr->offset;
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		memcpy(data_ptr, &stream_ptr->buffer[stream_ptr->offset], chunk_size);
+		stream_ptr->offset += chunk_size;
+		*read_ptr += chunk_size;
+		data_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Function to write the bytes collected by a write stream, e.g. on a
+ * record boundary. The next bytes go on in the same page: a flush costs
+ * one more write cycle for that page. */
+bool eeprom_stream_flush(eeprom_stream_t *stream_ptr)
+{
+	if (EEPROM_STREAM_WRITE != stream_ptr->mode) {
+		return (EEPROM_STREAM_READ == stream_ptr->mode);
+	}
+
+	return (0 == stream_ptr->fill) || write_buffer(stream_ptr);
+}
+
+
+/* Function to close a stream. A write stream is flushed and the function
+ * returns when the last write cycle is over. */
+bool eeprom_stream_close(eeprom_stream_t *stream_ptr)
+{
+	bool success = eeprom_stream_flush(stream_ptr);
+
+	if (EEPROM_STREAM_WRITE == stream_ptr->mode) {
+		success = eeprom_wait_ready() && success;
+	}
+	stream_ptr->mode = EEPROM_STREAM_CLOSED;
+
+	return success;
+}
+
+
+/* Function to get the device address of the next byte of a stream: the
+ * end of the array once the last page of it is done */
+uint32_t eeprom_stream_tell(const eeprom_stream_t *stream_ptr)
+{
+	if (EEPROM_STREAM_READ == stream_ptr->mode) {
+		return stream_ptr->address + stream_ptr->offset;
+	}
+
+	return stream_ptr->address + stream_ptr->fill;
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Get the bytes the buffer can hold from its device address: up to the
+ * end of the page, or of the region */
+static uint16_t chunk_room(const eeprom_stream_t *stream_ptr)
+{
+	uint32_t room = PAGE_SIZE - (stream_ptr->address & PAGE_MASK);
+
+	if ((stream_ptr->address + room) > stream_ptr->end) {
+		room = stream_ptr->end - stream_ptr->address;
+	}
+
+	return (uint16_t)room;
+}
+
+
+/* Write the buffer of a write stream by one page write. The device may
+ * still be in the write cycle of the previous page. */
+static bool write_buffer(eeprom_stream_t *stream_ptr)
+{
+	if (!eeprom_wait_ready()
+	|| !eeprom_write_page((eeprom_addr_t)stream_ptr->address, stream_ptr->buffer, stream_ptr->fill)) {
+		return false;
+	}
+	stream_ptr->address += stream_ptr->fill;
+	stream_ptr->fill = 0;
+
+	return true;
+}
+
+
+/* Fetch the next chunk of a read stream by one sequential read: after
+ * the first one, the device counter is already at the chunk and the read
+ * has no memory address phase. No bytes are left at the end of the
+ * region. */
+static bool read_buffer(eeprom_stream_t *stream_ptr)
+{
+	uint32_t length;
+
+	stream_ptr->address += stream_ptr->fill;
+	stream_ptr->offset = 0;
+	stream_ptr->fill = 0;
+
+	length = stream_ptr->end - stream_ptr->address;
+	if (length > PAGE_SIZE) {
+		length = PAGE_SIZE;
+	}
+	if (length > 0) {
+		if (!eeprom_wait_ready()
+		|| !eeprom_read_block((eeprom_addr_t)stream_ptr->address, stream_ptr->buffer, (uint16_t)length)) {
+			return false;
+		}
+		stream_ptr->fill = (uint16_t)length;
+	}
+
+	return true;
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,70 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_STREAM_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_STREAM_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* Stream directions */
+enum {
+	EEPROM_STREAM_CLOSED,	/* handle not in use */
+	EEPROM_STREAM_WRITE,	/* bytes collected and written page by page */
+	EEPROM_STREAM_READ		/* bytes fetched by sequential chunks */
+};
+
+/* ----------- Exported types ------------- */
+
+/* Stream handle: a device region written or read from its first to its
+ * last byte through one page of RAM. Owned by the caller, its fields are
+ * private to eeprom_stream.c. */
+typedef struct {
+	uint8_t mode;				/* stream direction */
+	uint32_t address;			/* device address of buffer[0] */
+	uint32_t end;				/* device address after the region */
+	uint16_t fill;				/* bytes in the buffer */
+	uint16_t offset;			/* read stream: next byte of the buffer */
+	uint8_t buffer[PAGE_SIZE];	/* page being collected or consumed */
+} eeprom_stream_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern bool eeprom_stream_open(eeprom_stream_t *, uint8_t, eeprom_addr_t, uint32_t);
+extern bool eeprom_stream_write(eeprom_stream_t *, const uint8_t *, uint16_t);
+extern bool eeprom_stream_read(eeprom_stream_t *, uint8_t *, uint16_t, uint16_t *);
+extern bool eeprom_stream_flush(eeprom_stream_t *);
+extern bool eeprom_stream_close(eeprom_stream_t *);
+extern uint32_t eeprom_stream_tell(const eeprom_stream_t *);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
@@ -0,0 +1,355 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Atomic multi-range writes. The writes of a transaction are staged in RAM
+ * as journal entries and written to the journal region in one go at commit,
+ * the first journal page last: once it is written the transaction is
+ * committed. The entries are then written to their addresses.
+ *
+ *   journal: magic | entries | length (2) | crc16 (2) | entries...
+ *   entry:   address (2, 3 beyond 64 KiB) | length | data (length)
+ *
+ * The journal is not cleared after a commit: the recovery at boot compares
+ * the data of a valid journal with the device and rewrites the ranges that
+ * differ, so a commit interrupted while writing the data is rolled forward
+ * and a commit interrupted before the first journal page leaves the old
+ * data. Addresses written in transactions shall be written only in
+ * transactions, or the recovery would restore the last committed data.
+ * A transaction fitting in one journal page costs one extra page write.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeprom.h"
+#include "eeprom_kv.h"
+#include "eeprom_txn.h"
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Journal header */
+#define TXN_MAGIC				0x4A
+#define TXN_HEADER_SIZE			6
+
+/* Entry header: address and length */
+#if (EEPROM_SIZE > 0x10000)
+#define TXN_ADDRESS_SIZE		3
+#else
+#define TXN_ADDRESS_SIZE		2
+#endif
+#define TXN_ENTRY_HEADER_SIZE	(TXN_ADDRESS_SIZE + 1)
+#define TXN_ENTRY_MAX			0xFF
+
+/* Journal region */
+#define TXN_JOURNAL_SIZE		(EEPROM_TXN_JOURNAL_PAGES * PAGE_SIZE)
+
+#if (EEPROM_TXN_JOURNAL_START & PAGE_MASK) != 0
+#error "EEPROM_TXN_JOURNAL_START shall be page aligned"
+#endif
+
+#if (EEPROM_TXN_JOURNAL_START + TXN_JOURNAL_SIZE) > EEPROM_SIZE
+#error "EEPROM_TXN_JOURNAL_START: journal beyond the end of the array"
+#endif
+
+#if (EEPROM_TXN_JOURNAL_START < (EEPROM_KV_START + EEPROM_KV_PAGES * PAGE_SIZE)) \
+	&& (EEPROM_KV_START < (EEPROM_TXN_JOURNAL_START + TXN_JOURNAL_SIZE))
+#error "EEPROM_TXN_JOURNAL_START: journal over the key/value log"
+#endif
+
+#if (EEPROM_TXN_JOURNAL_PAGES < 1) || (TXN_JOURNAL_SIZE > 0x1000)
+#error "EEPROM_TXN_JOURNAL_PAGES shall be in 1..64"
+#endif
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Journal image: staged entries, then the journal read by the recovery */
+static uint8_t txn_journal[TXN_JOURNAL_SIZE];
+
+/* Transaction open and bytes staged after the header */
+static bool txn_open = false;
+static uint16_t txn_length;
+static uint8_t txn_entries;
+
+/* Counters */
+static eeprom_txn_stats_t txn_stats;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static uint16_t crc16(uint16_t, const uint8_t *, uint16_t);
+static uint16_t journal_crc(void);
+static bool apply_entries(bool);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Function to initialise the transactions: recover an interrupted commit */
+void eeprom_txn_init(void)
+{
+	txn_open = false;
+	(void)eeprom_txn_recover();
+}
+
+
+/* Function to roll forward the last committed transaction. Return false on
+ * a bus error only: no valid journal means nothing to recover. */
+bool eeprom_txn_recover(void)
+{
+	uint16_t length;
+	bool success;
+
+	txn_open = false;
+	txn_stats.recovered = 0;
+
+	success = eeprom_wait_ready()
+			&& eeprom_read_page(EEPROM_TXN_JOURNAL_START, txn_journal, PAGE_SIZE);
+
+	if (success && (TXN_MAGIC == txn_journal[0])) {
+		length = (uint16_t)(txn_journal[2] | (txn_journal[3] << 8));
+		if ((TXN_HEADER_SIZE + length) <= TXN_JOURNAL_SIZE) {
+			if ((TXN_HEADER_SIZE + length) > PAGE_SIZE) {
+				success = eeprom_read_block(EEPROM_TXN_JOURNAL_START + PAGE_SIZE,
+											&txn_journal[PAGE_SIZE],
+											TXN_HEADER_SIZE + length - PAGE_SIZE);
+			}
+			txn_entries = txn_journal[1];
+			txn_length = length;
+			if (success
+			&& (journal_crc() == (uint16_t)(txn_journal[4] | (txn_journal[5] << 8)))) {
+				success = apply_entries(true);
+			}
+		}
+	}
+
+	txn_length = 0;
+	txn_entries = 0;
+
+	return success;
+}
+
+
+/* Function to open a transaction */
+bool eeprom_txn_begin(void)
+{
+	bool success = false;
+
+	if (!txn_open) {
+		txn_open = true;
+		txn_length = 0;
+		txn_entries = 0;
+		success = true;
+	}
+
+	return success;
+}
+
+
+/* Function to stage a write in the open transaction. Return false if the
+ * journal has no room for it: the transaction stays open. */
+bool eeprom_txn_write(eeprom_addr_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	uint32_t needed;
+	uint16_t chunk;
+	uint8_t *entry_ptr;
+	uint8_t i;
+
+	if (!txn_open
+	|| ((uint32_t)address + data_length > EEPROM_SIZE)) {
+		return false;
+	}
+
+	/* an entry holds up to 255 bytes; 32 bits: the headers of a long write
+	 * would wrap a 16-bit count */
+	needed = (uint32_t)data_length + TXN_ENTRY_HEADER_SIZE * (((uint32_t)data_length + TXN_ENTRY_MAX - 1) / TXN_ENTRY_MAX);
+	if (((TXN_HEADER_SIZE + txn_length + needed) > TXN_JOURNAL_SIZE)
+	|| ((txn_entries + (needed - data_length) / TXN_ENTRY_HEADER_SIZE) > 0xFF)) {
+		return false;
+	}
+
+	while (data_length > 0) {
+		chunk = (data_length > TXN_ENTRY_MAX) ? TXN_ENTRY_MAX : data_length;
+		entry_ptr = &txn_journal[TXN_HEADER_SIZE + txn_length];
+		for (i = 0; i < TXN_ADDRESS_SIZE; i++) {
+			entry_ptr[i] = (uint8_t)(address >> (8 * i));
+		}
+		entry_ptr[TXN_ADDRESS_SIZE] = (uint8_t)chunk;
+		memcpy(&entry_ptr[TXN_ENTRY_HEADER_SIZE], byte_ptr, chunk);
+		txn_length += TXN_ENTRY_HEADER_SIZE + chunk;
+		txn_entries++;
+		address += chunk;
+		byte_ptr += chunk;
+		data_length -= chunk;
+	}
+
+	return true;
+}
+
+
+/* Function to commit the open transaction: journal first, then the data.
+ * On a false return the transaction is closed and shall be recovered. */
+bool eeprom_txn_commit(void)
+{
+	uint16_t crc;
+	uint16_t length;
+	uint8_t pages;
+	uint8_t page;
+	uint8_t i;
+	bool success;
+
+	if (!txn_open) {
+		return false;
+	}
+	txn_open = false;
+
+	if (0 == txn_entries) {
+		return true;
+	}
+
+	txn_journal[0] = TXN_MAGIC;
+	txn_journal[1] = txn_entries;
+	txn_journal[2] = (uint8_t)txn_length;
+	txn_journal[3] = (uint8_t)(txn_length >> 8);
+	crc = journal_crc();
+	txn_journal[4] = (uint8_t)crc;
+	txn_journal[5] = (uint8_t)(crc >> 8);
+
+	/* the first page commits: it is written after the others */
+	pages = (uint8_t)((TXN_HEADER_SIZE + txn_length + PAGE_SIZE - 1) / PAGE_SIZE);
+	success = true;
+	for (i = 1; success && (i <= pages); i++) {
+		page = i % pages;
+		length = (page == (pages - 1)) ? (TXN_HEADER_SIZE + txn_length - page * PAGE_SIZE) : PAGE_SIZE;
+		success = eeprom_wait_ready()
+				&& eeprom_write_page(EEPROM_TXN_JOURNAL_START + page * PAGE_SIZE,
+									 &txn_journal[page * PAGE_SIZE], length);
+		txn_stats.journal_writes++;
+	}
+
+	success = success && apply_entries(false) && eeprom_wait_ready();
+
+	if (success) {
+		txn_stats.commits++;
+		txn_stats.data_bytes += txn_length - TXN_ENTRY_HEADER_SIZE * txn_entries;
+	}
+
+	return success;
+}
+
+
+/* Function to drop the staged writes */
+void eeprom_txn_abort(void)
+{
+	txn_open = false;
+}
+
+
+/* Function to get the transaction counters */
+void eeprom_txn_get_stats(eeprom_txn_stats_t *stats_ptr)
+{
+	*stats_ptr = txn_stats;
+}
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* CRC-16/CCITT, polynomial 0x1021 */
+static uint16_t crc16(uint16_t crc, const uint8_t *data_ptr, uint16_t data_length)
+{
+	uint8_t bit;
+
+	while (data_length > 0) {
+		crc ^= (uint16_t)(*data_ptr++ << 8);
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+		data_length--;
+	}
+
+	return crc;
+}
+
+
+/* CRC of the journal image: header without the CRC, then the entries */
+static uint16_t journal_crc(void)
+{
+	uint16_t crc = crc16(0xFFFF, txn_journal, 4);
+
+	return crc16(crc, &txn_journal[TXN_HEADER_SIZE], txn_length);
+}
+
+
+/* Write the journal entries to their addresses. The recovery writes only
+ * the bytes differing from the device. */
+static bool apply_entries(bool recovering)
+{
+	eeprom_update_stats_t update;
+	uint16_t offset = TXN_HEADER_SIZE;
+	eeprom_addr_t address;
+	uint8_t length;
+	uint8_t entry;
+	uint8_t i;
+	bool success = true;
+
+	for (entry = 0; success && (entry < txn_entries); entry++) {
+		address = 0;
+		for (i = TXN_ADDRESS_SIZE; i > 0; i--) {
+			address = (eeprom_addr_t)((address << 8) | txn_journal[offset + i - 1]);
+		}
+		length = txn_journal[offset + TXN_ADDRESS_SIZE];
+		offset += TXN_ENTRY_HEADER_SIZE;
+		if ((offset + length > TXN_HEADER_SIZE + txn_length)
+		|| ((uint32_t)address + length > EEPROM_SIZE)) {
+			break;
+		}
+		if (recovering) {
+			success = eeprom_update_block(address, &txn_journal[offset], length, &update);
+			if (update.bytes_written > 0) {
+				txn_stats.recovered++;
+			}
+		} else {
+			success = eeprom_wait_ready()
+					&& eeprom_write_block(address, &txn_journal[offset], length);
+		}
+		offset += length;
+	}
+
+	return success;
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,69 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef _EEPROM_TXN_INCLUDED_		/* switch to read the header file only */
+#define _EEPROM_TXN_INCLUDED_		/* one time. */
+
+
+/* ----------- Exported constants ------------- */
+
+/* EEPROM journal region: first address (page aligned) and pages.
+ * By default 8 pages below the last eighth of the array */
+#ifndef EEPROM_TXN_JOURNAL_START
+#define EEPROM_TXN_JOURNAL_START	(EEPROM_SIZE - EEPROM_SIZE / 8 - 8 * PAGE_SIZE)
+#endif
+#ifndef EEPROM_TXN_JOURNAL_PAGES
+#define EEPROM_TXN_JOURNAL_PAGES	4
+#endif
+
+/* ----------- Exported types ------------- */
+
+/* Transaction counters */
+typedef struct {
+	uint32_t commits;			/* transactions committed */
+	uint32_t journal_writes;	/* journal page writes */
+	uint32_t data_bytes;		/* bytes staged by the committed transactions */
+	uint16_t recovered;			/* ranges rolled forward by the last recovery */
+} eeprom_txn_stats_t;
+
+/* ----------- Exported functions prototypes ------------- */
+
+extern void eeprom_txn_init(void);
+extern bool eeprom_txn_recover(void);
+extern bool eeprom_txn_begin(void);
+extern bool eeprom_txn_write(eeprom_addr_t, uint8_t *, uint16_t);
+extern bool eeprom_txn_commit(void);
+extern void eeprom_txn_abort(void);
+extern void eeprom_txn_get_stats(eeprom_txn_stats_t *);
+
+
+
+
+#endif
+
+
+
+
+/* End of file */
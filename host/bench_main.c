@@ -0,0 +1,126 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/*
+ * This file bench_main.c runs the benchmark sweep of eeprom_bench.c on a
+ * Linux host against a simulated device. The results go to the standard
+ * output as CSV, one line per case, so that two commits can be compared
+ * with diff.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "i2c_sim.h"
+#include "rtos.h"
+#include "eeprom.h"
+#include "eeprom_bench.h"
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Operation names, by EEPROM_BENCH_x */
+static const char *const op_names[EEPROM_BENCH_OPS] = {
+	"read_byte",
+	"read_page",
+	"read_block",
+	"write_page",
+	"write_block"
+};
+
+/* Bus speeds in kHz, by EEPROM_SPEED_x */
+static const unsigned speed_khz[] = {100, 400, 1000};
+
+/* RTOS states: no tasks, the driver is used by blocking calls only */
+static void (*no_task_ptr_array[])(void) = {
+	NULL
+};
+
+rtos_state_t * const rtos_cfg_states_array[RTOS_CFG_KE_STATE_MAX_NUM] = {
+	no_task_ptr_array,
+	no_task_ptr_array,
+	no_task_ptr_array
+};
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static void print_result(const eeprom_bench_result_t *);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+int main(void)
+{
+	bool ok;
+
+	i2c_sim_init();
+	eeprom_init();
+
+	printf("op,speed_khz,size,offset,iterations,ops_per_s,bytes_per_s,p50_us,p99_us,overhead_pct\n");
+	ok = eeprom_bench_sweep(print_result);
+
+	if (!ok) {
+		fprintf(stderr, "eeprom_bench: device error\n");
+	}
+
+	return ok ? 0 : 1;
+}
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* One CSV line per case */
+static void print_result(const eeprom_bench_result_t *result_ptr)
+{
+	printf("%s,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+			op_names[result_ptr->bench_case.op],
+			speed_khz[result_ptr->bench_case.speed],
+			(unsigned)result_ptr->bench_case.size,
+			(unsigned)result_ptr->bench_case.offset,
+			(unsigned)result_ptr->bench_case.iterations,
+			(unsigned)result_ptr->ops_per_s,
+			(unsigned)result_ptr->bytes_per_s,
+			(unsigned)result_ptr->p50_us,
+			(unsigned)result_ptr->p99_us,
+			(unsigned)result_ptr->overhead_pct);
+}
+
+
+
+
+/* End of file */
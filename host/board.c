@@ -0,0 +1,138 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+/*
+ * This file board.c represents the source file of the host board.
+ *
+ * The firmware (main.c, rtos_cfg.c, test.c and the driver) runs unchanged
+ * on the simulated STM32F4 Discovery: the board is powered up before
+ * main(), the main loop idles on the simulator time (RTOS_CFG_IDLE_HOOK)
+ * and the run ends when the test task lights the green or the red LED.
+ * The exit status is 0 on the green one.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "i2c_sim.h"
+#include "board.h"
+#include "eeprom.h"
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+
+
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Longest run before declaring the test stuck */
+#define BOARD_TIME_LIMIT_NS		(10ull * 1000000000ull)
+
+/* Test result LEDs */
+#define BOARD_LED_PASS			GPIO12
+#define BOARD_LED_FAIL			GPIO14
+#define BOARD_LED_FACTORY		GPIO15
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* SCL period, by EEPROM_SPEED_x */
+static const uint32_t bit_ns_array[] = {10000, 2500, 1000};
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static void board_power_on(void) __attribute__((constructor));
+static void board_report(uint16_t);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Main loop idle: spend the simulator time up to the next event and stop
+ * at the test result */
+void board_idle(void)
+{
+	uint16_t leds;
+
+	i2c_sim_idle();
+
+	leds = gpio_get(GPIOD, BOARD_LED_PASS | BOARD_LED_FAIL);
+	if ((0 != leds) || (i2c_sim_time_ns() > BOARD_TIME_LIMIT_NS)) {
+		board_report(leds);
+	}
+}
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Power up: erased devices and peripherals at reset, before main() */
+static void board_power_on(void)
+{
+	i2c_sim_init();
+}
+
+
+/* Print the test result and the bus usage, then leave */
+static void board_report(uint16_t leds)
+{
+	uint64_t elapsed_ns = i2c_sim_time_ns();
+	i2c_sim_stats_t stats;
+
+	i2c_sim_get_stats(I2C1, &stats);
+
+	printf("board: %u byte device, %u kHz bus\n", (unsigned)EEPROM_SIZE,
+			(unsigned)(1000000u / bit_ns_array[EEPROM_CFG_SPEED]));
+	printf("  test %-10s %10.2f ms\n",
+			(BOARD_LED_PASS == leds) ? "passed" : ((0 != leds) ? "failed" : "stuck"),
+			(double)elapsed_ns / 1e6);
+	printf("  factory data %s\n", (0 != gpio_get(GPIOD, BOARD_LED_FACTORY)) ? "valid" : "not valid");
+	printf("  bus busy     %10.2f ms (%u bit times)\n",
+			(double)stats.bit_times * bit_ns_array[EEPROM_CFG_SPEED] / 1e6, (unsigned)stats.bit_times);
+	printf("  STARTs       %10u\n", (unsigned)stats.starts);
+	printf("  data bytes   %10u\n", (unsigned)stats.data_bytes);
+	printf("  NACKs        %10u\n", (unsigned)stats.nacks);
+	printf("  write cycles %10u\n", (unsigned)stats.write_cycles);
+	printf("  interrupts   %10u\n", (unsigned)stats.interrupts);
+
+	exit((BOARD_LED_PASS == leds) ? 0 : 1);
+}
+
+
+
+
+/* End of file */
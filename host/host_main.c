@@ -0,0 +1,2159 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * This file host_main.c exercises the EEPROM driver against the I2C
+ * simulator on a Linux host.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "i2c_sim.h"
+#include "rtos.h"
+#include "eeprom.h"
+#include "eeprom_cache.h"
+#include "eeprom_queue.h"
+#include "eeprom_kv.h"
+#include "eeprom_txn.h"
+#include "eeprom_array.h"
+#include "eeprom_sched.h"
+#include "eeprom_stream.h"
+#include "eeprom_image.h"
+#include "eeprom_layout.h"
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+
+
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Device under test, and the bus address of the other devices: their
+ * pins above the block select bits */
+#define SIM_EEPROM_ADDRESS		0x50
+#define SIM_DEVICE_ADDRESS(dev)	(SIM_EEPROM_ADDRESS + ((dev) << EEPROM_BLOCK_BITS))
+
+/* Transaction test: a configuration record spanning three pages and a
+ * counter elsewhere, saved together */
+#define TXN_RECORD_ADDRESS		0x3020
+#define TXN_RECORD_SIZE			100
+#define TXN_COUNTER_ADDRESS		0x3100
+
+/* Range in the upper half of the array: past 64 KiB on the larger parts */
+#define TXN_HIGH_ADDRESS		((eeprom_addr_t)(EEPROM_SIZE / 2 + 0x0200))
+
+/* Journal pages of that commit: header, then address and length of each
+ * entry before its data */
+#define TXN_ENTRY_HEADER		((EEPROM_SIZE > 0x10000) ? 4 : 3)
+#define TXN_JOURNAL_BYTES		(6 + TXN_ENTRY_HEADER + TXN_RECORD_SIZE + TXN_ENTRY_HEADER + 4)
+#define TXN_JOURNAL_USED		((TXN_JOURNAL_BYTES + PAGE_MASK) / PAGE_SIZE)
+
+/* Cache test: counters spread over the first pages, a page written in
+ * full after them */
+#define CACHE_ADDRESS			0x7000
+#define CACHE_SPAN				(6 * PAGE_SIZE)
+#define CACHE_FULL_ADDRESS		(CACHE_ADDRESS + 8 * PAGE_SIZE)
+
+/* Update test: config struct over several pages, pages it touches */
+#define UPDATE_ADDRESS			0x2410
+#define UPDATE_SIZE				300
+#define UPDATE_PAGES			(((UPDATE_ADDRESS & PAGE_MASK) + UPDATE_SIZE + PAGE_MASK) / PAGE_SIZE)
+
+/* Device array benchmark: data written and read */
+#define ARRAY_BENCH_SIZE		0x2000
+
+/* Bus context test: block written on each bus */
+#define BUS_BLOCK_ADDRESS		0x2000
+#define BUS_BLOCK_SIZE			2048
+
+/* Cursor test: stream parsed in small consecutive chunks */
+#define CURSOR_STREAM_ADDRESS	0x1000
+#define CURSOR_STREAM_SIZE		1024
+#define CURSOR_CHUNK_SIZE		8
+
+/* Scatter/gather test: structures saved together, page of the first one */
+#define VECTOR_PAGE_ADDRESS		0x3400
+#define VECTOR_SEGMENTS			6
+
+/* Scheduler test: long background write, calibration data read while it
+ * is running, chunks read in any order */
+#define SCHED_LOG_ADDRESS		0x5000
+#define SCHED_LOG_SIZE			2048
+#define SCHED_CAL_ADDRESS		0x0F00
+#define SCHED_CAL_SIZE			64
+#define SCHED_CHUNKS			4
+
+/* Stream test: logger samples written and parsed a few bytes at a time */
+#define STREAM_ADDRESS			0x5800
+#define STREAM_SIZE				2048
+#define STREAM_SAMPLE_SIZE		3
+#define STREAM_BYTE_WRITES		(STREAM_SAMPLE_SIZE * 20)
+
+/* Compare test: provisioned region verified against its image */
+#define COMPARE_ADDRESS			0x6000
+#define COMPARE_SIZE			2048
+
+/* Performance counters: page after the compare range */
+#define PERF_ADDRESS			0x6800
+
+/* Image test: time taken by the service link to move a byte to or from
+ * the file (1 Mbaud UART), chunk of the reference dump */
+#define IMAGE_LINK_NS_PER_BYTE	10000u
+#define IMAGE_NAIVE_CHUNK		64
+
+/* Hot key updates of the key/value test: enough to wrap the log */
+#define KV_UPDATES				(EEPROM_KV_PAGES * PAGE_SIZE / 3)
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Status received by the completion callback */
+static volatile uint8_t cb_status;
+
+/* Completion callback calls */
+static volatile uint32_t cb_calls;
+
+/* Checks failed */
+static uint32_t failures;
+
+/* File of the image test */
+static FILE *image_file;
+
+/* Completion time of the scheduler requests */
+static volatile uint64_t sched_cal_ns;
+static volatile uint64_t sched_log_ns;
+
+/* Periodic task calls and longest time between two calls */
+static uint32_t task_calls;
+static uint64_t task_last_ns;
+static uint64_t task_max_gap_ns;
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static void check(bool, const char *);
+static void transfer_done(uint8_t);
+static void wait_ready(void);
+static void run_async(void);
+static void run_blocking(void);
+static bool read_chunked(uint16_t, uint8_t *, uint16_t);
+static void run_sequential(void);
+static void run_dma(void);
+static void cadence_task(void);
+static void cadence_reset(void);
+static void run_rtos(void);
+static void poll_ready(void);
+static void run_twr(void);
+static void run_cache(void);
+static void run_read_cache(void);
+static void run_queue(void);
+static void run_update(void);
+static void run_kv(void);
+static void run_txn(void);
+static void run_record(void);
+static void run_array(void);
+static void run_bus(void);
+static void run_cursor(void);
+static void run_vector(void);
+static void cal_done(uint8_t);
+static void log_done(uint8_t);
+static uint32_t sched_cal_latency(uint8_t);
+static void run_sched(void);
+static void run_stream(void);
+static void run_compare(void);
+static void run_layout(void);
+static void run_perf(void);
+static void link_time(uint16_t);
+static bool image_sink(eeprom_addr_t, const uint8_t *, uint16_t);
+static bool image_source(eeprom_addr_t, uint8_t *, uint16_t);
+static void run_image(void);
+static bool txn_save(uint8_t);
+static uint8_t txn_version(void);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+int main(void)
+{
+	i2c_sim_init();
+	eeprom_init();
+
+	run_async();
+	run_blocking();
+	run_sequential();
+	run_dma();
+	run_rtos();
+	run_twr();
+	run_cache();
+	run_read_cache();
+	run_queue();
+	run_update();
+	run_kv();
+	run_txn();
+	run_record();
+	run_array();
+	run_bus();
+	run_cursor();
+	run_vector();
+	run_sched();
+	run_stream();
+	run_compare();
+	run_layout();
+	run_perf();
+	run_image();
+
+	printf("%s\n", (0 == failures) ? "PASS" : "FAIL");
+
+	return (0 == failures) ? 0 : 1;
+}
+
+
+
+
+/* RTOS states: the periodic task records its cadence */
+static void (*init_state_ptr_array[])(void) = {
+	NULL
+};
+
+static void (*normal_state_ptr_array[])(void) = {
+	&cadence_task,
+	&eeprom_cache_task,
+	NULL
+};
+
+static void (*sleep_state_ptr_array[])(void) = {
+	NULL
+};
+
+rtos_state_t * const rtos_cfg_states_array[RTOS_CFG_KE_STATE_MAX_NUM] = {
+	init_state_ptr_array,
+	normal_state_ptr_array,
+	sleep_state_ptr_array
+};
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Record a check result */
+static void check(bool ok, const char *what)
+{
+	printf("  %-48s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok) {
+		failures++;
+	}
+}
+
+
+/* Completion callback */
+static void transfer_done(uint8_t status)
+{
+	cb_status = status;
+	cb_calls++;
+}
+
+
+/* ACK polling until the end of the device write cycle */
+static void wait_ready(void)
+{
+	do {
+		while (!eeprom_probe_async(transfer_done)) {
+			i2c_sim_idle();
+		}
+		while (EEPROM_ST_BUSY == eeprom_get_status()) {
+			i2c_sim_idle();
+		}
+	} while (cb_status != EEPROM_ST_DONE);
+}
+
+
+/* Page write and read through the interrupt engine */
+static void run_async(void)
+{
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t page[PAGE_SIZE];
+	uint8_t back[PAGE_SIZE];
+	uint32_t other_work = 0;
+	uint64_t start_ns;
+	uint16_t i;
+
+	printf("interrupt driven transfers\n");
+
+	for (i = 0; i < PAGE_SIZE; i++) {
+		page[i] = (uint8_t)(i * 7 + 1);
+	}
+
+	/* page write: the main loop keeps running until the callback */
+	start_ns = i2c_sim_time_ns();
+	cb_calls = 0;
+	check(eeprom_write_page_async(0x0100, page, PAGE_SIZE, transfer_done), "write started");
+	check(!eeprom_write_page_async(0x0100, page, PAGE_SIZE, transfer_done), "second start refused while busy");
+	while (EEPROM_ST_BUSY == eeprom_get_status()) {
+		other_work++;
+		i2c_sim_idle();
+	}
+	check((1 == cb_calls) && (EEPROM_ST_DONE == cb_status), "write completed through callback");
+	check(other_work > 0, "main loop ran during the transfer");
+	printf("  page write %.1f us, %u main loop passes\n",
+			(double)(i2c_sim_time_ns() - start_ns) / 1000.0, (unsigned)other_work);
+
+	/* the device does not answer during its write cycle */
+	check(eeprom_probe_async(transfer_done), "probe started");
+	while (EEPROM_ST_BUSY == eeprom_get_status()) {
+		i2c_sim_idle();
+	}
+	check(EEPROM_ST_NACK == cb_status, "probe NACKed during write cycle");
+	check(memcmp(&mem[0x0100], page, PAGE_SIZE) == 0, "device content");
+
+	/* wait for the write cycle, then read back asynchronously */
+	wait_ready();
+
+	memset(back, 0, sizeof(back));
+	check(eeprom_read_page_async(0x0100, back, PAGE_SIZE, transfer_done), "read started");
+	while (EEPROM_ST_BUSY == eeprom_get_status()) {
+		i2c_sim_idle();
+	}
+	check((EEPROM_ST_DONE == cb_status) && (memcmp(back, page, PAGE_SIZE) == 0), "read back");
+}
+
+
+/* Blocking wrappers on top of the engine */
+static void run_blocking(void)
+{
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t block[300];
+	uint8_t back[300];
+	uint8_t byte = 0;
+	uint16_t i;
+
+	printf("blocking wrappers\n");
+
+	for (i = 0; i < sizeof(block); i++) {
+		block[i] = (uint8_t)(i ^ 0x5A);
+	}
+
+	check(eeprom_write_byte(0x0101, 0xAD), "write byte");
+	wait_ready();
+	check(eeprom_write_block(0x0230, block, sizeof(block)), "write block across pages");
+	check(memcmp(&mem[0x0230], block, sizeof(block)) == 0, "device content");
+	check(eeprom_read_byte(0x0101, &byte) && (0xAD == byte), "read byte");
+	memset(back, 0, sizeof(back));
+	check(eeprom_read_page(0x0232, back, 2) && (memcmp(back, block + 2, 2) == 0), "read 2 bytes");
+	memset(back, 0, sizeof(back));
+	check(eeprom_read_block(0x0230, back, sizeof(back)), "read block");
+	check(memcmp(back, block, sizeof(block)) == 0, "read block content");
+}
+
+
+
+
+/* Previous eeprom_read_block: one addressed transaction per page */
+static bool read_chunked(uint16_t address, uint8_t *byte_ptr, uint16_t data_length)
+{
+	uint16_t chunk_size;
+
+	while (data_length > 0) {
+		chunk_size = PAGE_SIZE - (address & PAGE_MASK);
+		if (chunk_size > data_length) {
+			chunk_size = data_length;
+		}
+		if (!eeprom_read_page(address, byte_ptr, chunk_size)) {
+			return false;
+		}
+		address += chunk_size;
+		byte_ptr += chunk_size;
+		data_length -= chunk_size;
+	}
+
+	return true;
+}
+
+
+/* Sequential read against the chunked path: content and bus cycles */
+static void run_sequential(void)
+{
+	static const uint16_t lengths[] = {1, 2, 3, 4, 64, 100, 1024, 4096};
+	static uint8_t back[4096];
+	uint32_t chunked_bits[sizeof(lengths) / sizeof(lengths[0])];
+	uint32_t sequential_bits[sizeof(lengths) / sizeof(lengths[0])];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t chunked, sequential;
+	uint16_t address;
+	char what[64];
+	uint32_t i;
+
+	printf("sequential read\n");
+
+	for (i = 0; i < 0x8000u; i++) {
+		mem[i] = (uint8_t)((i * 31u) ^ (i >> 8));
+	}
+
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		address = 0x1010;
+
+		i2c_sim_reset_stats();
+		memset(back, 0, sizeof(back));
+		snprintf(what, sizeof(what), "chunked read of %u bytes", lengths[i]);
+		check(read_chunked(address, back, lengths[i])
+				&& (memcmp(back, &mem[address], lengths[i]) == 0), what);
+		i2c_sim_get_stats(I2C1, &chunked);
+		chunked_bits[i] = chunked.bit_times;
+
+		i2c_sim_reset_stats();
+		memset(back, 0, sizeof(back));
+		snprintf(what, sizeof(what), "sequential read of %u bytes", lengths[i]);
+		check(eeprom_read_block(address, back, lengths[i])
+				&& (memcmp(back, &mem[address], lengths[i]) == 0), what);
+		i2c_sim_get_stats(I2C1, &sequential);
+		sequential_bits[i] = sequential.bit_times;
+	}
+
+	/* bus cycles (SCL periods) of both paths */
+	printf("  %6s %12s %12s %8s\n", "bytes", "chunked", "sequential", "saved");
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		printf("  %6u %12u %12u %7.1f%%\n", lengths[i],
+				(unsigned)chunked_bits[i], (unsigned)sequential_bits[i],
+				100.0 * (double)(chunked_bits[i] - sequential_bits[i]) / (double)chunked_bits[i]);
+	}
+
+	/* the device address counter wraps at the end of the array */
+	memset(back, 0, sizeof(back));
+	check(eeprom_read_block((eeprom_addr_t)(EEPROM_SIZE - 16), back, 32)
+			&& (memcmp(back, &mem[EEPROM_SIZE - 16], 16) == 0)
+			&& (memcmp(back + 16, &mem[0], 16) == 0), "sequential read wraps at the end of the array");
+}
+
+
+
+
+/* DMA mode against interrupt mode: content and CPU interrupts */
+static void run_dma(void)
+{
+	static const uint8_t modes[2] = {EEPROM_MODE_IRQ, EEPROM_MODE_DMA};
+	static const char *const names[2] = {"irq", "dma"};
+	static uint8_t back[4096];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t page[PAGE_SIZE];
+	i2c_sim_stats_t write_stats, read_stats;
+	uint8_t byte = 0;
+	char what[64];
+	uint16_t i;
+	uint8_t m;
+
+	printf("dma mode\n");
+
+	for (i = 0; i < PAGE_SIZE; i++) {
+		page[i] = (uint8_t)(0xC3 ^ i);
+	}
+
+	for (m = 0; m < 2; m++) {
+		eeprom_init_mode(modes[m]);
+
+		i2c_sim_reset_stats();
+		snprintf(what, sizeof(what), "%s: page write", names[m]);
+		check(eeprom_write_page(0x2000 + m * PAGE_SIZE, page, PAGE_SIZE), what);
+		i2c_sim_get_stats(I2C1, &write_stats);
+		wait_ready();
+		snprintf(what, sizeof(what), "%s: page content", names[m]);
+		check(memcmp(&mem[0x2000 + m * PAGE_SIZE], page, PAGE_SIZE) == 0, what);
+
+		i2c_sim_reset_stats();
+		memset(back, 0, sizeof(back));
+		snprintf(what, sizeof(what), "%s: 4096 byte sequential read", names[m]);
+		check(eeprom_read_block(0x1003, back, sizeof(back))
+				&& (memcmp(back, &mem[0x1003], sizeof(back)) == 0), what);
+		i2c_sim_get_stats(I2C1, &read_stats);
+
+		snprintf(what, sizeof(what), "%s: 1, 2 and 3 byte reads", names[m]);
+		memset(back, 0, 3);
+		check(eeprom_read_byte(0x1003, &byte) && (byte == mem[0x1003])
+				&& eeprom_read_page(0x1004, back, 2) && (memcmp(back, &mem[0x1004], 2) == 0)
+				&& eeprom_read_page(0x1006, back, 3) && (memcmp(back, &mem[0x1006], 3) == 0), what);
+
+		printf("  %s: I2C interrupts: page write %u, 4096 byte read %u\n", names[m],
+				(unsigned)write_stats.interrupts, (unsigned)read_stats.interrupts);
+	}
+
+	eeprom_init_mode(EEPROM_MODE_IRQ);
+}
+
+
+
+
+/* Periodic task of the normal state */
+static void cadence_task(void)
+{
+	uint64_t now_ns = i2c_sim_time_ns();
+
+	if ((task_calls > 0) && ((now_ns - task_last_ns) > task_max_gap_ns)) {
+		task_max_gap_ns = now_ns - task_last_ns;
+	}
+	task_last_ns = now_ns;
+	task_calls++;
+}
+
+
+/* Restart the cadence measurement */
+static void cadence_reset(void)
+{
+	task_calls = 0;
+	task_max_gap_ns = 0;
+}
+
+
+/* Block write with the write cycle waited by the RTOS against ACK polling */
+static void run_rtos(void)
+{
+	static uint8_t block[4096];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint64_t idle_gap_ns;
+	uint64_t start_ns;
+	uint16_t i;
+
+	printf("rtos paced block write\n");
+
+	for (i = 0; i < sizeof(block); i++) {
+		block[i] = (uint8_t)((i * 13u) ^ (i >> 7));
+	}
+
+	rtos_start_operation(RTOS_CFG_KE_NORMAL_STATE);
+
+	/* task period with an idle bus */
+	cadence_reset();
+	while (task_calls < 4) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	idle_gap_ns = task_max_gap_ns;
+
+	cadence_reset();
+	cb_calls = 0;
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_write_block_async(0x4000, block, sizeof(block), transfer_done), "async block write started");
+	check(!eeprom_write_block_async(0x4000, block, sizeof(block), transfer_done), "second block write refused");
+	while (eeprom_write_block_busy()) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	check((1 == cb_calls) && (EEPROM_ST_DONE == cb_status), "block write completed through callback");
+	check(memcmp(&mem[0x4000], block, sizeof(block)) == 0, "device content");
+	check(task_max_gap_ns <= idle_gap_ns, "tasks kept their period");
+	printf("  async: %.1f ms, %u task calls, longest task gap %.1f ms (idle %.1f ms)\n",
+			(double)(i2c_sim_time_ns() - start_ns) / 1e6, (unsigned)task_calls,
+			(double)task_max_gap_ns / 1e6, (double)idle_gap_ns / 1e6);
+
+	/* ACK polling: no task runs until the whole block is written */
+	for (i = 0; i < sizeof(block); i++) {
+		block[i] = (uint8_t)~block[i];
+	}
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_write_block(0x4000, block, sizeof(block)), "blocking block write");
+	check(memcmp(&mem[0x4000], block, sizeof(block)) == 0, "device content");
+	printf("  blocking: %.1f ms without any task call\n",
+			(double)(i2c_sim_time_ns() - start_ns) / 1e6);
+
+	/* device gone during the second write cycle: no ACK any more */
+	i2c_sim_power_cut(I2C1, SIM_EEPROM_ADDRESS, 1, false);
+	cb_calls = 0;
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_write_block_async(0x4000, block, sizeof(block), transfer_done), "async block write started");
+	while (eeprom_write_block_busy() && ((i2c_sim_time_ns() - start_ns) < 1000000000u)) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	check(!eeprom_write_block_busy() && (1 == cb_calls) && (EEPROM_ST_NACK == cb_status),
+			"silent device ends the block write");
+	printf("  silent device: NACK after %.1f ms\n", (double)(i2c_sim_time_ns() - start_ns) / 1e6);
+	i2c_sim_power_restore(I2C1, SIM_EEPROM_ADDRESS);
+
+	rtos_stop_operation();
+}
+
+
+
+
+/* Previous ACK polling: probes back to back from the end of the write */
+static void poll_ready(void)
+{
+	do {
+		while (!eeprom_probe_async(transfer_done)) {
+			i2c_sim_idle();
+		}
+		while (EEPROM_ST_BUSY == eeprom_get_status()) {
+			i2c_sim_idle();
+		}
+	} while (cb_status != EEPROM_ST_DONE);
+}
+
+
+/* Predicted write cycle against immediate ACK polling */
+static void run_twr(void)
+{
+	static const uint32_t write_times_us[] = {5000, 3300, 1800};
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t page[PAGE_SIZE];
+	i2c_sim_stats_t polled, predicted;
+	eeprom_twr_stats_t twr_before, twr_after;
+	uint64_t polled_ns, predicted_ns, start_ns;
+	bool content_ok;
+	char what[64];
+	uint16_t p;
+	uint16_t i;
+	uint8_t t;
+
+	printf("write cycle predictor\n");
+	printf("  %6s %16s %16s %10s %10s\n", "tWR us", "polled frames", "predicted frames", "learned us", "max us");
+
+	for (t = 0; t < sizeof(write_times_us) / sizeof(write_times_us[0]); t++) {
+		i2c_sim_set_write_time(write_times_us[t] * 1000u);
+
+		/* immediate polling */
+		i2c_sim_reset_stats();
+		start_ns = i2c_sim_time_ns();
+		content_ok = true;
+		for (p = 0; p < 32; p++) {
+			for (i = 0; i < PAGE_SIZE; i++) {
+				page[i] = (uint8_t)(p + i + t);
+			}
+			content_ok = content_ok && eeprom_write_page(0x6000 + p * PAGE_SIZE, page, PAGE_SIZE);
+			poll_ready();
+			content_ok = content_ok && (memcmp(&mem[0x6000 + p * PAGE_SIZE], page, PAGE_SIZE) == 0);
+		}
+		i2c_sim_get_stats(I2C1, &polled);
+		polled_ns = i2c_sim_time_ns() - start_ns;
+		snprintf(what, sizeof(what), "tWR %u us: immediate polling", (unsigned)write_times_us[t]);
+		check(content_ok, what);
+
+		/* predicted write cycle and back-off */
+		eeprom_get_twr_stats(&twr_before);
+		i2c_sim_reset_stats();
+		start_ns = i2c_sim_time_ns();
+		content_ok = true;
+		for (p = 0; p < 32; p++) {
+			for (i = 0; i < PAGE_SIZE; i++) {
+				page[i] = (uint8_t)(p - i - t);
+			}
+			content_ok = content_ok && eeprom_write_page(0x6000 + p * PAGE_SIZE, page, PAGE_SIZE);
+			content_ok = content_ok && eeprom_wait_ready();
+			content_ok = content_ok && (memcmp(&mem[0x6000 + p * PAGE_SIZE], page, PAGE_SIZE) == 0);
+		}
+		i2c_sim_get_stats(I2C1, &predicted);
+		predicted_ns = i2c_sim_time_ns() - start_ns;
+		eeprom_get_twr_stats(&twr_after);
+		snprintf(what, sizeof(what), "tWR %u us: predicted write cycle", (unsigned)write_times_us[t]);
+		check(content_ok, what);
+		snprintf(what, sizeof(what), "tWR %u us: fewer address frames", (unsigned)write_times_us[t]);
+		check(predicted.address_frames < polled.address_frames, what);
+		snprintf(what, sizeof(what), "tWR %u us: no more than 10%% slower", (unsigned)write_times_us[t]);
+		check(predicted_ns * 10 <= polled_ns * 11, what);
+
+		printf("  %6u %16u %16u %10u %10u\n", (unsigned)write_times_us[t],
+				(unsigned)polled.address_frames, (unsigned)predicted.address_frames,
+				(unsigned)twr_after.twr_avg_us, (unsigned)twr_after.twr_max_us);
+		printf("  %6s probes %u, NACKed %u, %.1f ms against %.1f ms\n", "",
+				(unsigned)(twr_after.probes - twr_before.probes),
+				(unsigned)(twr_after.nacks - twr_before.nacks),
+				(double)predicted_ns / 1e6, (double)polled_ns / 1e6);
+	}
+
+	i2c_sim_set_write_time(5000000u);
+}
+
+
+
+
+/* Scattered small writes through the write-back cache */
+static void run_cache(void)
+{
+	static uint8_t image[CACHE_SPAN];
+	static uint8_t back[CACHE_SPAN];
+	uint8_t page[PAGE_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t direct, cached;
+	uint16_t offset;
+	uint16_t i;
+	uint8_t byte;
+	bool ok;
+
+	printf("write-back cache\n");
+
+	eeprom_cache_init();
+	memcpy(image, &mem[CACHE_ADDRESS], sizeof(image));
+
+	/* 100 counter updates spread over 3 pages, written directly */
+	i2c_sim_reset_stats();
+	ok = true;
+	for (i = 0; i < 100; i++) {
+		offset = (uint16_t)((i * 37u) % (3 * PAGE_SIZE));
+		byte = (uint8_t)(i + 1);
+		ok = ok && eeprom_write_byte(CACHE_ADDRESS + offset, byte) && eeprom_wait_ready();
+		image[offset] = byte;
+	}
+	i2c_sim_get_stats(I2C1, &direct);
+	check(ok && (memcmp(&mem[CACHE_ADDRESS], image, sizeof(image)) == 0), "direct byte writes");
+
+	/* the same updates through the cache */
+	i2c_sim_reset_stats();
+	ok = true;
+	for (i = 0; i < 100; i++) {
+		offset = (uint16_t)((i * 37u) % (3 * PAGE_SIZE));
+		byte = (uint8_t)(i + 0x81);
+		ok = ok && eeprom_cache_write(CACHE_ADDRESS + offset, &byte, 1);
+		image[offset] = byte;
+	}
+	check(ok, "cached byte writes");
+	check(3 == eeprom_cache_dirty_pages(), "3 dirty pages");
+	memset(back, 0, sizeof(back));
+	check(eeprom_cache_read(CACHE_ADDRESS, back, (3 * PAGE_SIZE)) && (memcmp(back, image, (3 * PAGE_SIZE)) == 0),
+			"reads served from the cache");
+	check(memcmp(&mem[CACHE_ADDRESS], image, (3 * PAGE_SIZE)) != 0, "device not written yet");
+
+	/* the background task flushes one page per period */
+	rtos_start_operation(RTOS_CFG_KE_NORMAL_STATE);
+	while (eeprom_cache_dirty_pages() > 0) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	rtos_stop_operation();
+	check(eeprom_wait_ready() && (memcmp(&mem[CACHE_ADDRESS], image, sizeof(image)) == 0),
+			"background flush");
+	i2c_sim_get_stats(I2C1, &cached);
+	printf("  100 scattered byte writes: %u write cycles direct, %u through the cache\n",
+			(unsigned)direct.write_cycles, (unsigned)cached.write_cycles);
+	check(cached.write_cycles < direct.write_cycles, "fewer write cycles");
+
+	/* more pages than slots: the replaced dirty pages are written back */
+	for (i = 0; i < 6; i++) {
+		byte = (uint8_t)(0xE0 + i);
+		offset = (uint16_t)(i * PAGE_SIZE + 5);
+		check(eeprom_cache_write(CACHE_ADDRESS + offset, &byte, 1), "write to a new page");
+		image[offset] = byte;
+	}
+	check(eeprom_cache_flush() && (memcmp(&mem[CACHE_ADDRESS], image, sizeof(image)) == 0)
+			&& (0 == eeprom_cache_dirty_pages()), "explicit flush");
+
+	/* a page not cached and written in full: no load, then read back from
+	 * the cache and written back when its slot is taken */
+	for (i = 0; i < PAGE_SIZE; i++) {
+		page[i] = (uint8_t)(0xA0 ^ i);
+	}
+	check(eeprom_cache_write(CACHE_FULL_ADDRESS, page, PAGE_SIZE), "full page write to a new page");
+	memset(back, 0, PAGE_SIZE);
+	check(eeprom_cache_read(CACHE_FULL_ADDRESS, back, PAGE_SIZE) && (memcmp(back, page, PAGE_SIZE) == 0),
+			"full page read back from the cache");
+	ok = true;
+	for (i = 0; i < EEPROM_CACHE_PAGES; i++) {
+		ok = ok && eeprom_cache_read((eeprom_addr_t)(CACHE_FULL_ADDRESS + (i + 1) * PAGE_SIZE), back, 1);
+	}
+	check(ok && eeprom_wait_ready() && (memcmp(&mem[CACHE_FULL_ADDRESS], page, PAGE_SIZE) == 0)
+			&& (0 == eeprom_cache_dirty_pages()), "full page written back at eviction");
+}
+
+
+
+
+/* Hot region and sequential scan through the read cache */
+static void run_read_cache(void)
+{
+	static uint8_t back[16 * PAGE_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	eeprom_cache_stats_t stats;
+	uint64_t direct_ns, cached_ns, start_ns;
+	uint8_t page[PAGE_SIZE];
+	uint8_t byte = 0;
+	uint16_t offset;
+	uint16_t i;
+	bool ok;
+
+	printf("read cache\n");
+
+	eeprom_cache_init();
+
+	/* 1000 byte reads over a 2 page calibration table */
+	start_ns = i2c_sim_time_ns();
+	ok = true;
+	for (i = 0; i < 1000; i++) {
+		offset = (uint16_t)((i * 53u) % (2 * PAGE_SIZE));
+		ok = ok && eeprom_read_byte(0x5000 + offset, &byte) && (byte == mem[0x5000 + offset]);
+	}
+	direct_ns = i2c_sim_time_ns() - start_ns;
+	check(ok, "direct byte reads");
+
+	start_ns = i2c_sim_time_ns();
+	ok = true;
+	for (i = 0; i < 1000; i++) {
+		offset = (uint16_t)((i * 53u) % (2 * PAGE_SIZE));
+		ok = ok && eeprom_cache_read(0x5000 + offset, &byte, 1) && (byte == mem[0x5000 + offset]);
+	}
+	cached_ns = i2c_sim_time_ns() - start_ns;
+	eeprom_cache_get_stats(&stats);
+	check(ok, "cached byte reads");
+	check((2 == stats.misses) && (998 == stats.hits), "2 misses, 998 hits");
+	printf("  1000 byte reads: %.1f ms direct, %.1f ms cached\n",
+			(double)direct_ns / 1e6, (double)cached_ns / 1e6);
+
+	/* sequential scan: every other page comes from the read ahead */
+	eeprom_cache_reset_stats();
+	memset(back, 0, sizeof(back));
+	ok = true;
+	for (i = 0; i < 16 * PAGE_SIZE; i += 16) {
+		ok = ok && eeprom_cache_read(0x5800 + i, &back[i], 16);
+	}
+	eeprom_cache_get_stats(&stats);
+	check(ok && (memcmp(back, &mem[0x5800], sizeof(back)) == 0), "sequential scan");
+	/* the last page read ahead is past the scan */
+	check((stats.prefetches > 0) && ((stats.prefetch_hits + 1) == stats.prefetches), "read ahead pages used");
+	printf("  scan of 16 pages: hits %u, misses %u, prefetches %u, prefetch hits %u, evictions %u\n",
+			(unsigned)stats.hits, (unsigned)stats.misses, (unsigned)stats.prefetches,
+			(unsigned)stats.prefetch_hits, (unsigned)stats.evictions);
+
+	/* writes done through the driver update the cached pages */
+	check(eeprom_cache_read(0x5F00, &byte, 1), "page cached");
+	for (i = 0; i < PAGE_SIZE; i++) {
+		page[i] = (uint8_t)(0x3C + i);
+	}
+	check(eeprom_write_page(0x5F00, page, PAGE_SIZE) && eeprom_wait_ready(), "direct page write");
+	memset(back, 0, PAGE_SIZE);
+	check(eeprom_cache_read(0x5F00, back, PAGE_SIZE) && (memcmp(back, page, PAGE_SIZE) == 0),
+			"cache coherent with direct writes");
+	check(eeprom_write_byte(0x5F10, 0x99) && eeprom_wait_ready()
+			&& eeprom_cache_read(0x5F10, &byte, 1) && (0x99 == byte), "cache coherent with byte writes");
+}
+
+
+
+
+/* Bursts of small writes merged by the queue */
+static void run_queue(void)
+{
+	static uint8_t image[4 * PAGE_SIZE];
+	static uint8_t back[4 * PAGE_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	eeprom_queue_stats_t stats;
+	i2c_sim_stats_t bus;
+	uint8_t data[8];
+	uint16_t offset;
+	uint16_t length;
+	uint32_t seed = 12345;
+	uint16_t i, j;
+	bool ok;
+
+	printf("write queue\n");
+
+	eeprom_queue_init();
+	memcpy(image, &mem[0x3000], sizeof(image));
+
+	/* 200 byte and short writes over 4 pages, overlapping at random */
+	i2c_sim_reset_stats();
+	ok = true;
+	for (i = 0; i < 200; i++) {
+		seed = seed * 1103515245u + 12345u;
+		offset = (uint16_t)((seed >> 8) % (sizeof(image) - 8));
+		length = (uint16_t)(1 + ((seed >> 20) % 8));
+		for (j = 0; j < length; j++) {
+			data[j] = (uint8_t)(seed >> (j & 3)) + (uint8_t)j;
+		}
+		ok = ok && eeprom_queue_write(0x3000 + offset, data, length);
+		memcpy(&image[offset], data, length);
+	}
+	check(ok, "200 writes queued");
+	check(eeprom_queue_read(0x3000, back, sizeof(back)) && (memcmp(back, image, sizeof(back)) == 0),
+			"read with the pending writes applied");
+
+	rtos_start_operation(RTOS_CFG_KE_NORMAL_STATE);
+	while (eeprom_queue_pending() > 0) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	rtos_stop_operation();
+	check(eeprom_wait_ready() && (memcmp(&mem[0x3000], image, sizeof(image)) == 0),
+			"device content in submission order");
+	i2c_sim_get_stats(I2C1, &bus);
+	eeprom_queue_get_stats(&stats);
+	check((4 == stats.page_writes) && (4 == bus.write_cycles), "one page write per page");
+	printf("  %u requests, %u page writes, %u fill reads, %u write cycles saved\n",
+			(unsigned)stats.requests, (unsigned)stats.page_writes,
+			(unsigned)stats.fill_reads, (unsigned)stats.saved_cycles);
+
+	/* scattered bytes in a page keep the device bytes in between */
+	eeprom_queue_reset_stats();
+	data[0] = 0x11;
+	data[1] = 0x22;
+	memcpy(back, &mem[0x3100], PAGE_SIZE);
+	back[3] = 0x11;
+	back[40] = 0x22;
+	check(eeprom_queue_write(0x3103, &data[0], 1) && eeprom_queue_write(0x3128, &data[1], 1)
+			&& eeprom_queue_sync() && (memcmp(&mem[0x3100], back, PAGE_SIZE) == 0), "holes filled from the device");
+	eeprom_queue_get_stats(&stats);
+	check((1 == stats.fill_reads) && (1 == stats.page_writes), "one fill read, one page write");
+
+	/* a full queue writes its oldest page to make room */
+	ok = true;
+	for (i = 0; i < EEPROM_QUEUE_PAGES + 2; i++) {
+		data[0] = (uint8_t)(0xA0 + i);
+		ok = ok && eeprom_queue_write((uint16_t)(0x3200 + i * PAGE_SIZE), data, 1);
+	}
+	check(ok && eeprom_queue_sync(), "more pages than entries");
+	for (i = 0; i < EEPROM_QUEUE_PAGES + 2; i++) {
+		ok = ok && (mem[0x3200 + i * PAGE_SIZE] == (uint8_t)(0xA0 + i));
+	}
+	check(ok, "device content");
+}
+
+
+
+
+/* Config save rewriting a whole struct with one field changed */
+static void run_update(void)
+{
+	static uint8_t config[UPDATE_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	eeprom_update_stats_t stats;
+	i2c_sim_stats_t write_bus, update_bus;
+	uint64_t write_ns, update_ns, start_ns;
+	uint16_t i;
+
+	printf("update block\n");
+
+	for (i = 0; i < sizeof(config); i++) {
+		config[i] = (uint8_t)(i * 3 + 7);
+	}
+	check(eeprom_write_block(UPDATE_ADDRESS, config, sizeof(config)) && eeprom_wait_ready(), "initial save");
+
+	/* one 4 byte field changed */
+	config[150] ^= 0xFF;
+	config[153] ^= 0xFF;
+
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_write_block(UPDATE_ADDRESS, config, sizeof(config)) && eeprom_wait_ready(), "save with write block");
+	write_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &write_bus);
+
+	config[150] ^= 0x0F;
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_update_block(UPDATE_ADDRESS, config, sizeof(config), &stats), "save with update block");
+	update_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &update_bus);
+	check(memcmp(&mem[UPDATE_ADDRESS], config, sizeof(config)) == 0, "device content");
+	check(((UPDATE_PAGES - 1) == stats.pages_skipped) && (1 == stats.pages_partial) && (0 == stats.pages_rewritten)
+			&& (1 == stats.bytes_written) && (1 == update_bus.write_cycles), "one byte written");
+	printf("  write block: %u write cycles, %.1f ms; update: %u write cycle, %.1f ms\n",
+			(unsigned)write_bus.write_cycles, (double)write_ns / 1e6,
+			(unsigned)update_bus.write_cycles, (double)update_ns / 1e6);
+
+	/* nothing changed */
+	check(eeprom_update_block(UPDATE_ADDRESS, config, sizeof(config), &stats)
+			&& (UPDATE_PAGES == stats.pages_skipped) && (0 == stats.bytes_written), "unchanged data skipped");
+
+	/* everything changed */
+	for (i = 0; i < sizeof(config); i++) {
+		config[i] = (uint8_t)~config[i];
+	}
+	check(eeprom_update_block(UPDATE_ADDRESS, config, sizeof(config), &stats)
+			&& (UPDATE_PAGES == stats.pages_rewritten) && (sizeof(config) == stats.bytes_written)
+			&& (memcmp(&mem[UPDATE_ADDRESS], config, sizeof(config)) == 0), "changed data rewritten");
+}
+
+
+
+
+/* Key/value log: wear spread of a hot key and values kept over a remount */
+static void run_kv(void)
+{
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t value[EEPROM_KV_VALUE_MAX];
+	uint8_t length;
+	eeprom_kv_stats_t stats;
+	uint32_t counter;
+	uint32_t wear;
+	uint32_t wear_min = UINT32_MAX;
+	uint32_t wear_max = 0;
+	uint64_t start_ns;
+	uint16_t page;
+	bool ok = true;
+	uint8_t key;
+
+	printf("key/value log, %u pages:\n", (unsigned)EEPROM_KV_PAGES);
+
+	memset(&mem[EEPROM_KV_START], 0xA5, EEPROM_KV_PAGES * PAGE_SIZE);
+	check(!eeprom_kv_mount(), "unformatted region not mounted");
+	check(eeprom_kv_format(), "format");
+
+	/* cold values */
+	for (key = 1; key < 40; key++) {
+		memset(value, key, key % EEPROM_KV_VALUE_MAX + 1);
+		ok = ok && eeprom_kv_set(key, value, key % EEPROM_KV_VALUE_MAX + 1);
+	}
+	check(ok, "cold values set");
+
+	/* hot counter: at a fixed address each update wears the same page */
+	for (counter = 0; ok && (counter < KV_UPDATES); counter++) {
+		ok = eeprom_kv_set(0, (uint8_t *)&counter, sizeof(counter));
+	}
+	counter--;
+	ok = ok && eeprom_kv_set(0, (uint8_t *)&counter, sizeof(counter));
+	check(ok, "hot counter updates");
+
+	for (page = EEPROM_KV_START / PAGE_SIZE; page < (EEPROM_KV_START / PAGE_SIZE + EEPROM_KV_PAGES); page++) {
+		wear = i2c_sim_page_wear(I2C1, SIM_EEPROM_ADDRESS, page);
+		wear_min = (wear < wear_min) ? wear : wear_min;
+		wear_max = (wear > wear_max) ? wear : wear_max;
+	}
+	eeprom_kv_get_stats(&stats);
+	check(1 == stats.unchanged, "unchanged value not written");
+	check(stats.gc_pages > EEPROM_KV_PAGES, "log wrapped");
+	check((wear_max * 10) < KV_UPDATES, "wear spread over the region");
+	printf("  %u updates: fixed address page %u writes, log pages %u..%u writes\n",
+			(unsigned)KV_UPDATES, (unsigned)KV_UPDATES, (unsigned)wear_min, (unsigned)wear_max);
+	printf("  %u records, %u pages opened, %u collected, %u records moved\n",
+			(unsigned)stats.records, (unsigned)stats.page_opens,
+			(unsigned)stats.gc_pages, (unsigned)stats.gc_moves);
+
+	/* remount: all the values back */
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_kv_mount(), "remount");
+	eeprom_kv_get_stats(&stats);
+	printf("  mount: %u reads, %.1f ms\n", (unsigned)stats.mount_reads,
+			(double)(i2c_sim_time_ns() - start_ns) / 1e6);
+	ok = eeprom_kv_get(0, value, &length)
+			&& (sizeof(counter) == length)
+			&& (memcmp(value, &counter, sizeof(counter)) == 0);
+	for (key = 1; key < 40; key++) {
+		ok = ok && eeprom_kv_get(key, value, &length)
+				&& (length == (key % EEPROM_KV_VALUE_MAX + 1))
+				&& (value[0] == key) && (value[length - 1] == key);
+	}
+	check(ok && !eeprom_kv_get(40, value, &length), "values after remount");
+
+	/* the store keeps going after the mount */
+	counter++;
+	check(eeprom_kv_set(0, (uint8_t *)&counter, sizeof(counter))
+			&& eeprom_kv_mount()
+			&& eeprom_kv_get(0, value, &length)
+			&& (memcmp(value, &counter, sizeof(counter)) == 0), "update after remount");
+}
+
+
+
+
+/* Transactions: a power cut after each write cycle of a commit, lost or
+ * torn, leaves either the old or the new data after the recovery */
+static void run_txn(void)
+{
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t bus;
+	uint32_t commit_cycles;
+	uint32_t plain_cycles;
+	uint32_t cut;
+	uint32_t old_count = 0;
+	uint32_t new_count = 0;
+	uint32_t recover_frames = 0;
+	uint64_t recover_ns = 0;
+	uint64_t start_ns;
+	uint8_t record[TXN_RECORD_SIZE];
+	uint8_t torn;
+	uint8_t version;
+	bool ok = true;
+
+	printf("transactions:\n");
+
+	/* write cycles of one commit, against the same data written directly */
+	check(txn_save(1), "first commit");
+	i2c_sim_reset_stats();
+	check(txn_save(2), "commit");
+	i2c_sim_get_stats(I2C1, &bus);
+	commit_cycles = bus.write_cycles;
+	check(2 == txn_version(), "committed data");
+	i2c_sim_reset_stats();
+	memset(record, 3, sizeof(record));
+	check(eeprom_write_block(TXN_RECORD_ADDRESS, record, sizeof(record))
+			&& eeprom_wait_ready()
+			&& eeprom_write_block(TXN_COUNTER_ADDRESS, record, 4)
+			&& eeprom_wait_ready(), "direct write");
+	i2c_sim_get_stats(I2C1, &bus);
+	plain_cycles = bus.write_cycles;
+
+	i2c_sim_reset_stats();
+	memset(record, 4, sizeof(record));
+	check(eeprom_wait_ready() && eeprom_txn_begin()
+			&& eeprom_txn_write(0x3200, record, 32)
+			&& eeprom_txn_commit(), "one page commit");
+	i2c_sim_get_stats(I2C1, &bus);
+	check(2 == bus.write_cycles, "one extra page write");
+	memset(record, 5, sizeof(record));
+	check(eeprom_txn_begin()
+			&& eeprom_txn_write(TXN_HIGH_ADDRESS, record, 32)
+			&& eeprom_txn_commit()
+			&& (memcmp(&mem[TXN_HIGH_ADDRESS], record, 32) == 0), "commit to the upper half");
+
+	/* the entry headers of a long write would wrap a 16-bit count back
+	 * into the journal size */
+	check(eeprom_txn_begin()
+			&& !eeprom_txn_write(0x0000, mem, 65270)
+			&& eeprom_txn_write(0x3200, record, 32), "write beyond the journal refused");
+	eeprom_txn_abort();
+	printf("  %u + 4 byte commit: %u write cycles, written directly %u\n",
+			(unsigned)TXN_RECORD_SIZE, (unsigned)commit_cycles, (unsigned)plain_cycles);
+
+	/* power cut after each write cycle of the commit, the interrupted
+	 * write lost or torn */
+	for (cut = 0; cut <= commit_cycles; cut++) {
+		for (torn = 0; torn < 2; torn++) {
+			ok = ok && txn_save(1);
+			i2c_sim_power_cut(I2C1, SIM_EEPROM_ADDRESS, cut, (1 == torn));
+			ok = ok && (txn_save(2) == (cut == commit_cycles));
+			ok = ok && ((cut == commit_cycles) || !i2c_sim_powered(I2C1, SIM_EEPROM_ADDRESS));
+
+			/* reboot */
+			i2c_sim_power_restore(I2C1, SIM_EEPROM_ADDRESS);
+			eeprom_init();
+			i2c_sim_reset_stats();
+			start_ns = i2c_sim_time_ns();
+			eeprom_txn_init();
+			i2c_sim_get_stats(I2C1, &bus);
+			if ((i2c_sim_time_ns() - start_ns) > recover_ns) {
+				recover_ns = i2c_sim_time_ns() - start_ns;
+				recover_frames = bus.address_frames;
+			}
+
+			version = txn_version();
+			ok = ok && ((1 == version) || (2 == version));
+			old_count += (1 == version) ? 1 : 0;
+			new_count += (2 == version) ? 1 : 0;
+		}
+	}
+	check(ok, "old or new data after every power cut");
+	check((2 * TXN_JOURNAL_USED) == old_count, "rolled back up to the first journal page");
+	printf("  %u power cuts: %u rolled back, %u rolled forward\n",
+			(unsigned)(old_count + new_count), (unsigned)old_count, (unsigned)new_count);
+	printf("  worst recovery: %u address frames, %.1f ms\n",
+			(unsigned)recover_frames, (double)recover_ns / 1e6);
+}
+
+
+/* Save the record and the counter of a version in one transaction */
+static bool txn_save(uint8_t version)
+{
+	uint8_t record[TXN_RECORD_SIZE];
+	uint32_t counter = version;
+
+	memset(record, version, sizeof(record));
+
+	return eeprom_wait_ready()
+			&& eeprom_txn_begin()
+			&& eeprom_txn_write(TXN_RECORD_ADDRESS, record, sizeof(record))
+			&& eeprom_txn_write(TXN_COUNTER_ADDRESS, (uint8_t *)&counter, sizeof(counter))
+			&& eeprom_txn_commit();
+}
+
+
+/* Version of the record and counter on the device, 0 if mixed */
+static uint8_t txn_version(void)
+{
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t version = mem[TXN_COUNTER_ADDRESS];
+	uint16_t i;
+
+	for (i = 0; i < TXN_RECORD_SIZE; i++) {
+		if (mem[TXN_RECORD_ADDRESS + i] != version) {
+			version = 0;
+		}
+	}
+	for (i = 1; i < 4; i++) {
+		if (mem[TXN_COUNTER_ADDRESS + i] != 0) {
+			version = 0;
+		}
+	}
+
+	return version;
+}
+
+
+
+/* CRC framed records: the CRC computed while the bytes arrive */
+static void run_record(void)
+{
+	static uint8_t long_record[0xFFFF];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t record[200];
+	uint8_t buffer[sizeof(record)];
+	uint8_t check_string[] = "123456789";
+	i2c_sim_stats_t bus;
+	uint32_t crc;
+	uint16_t length;
+	uint16_t i;
+	bool ok = true;
+
+	printf("CRC records:\n");
+
+	check(0x0376E6E7u == eeprom_crc_block(check_string, 9), "CRC-32/MPEG-2 check value");
+
+	for (i = 0; i < sizeof(record); i++) {
+		record[i] = (uint8_t)(i * 7 + 1);
+	}
+	i2c_sim_reset_stats();
+	check(eeprom_write_record(0x4010, record, sizeof(record)), "write record");
+	i2c_sim_get_stats(I2C1, &bus);
+	crc = eeprom_crc_block(record, sizeof(record));
+	check((memcmp(&mem[0x4010], record, sizeof(record)) == 0)
+			&& (mem[0x4010 + sizeof(record)] == (uint8_t)(crc >> 24))
+			&& (mem[0x4010 + sizeof(record) + 3] == (uint8_t)crc), "data and CRC on the device");
+	check((((0x4010 & PAGE_MASK) + sizeof(record) + EEPROM_RECORD_CRC_SIZE + PAGE_MASK) / PAGE_SIZE)
+			== bus.write_cycles, "CRC in the last data page");
+
+	memset(buffer, 0, sizeof(buffer));
+	check(eeprom_read_record(0x4010, buffer, sizeof(buffer))
+			&& (memcmp(buffer, record, sizeof(record)) == 0), "read record");
+
+	/* the CRC of the device data without copying it, odd lengths for the
+	 * bytes short of a CRC unit word */
+	for (length = 1; length <= sizeof(record); length += 13) {
+		ok = ok && eeprom_checksum_range(0x4010, length, &crc)
+				&& (crc == eeprom_crc_block(record, length));
+	}
+	check(ok, "checksum range");
+
+	mem[0x4010 + 100] ^= 0x10;
+	check(!eeprom_read_record(0x4010, buffer, sizeof(buffer))
+			&& (EEPROM_ST_CRC == eeprom_get_status()), "corrupted record detected");
+	mem[0x4010 + sizeof(record) + 2] ^= 0x01;
+	mem[0x4010 + 100] ^= 0x10;
+	check(!eeprom_read_record(0x4010, buffer, sizeof(buffer))
+			&& (EEPROM_ST_CRC == eeprom_get_status()), "corrupted CRC detected");
+	mem[0x4010 + sizeof(record) + 2] ^= 0x01;
+
+	/* CRC past the end of the array, length wrapping with the CRC */
+	i2c_sim_reset_stats();
+	check(!eeprom_read_record((eeprom_addr_t)(EEPROM_SIZE - 8), buffer, 8)
+			&& !eeprom_read_record(0x0000, buffer, 0xFFFE), "record beyond the array refused");
+	check(!eeprom_write_record((eeprom_addr_t)(EEPROM_SIZE - 8), long_record, 8)
+			&& !eeprom_write_record(0x0000, long_record, 0xFFFC), "record write beyond a read refused");
+	i2c_sim_get_stats(I2C1, &bus);
+	check(0 == bus.starts, "no transfer started");
+
+	/* DMA mode: records moved by the CPU, plain reads still by DMA */
+	eeprom_init_mode(EEPROM_MODE_DMA);
+	memset(buffer, 0, sizeof(buffer));
+	check(eeprom_read_record(0x4010, buffer, sizeof(buffer))
+			&& (memcmp(buffer, record, sizeof(record)) == 0), "read record in DMA mode");
+	i2c_sim_reset_stats();
+	check(eeprom_read_block(0x4010, buffer, sizeof(buffer)), "read block in DMA mode");
+	i2c_sim_get_stats(I2C1, &bus);
+	check(bus.interrupts < 10, "read block moved by DMA");
+	eeprom_init();
+}
+
+
+
+/* Device arrays of 1, 2, 4 and 8 devices striped by page: write and read
+ * throughput, then a wider stripe */
+static void run_array(void)
+{
+	static uint8_t data[ARRAY_BENCH_SIZE];
+	static uint8_t buffer[ARRAY_BENCH_SIZE];
+	static uint8_t device_image[EEPROM_SIZE];
+	uint8_t devices;
+	uint8_t device;
+	uint64_t start_ns;
+	uint64_t write_ns;
+	uint64_t read_ns;
+	uint64_t single_ns = 0;
+	uint32_t i;
+	bool ok;
+
+	printf("device array, %u KB striped by page:\n", (unsigned)(ARRAY_BENCH_SIZE / 1024));
+
+	for (device = 1; device < EEPROM_DEVICES; device++) {
+		i2c_sim_attach(I2C1, (uint8_t)SIM_DEVICE_ADDRESS(device));
+	}
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (uint8_t)((i >> 6) ^ (i * 13));
+	}
+
+	printf("  devices write ms  write KB/s  read ms  speed-up\n");
+	for (devices = 1; devices <= EEPROM_DEVICES; devices <<= 1) {
+		ok = eeprom_array_init(devices, 1);
+		start_ns = i2c_sim_time_ns();
+		ok = ok && eeprom_array_write(0x0100, data, sizeof(data));
+		write_ns = i2c_sim_time_ns() - start_ns;
+		memset(buffer, 0, sizeof(buffer));
+		start_ns = i2c_sim_time_ns();
+		ok = ok && eeprom_array_read(0x0100, buffer, sizeof(buffer));
+		read_ns = i2c_sim_time_ns() - start_ns;
+		ok = ok && (memcmp(buffer, data, sizeof(data)) == 0);
+		if (1 == devices) {
+			single_ns = write_ns;
+		}
+		printf("  %7u %8.1f %11.1f %8.1f %8.2fx\n", (unsigned)devices,
+				(double)write_ns / 1e6, (double)sizeof(data) / 1.024 / ((double)write_ns / 1e6),
+				(double)read_ns / 1e6, (double)single_ns / (double)write_ns);
+		check(ok, "data written and read back");
+		if (2 == devices) {
+			check((single_ns * 10) > (write_ns * 18), "two devices write about twice as fast");
+		}
+		if (4 == devices) {
+			check(((single_ns * 10) > (write_ns * 34)) || ((write_ns * 10) < (read_ns * 11)),
+					"four devices write over 3.4 times as fast or at bus speed");
+		}
+	}
+
+	/* stripe of four pages over two devices: logical page 4 is page 0 of
+	 * the second device */
+	check(eeprom_array_init(2, 4) && eeprom_array_write(0, data, sizeof(data))
+			&& (memcmp(i2c_sim_memory(I2C1, SIM_DEVICE_ADDRESS(1)), &data[4 * PAGE_SIZE], 4 * PAGE_SIZE) == 0)
+			&& (memcmp(i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS), &data[8 * PAGE_SIZE], 64) != 0)
+			&& (memcmp(&i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS)[4 * PAGE_SIZE], &data[8 * PAGE_SIZE], 4 * PAGE_SIZE) == 0),
+			"four page stripe layout");
+	memset(buffer, 0, sizeof(buffer));
+	check(eeprom_array_read(0, buffer, sizeof(buffer))
+			&& (memcmp(buffer, data, sizeof(data)) == 0), "four page stripe read back");
+	check(!eeprom_array_init(3, 3) && !eeprom_array_init(9, 1)
+			&& eeprom_array_init(1, 1), "configuration checked");
+
+	/* stripe of the whole device: 64 KiB or more read by one call */
+	for (i = 0; i < EEPROM_SIZE; i++) {
+		i2c_sim_memory(I2C1, SIM_DEVICE_ADDRESS(1))[i] = (uint8_t)(i ^ (i >> 8) ^ (i >> 16));
+	}
+	memset(device_image, 0, sizeof(device_image));
+	check(eeprom_array_init(2, EEPROM_PAGES)
+			&& eeprom_array_read(EEPROM_SIZE, device_image, EEPROM_SIZE)
+			&& (memcmp(device_image, i2c_sim_memory(I2C1, SIM_DEVICE_ADDRESS(1)), EEPROM_SIZE) == 0),
+			"whole device stripe read back");
+}
+
+
+
+/* Bus contexts: block writes on three buses at the same time */
+static void run_bus(void)
+{
+	static uint8_t data[3][BUS_BLOCK_SIZE];
+	static uint8_t buffer[2][BUS_BLOCK_SIZE];
+	eeprom_bus_cfg_t cfg2 = {
+		I2C2, GPIOB, GPIO10, GPIOB, GPIO11,
+		EEPROM_SPEED_400K, EEPROM_MODE_IRQ, 0
+	};
+	eeprom_bus_cfg_t cfg3 = {
+		I2C3, GPIOA, GPIO8, GPIOC, GPIO9,
+		EEPROM_SPEED_400K, EEPROM_MODE_DMA, 1
+	};
+	eeprom_bus_cfg_t bad_cfg = cfg2;
+	eeprom_ctx_t *ctx1 = eeprom_default_ctx();
+	eeprom_ctx_t *ctx2;
+	eeprom_ctx_t *ctx3;
+	uint64_t start_ns;
+	uint64_t single_ns;
+	uint64_t concurrent_ns;
+	uint32_t i;
+
+	printf("bus contexts:\n");
+
+	i2c_sim_attach(I2C2, SIM_EEPROM_ADDRESS);
+	i2c_sim_attach(I2C3, SIM_DEVICE_ADDRESS(1));
+	ctx2 = eeprom_ctx_init(&cfg2);
+	ctx3 = eeprom_ctx_init(&cfg3);
+	check((ctx2 != NULL) && (ctx3 != NULL) && (ctx2 != ctx1) && (ctx3 != ctx2), "I2C2 and I2C3 contexts");
+	bad_cfg.device = EEPROM_DEVICES;
+	check(NULL == eeprom_ctx_init(&bad_cfg), "device beyond the address pins refused");
+	bad_cfg = cfg2;
+	bad_cfg.i2c = 0;
+	check(NULL == eeprom_ctx_init(&bad_cfg), "unknown peripheral refused");
+
+	for (i = 0; i < BUS_BLOCK_SIZE; i++) {
+		data[0][i] = (uint8_t)(i * 7u);
+		data[1][i] = (uint8_t)~(i * 11u);
+		data[2][i] = (uint8_t)((i >> 3) ^ 0x5A);
+	}
+
+	rtos_start_operation(RTOS_CFG_KE_NORMAL_STATE);
+
+	/* one bus */
+	cb_calls = 0;
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_ctx_write_block_async(ctx1, BUS_BLOCK_ADDRESS, data[0], BUS_BLOCK_SIZE, transfer_done),
+			"I2C1 block write started");
+	while (eeprom_ctx_write_block_busy(ctx1)) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	single_ns = i2c_sim_time_ns() - start_ns;
+	check((1 == cb_calls) && (EEPROM_ST_DONE == cb_status), "I2C1 block written");
+
+	/* three buses: each one runs its own transfers and write cycles */
+	for (i = 0; i < BUS_BLOCK_SIZE; i++) {
+		data[0][i] = (uint8_t)~data[0][i];
+	}
+	cb_calls = 0;
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_ctx_write_block_async(ctx1, BUS_BLOCK_ADDRESS, data[0], BUS_BLOCK_SIZE, transfer_done)
+			&& eeprom_ctx_write_block_async(ctx2, BUS_BLOCK_ADDRESS, data[1], BUS_BLOCK_SIZE, transfer_done)
+			&& eeprom_ctx_write_block_async(ctx3, BUS_BLOCK_ADDRESS, data[2], BUS_BLOCK_SIZE, transfer_done),
+			"block writes started on three buses");
+	while (eeprom_ctx_write_block_busy(ctx1)
+	|| eeprom_ctx_write_block_busy(ctx2)
+	|| eeprom_ctx_write_block_busy(ctx3)) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	concurrent_ns = i2c_sim_time_ns() - start_ns;
+	rtos_stop_operation();
+
+	check((3 == cb_calls) && (EEPROM_ST_DONE == cb_status), "three block writes completed");
+	check((memcmp(&i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS)[BUS_BLOCK_ADDRESS], data[0], BUS_BLOCK_SIZE) == 0)
+			&& (memcmp(&i2c_sim_memory(I2C2, SIM_EEPROM_ADDRESS)[BUS_BLOCK_ADDRESS], data[1], BUS_BLOCK_SIZE) == 0)
+			&& (memcmp(&i2c_sim_memory(I2C3, SIM_DEVICE_ADDRESS(1))[BUS_BLOCK_ADDRESS], data[2], BUS_BLOCK_SIZE) == 0),
+			"device contents");
+	check((concurrent_ns * 10) < (single_ns * 12), "three buses in the time of one");
+	printf("  2 KB block: one bus %.1f ms, three buses %.1f ms\n",
+			(double)single_ns / 1e6, (double)concurrent_ns / 1e6);
+
+	/* reads on two buses at the same time */
+	memset(buffer, 0, sizeof(buffer));
+	cb_calls = 0;
+	check(eeprom_ctx_read_block_async(ctx1, BUS_BLOCK_ADDRESS, buffer[0], BUS_BLOCK_SIZE, transfer_done)
+			&& eeprom_ctx_read_block_async(ctx2, BUS_BLOCK_ADDRESS, buffer[1], BUS_BLOCK_SIZE, transfer_done),
+			"reads started on two buses");
+	while (cb_calls < 2) {
+		i2c_sim_idle();
+	}
+	check((memcmp(buffer[0], data[0], BUS_BLOCK_SIZE) == 0)
+			&& (memcmp(buffer[1], data[1], BUS_BLOCK_SIZE) == 0), "data read back");
+
+	/* blocking functions of a context in DMA mode and another device */
+	memset(buffer, 0, sizeof(buffer));
+	check(eeprom_ctx_write_record(ctx3, 0x0040, data[2], 100)
+			&& eeprom_ctx_read_record(ctx3, 0x0040, buffer[0], 100)
+			&& (memcmp(buffer[0], data[2], 100) == 0), "record on the I2C3 context");
+	check(EEPROM_ST_DONE == eeprom_get_status(), "default context left alone");
+}
+
+
+
+/* Current address reads: a stream read in consecutive chunks against two
+ * streams read alternately, where every read needs its memory address */
+static void run_cursor(void)
+{
+	static uint8_t back[CURSOR_STREAM_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t consecutive, alternate, stats;
+	uint64_t start_ns;
+	uint64_t consecutive_ns;
+	uint64_t alternate_ns;
+	uint8_t byte;
+	uint32_t i;
+	bool ok = true;
+
+	printf("current address reads, %u byte chunks:\n", (unsigned)CURSOR_CHUNK_SIZE);
+
+	for (i = 0; i < 2 * CURSOR_STREAM_SIZE; i++) {
+		mem[CURSOR_STREAM_ADDRESS + i] = (uint8_t)((i * 29u) ^ (i >> 5));
+	}
+
+	/* random read of the first chunk, current address reads of the others */
+	memset(back, 0, sizeof(back));
+	eeprom_wait_ready();
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	for (i = 0; i < CURSOR_STREAM_SIZE; i += CURSOR_CHUNK_SIZE) {
+		ok = ok && eeprom_read_page(CURSOR_STREAM_ADDRESS + i, &back[i], CURSOR_CHUNK_SIZE);
+	}
+	consecutive_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &consecutive);
+	check(ok && (memcmp(back, &mem[CURSOR_STREAM_ADDRESS], CURSOR_STREAM_SIZE) == 0), "consecutive chunks read");
+	check((consecutive.starts == (CURSOR_STREAM_SIZE / CURSOR_CHUNK_SIZE) + 1)
+			&& (consecutive.data_bytes == CURSOR_STREAM_SIZE + EEPROM_ADDRESS_BYTES),
+			"memory address sent for the first chunk only");
+
+	/* two streams: each read moves the counter away from the other one */
+	memset(back, 0, sizeof(back));
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	for (i = 0; i < CURSOR_STREAM_SIZE; i += 2 * CURSOR_CHUNK_SIZE) {
+		ok = ok && eeprom_read_page(CURSOR_STREAM_ADDRESS + i / 2, &back[i], CURSOR_CHUNK_SIZE)
+				&& eeprom_read_page(CURSOR_STREAM_ADDRESS + CURSOR_STREAM_SIZE + i / 2,
+									&back[i + CURSOR_CHUNK_SIZE], CURSOR_CHUNK_SIZE);
+	}
+	alternate_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &alternate);
+	check(ok && (alternate.starts == 2 * (CURSOR_STREAM_SIZE / CURSOR_CHUNK_SIZE)), "alternate chunks read");
+
+	printf("  %-12s %8s %8s %10s %8s\n", "", "STARTs", "frames", "SCL", "ms");
+	printf("  %-12s %8u %8u %10u %8.1f\n", "consecutive", (unsigned)consecutive.starts,
+			(unsigned)(consecutive.address_frames + consecutive.data_bytes),
+			(unsigned)consecutive.bit_times, (double)consecutive_ns / 1e6);
+	printf("  %-12s %8u %8u %10u %8.1f\n", "alternate", (unsigned)alternate.starts,
+			(unsigned)(alternate.address_frames + alternate.data_bytes),
+			(unsigned)alternate.bit_times, (double)alternate_ns / 1e6);
+
+	/* a write moves the counter into the written page */
+	check(eeprom_read_byte(CURSOR_STREAM_ADDRESS, &byte)
+			&& eeprom_write_byte(CURSOR_STREAM_ADDRESS + 0x100, 0x3C) && eeprom_wait_ready(), "read then write");
+	i2c_sim_reset_stats();
+	check(eeprom_read_byte(CURSOR_STREAM_ADDRESS + 1, &byte) && (mem[CURSOR_STREAM_ADDRESS + 1] == byte), "read after the write");
+	i2c_sim_get_stats(I2C1, &stats);
+	check(2 == stats.starts, "memory address sent after a write");
+
+	/* a power cycle resets the counter: the NACKed read drops the cursor */
+	check(eeprom_read_byte(CURSOR_STREAM_ADDRESS + 8, &byte), "read before the power cut");
+	i2c_sim_power_cut(I2C1, SIM_EEPROM_ADDRESS, 0, false);
+	check(eeprom_write_byte(0x0FF0, 0x00) && eeprom_wait_ready() == false, "device lost");
+	check(!eeprom_read_byte(CURSOR_STREAM_ADDRESS + 9, &byte), "read refused while off");
+	i2c_sim_power_restore(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_reset_stats();
+	check(eeprom_read_byte(CURSOR_STREAM_ADDRESS + 9, &byte) && (mem[CURSOR_STREAM_ADDRESS + 9] == byte), "read after the power cycle");
+	i2c_sim_get_stats(I2C1, &stats);
+	check(2 == stats.starts, "memory address sent after a failure");
+}
+
+
+/* Scatter/gather: structures spread over three pages saved and loaded by
+ * one call, against one block write or read per structure */
+static void run_vector(void)
+{
+	static uint8_t header[12], counters[4], limits[20], table[60], flags[8], mode[2];
+	static uint8_t back[VECTOR_SEGMENTS][60];
+	static uint8_t image[3 * PAGE_SIZE];
+	/* not sorted: header and counters follow each other, limits is 4 bytes
+	 * after them, table crosses a page boundary */
+	eeprom_iovec_t iov[VECTOR_SEGMENTS] = {
+		{VECTOR_PAGE_ADDRESS + 0x38, table, sizeof(table)},
+		{VECTOR_PAGE_ADDRESS + 0x04, header, sizeof(header)},
+		{VECTOR_PAGE_ADDRESS + 0x80, flags, sizeof(flags)},
+		{VECTOR_PAGE_ADDRESS + 0x14, limits, sizeof(limits)},
+		{VECTOR_PAGE_ADDRESS + 0x10, counters, sizeof(counters)},
+		{VECTOR_PAGE_ADDRESS + 0xA0, mode, sizeof(mode)}
+	};
+	eeprom_iovec_t read_iov[VECTOR_SEGMENTS];
+	eeprom_iovec_t overlap[2];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t separate, vector, stats;
+	uint64_t start_ns;
+	uint64_t separate_ns;
+	uint64_t vector_ns;
+	uint32_t segment_pages = 0;
+	uint32_t touched_pages = 0;
+	uint32_t page;
+	uint32_t i;
+	bool ok = true;
+
+	printf("scatter/gather, %u structures:\n", (unsigned)VECTOR_SEGMENTS);
+
+	/* write cycles expected: each structure written alone, then each page
+	 * holding one of them */
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		segment_pages += ((iov[i].address & PAGE_MASK) + iov[i].data_length + PAGE_MASK) / PAGE_SIZE;
+	}
+	for (page = VECTOR_PAGE_ADDRESS; page < (VECTOR_PAGE_ADDRESS + sizeof(image)); page += PAGE_SIZE) {
+		for (i = 0; i < VECTOR_SEGMENTS; i++) {
+			if ((iov[i].address < (page + PAGE_SIZE)) && ((iov[i].address + iov[i].data_length) > page)) {
+				touched_pages++;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < sizeof(image); i++) {
+		mem[VECTOR_PAGE_ADDRESS + i] = (uint8_t)(0xA5 ^ i);
+	}
+
+	/* one block write per structure */
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		memset(iov[i].data_ptr, (int)(0x10 + i), iov[i].data_length);
+	}
+	eeprom_wait_ready();
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		ok = ok && eeprom_write_block(iov[i].address, iov[i].data_ptr, iov[i].data_length);
+	}
+	separate_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &separate);
+
+	/* the same structures with new content by one call */
+	for (i = 0; i < sizeof(image); i++) {
+		image[i] = mem[VECTOR_PAGE_ADDRESS + i];
+	}
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		memset(iov[i].data_ptr, (int)(0x60 + i), iov[i].data_length);
+		memcpy(&image[iov[i].address - VECTOR_PAGE_ADDRESS], iov[i].data_ptr, iov[i].data_length);
+	}
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	ok = ok && eeprom_writev(iov, VECTOR_SEGMENTS);
+	vector_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &vector);
+	check(ok && (memcmp(image, &mem[VECTOR_PAGE_ADDRESS], sizeof(image)) == 0),
+			"structures written, gaps unchanged");
+	check((touched_pages == vector.write_cycles) && (segment_pages == separate.write_cycles), "one write cycle per page touched");
+
+	printf("  %-12s %8s %8s %8s\n", "", "cycles", "STARTs", "ms");
+	printf("  %-12s %8u %8u %8.1f\n", "separate", (unsigned)separate.write_cycles,
+			(unsigned)separate.starts, (double)separate_ns / 1e6);
+	printf("  %-12s %8u %8u %8.1f\n", "writev", (unsigned)vector.write_cycles,
+			(unsigned)vector.starts, (double)vector_ns / 1e6);
+
+	/* read back: header, counters and limits by one sequential read */
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		read_iov[i] = iov[i];
+		read_iov[i].data_ptr = back[i];
+	}
+	memset(back, 0, sizeof(back));
+	i2c_sim_reset_stats();
+	ok = eeprom_readv(read_iov, VECTOR_SEGMENTS);
+	i2c_sim_get_stats(I2C1, &stats);
+	for (i = 0; i < VECTOR_SEGMENTS; i++) {
+		ok = ok && (memcmp(back[i], iov[i].data_ptr, iov[i].data_length) == 0);
+	}
+	check(ok, "structures read");
+	check(stats.starts < 2 * VECTOR_SEGMENTS, "near structures read together");
+	printf("  readv: %u STARTs, %u bytes, %u separate reads: %u STARTs\n", (unsigned)stats.starts,
+			(unsigned)stats.data_bytes, (unsigned)VECTOR_SEGMENTS, (unsigned)(2 * VECTOR_SEGMENTS));
+
+	/* refused requests */
+	overlap[0] = iov[1];
+	overlap[1] = iov[1];
+	overlap[1].address += 2;
+	check(!eeprom_writev(overlap, 2), "overlapping segments refused");
+	overlap[0].address = EEPROM_SIZE - 4;
+	check(!eeprom_readv(overlap, 1), "segment beyond the array refused");
+}
+
+
+/* Scheduler completion callbacks: calibration read and log write */
+static void cal_done(uint8_t status)
+{
+	if (EEPROM_ST_DONE == status) {
+		sched_cal_ns = i2c_sim_time_ns();
+	}
+}
+
+
+static void log_done(uint8_t status)
+{
+	if (EEPROM_ST_DONE == status) {
+		sched_log_ns = i2c_sim_time_ns();
+	}
+}
+
+
+/* Read the calibration data in a class while the background write of the
+ * log is running. Return the time taken by the read, in us. */
+static uint32_t sched_cal_latency(uint8_t cls)
+{
+	static uint8_t log_data[SCHED_LOG_SIZE];
+	static uint8_t cal[SCHED_CAL_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	eeprom_sched_stats_t stats;
+	uint64_t start_ns;
+	uint64_t submit_ns;
+	uint32_t i;
+	bool ok;
+
+	for (i = 0; i < SCHED_LOG_SIZE; i++) {
+		log_data[i] = (uint8_t)((i * 7u) + cls);
+	}
+	memset(cal, 0, sizeof(cal));
+	sched_cal_ns = 0;
+	sched_log_ns = 0;
+	eeprom_sched_init();
+
+	rtos_start_operation(RTOS_CFG_KE_NORMAL_STATE);
+	start_ns = i2c_sim_time_ns();
+	ok = eeprom_sched_write(EEPROM_SCHED_BACKGROUND, SCHED_LOG_ADDRESS, log_data, SCHED_LOG_SIZE, &log_done);
+	/* a few pages written, then the boot code needs its calibration */
+	while ((i2c_sim_time_ns() - start_ns) < 45000000u) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	submit_ns = i2c_sim_time_ns();
+	ok = ok && eeprom_sched_read(cls, SCHED_CAL_ADDRESS, cal, SCHED_CAL_SIZE, &cal_done);
+	while (eeprom_sched_depth() > 0) {
+		rtos_execute_task();
+		i2c_sim_idle();
+	}
+	rtos_stop_operation();
+
+	eeprom_sched_get_stats(&stats);
+	ok = ok && eeprom_wait_ready() && (sched_cal_ns != 0) && (sched_log_ns != 0)
+			&& (memcmp(&mem[SCHED_LOG_ADDRESS], log_data, SCHED_LOG_SIZE) == 0)
+			&& (memcmp(&mem[SCHED_CAL_ADDRESS], cal, SCHED_CAL_SIZE) == 0)
+			&& (2 == stats.depth_max) && (0 == stats.depth)
+			&& (2 == (stats.cls[EEPROM_SCHED_URGENT].completed + stats.cls[EEPROM_SCHED_BACKGROUND].completed));
+	check(ok, (EEPROM_SCHED_URGENT == cls) ? "urgent read during the log write"
+										   : "background read during the log write");
+	printf("  %-10s read %6u us, log write %6u us\n", (EEPROM_SCHED_URGENT == cls) ? "urgent" : "background",
+			(unsigned)((sched_cal_ns - submit_ns) / 1000u), (unsigned)((sched_log_ns - start_ns) / 1000u));
+
+	return (uint32_t)((sched_cal_ns - submit_ns) / 1000u);
+}
+
+
+/* Request scheduler: an urgent read overtakes a long background write,
+ * the requests of a class are served by address */
+static void run_sched(void)
+{
+	static uint8_t back[SCHED_CHUNKS * 32];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	eeprom_sched_stats_t stats;
+	i2c_sim_stats_t bus;
+	uint32_t urgent_us;
+	uint32_t background_us;
+	uint32_t i;
+	bool ok = true;
+
+	printf("request scheduler:\n");
+
+	urgent_us = sched_cal_latency(EEPROM_SCHED_URGENT);
+	background_us = sched_cal_latency(EEPROM_SCHED_BACKGROUND);
+	check(urgent_us < (background_us / 4), "urgent read between two pages of the write");
+
+	/* chunks submitted from the last one: read by address, each one from
+	 * where the previous one stopped */
+	eeprom_sched_init();
+	memset(back, 0, sizeof(back));
+	for (i = SCHED_CHUNKS; i > 0; i--) {
+		ok = ok && eeprom_sched_read(EEPROM_SCHED_BACKGROUND, (eeprom_addr_t)(SCHED_CAL_ADDRESS + (i - 1) * 32),
+									 &back[(i - 1) * 32], 32, NULL);
+	}
+	i2c_sim_reset_stats();
+	ok = ok && eeprom_sched_sync();
+	i2c_sim_get_stats(I2C1, &bus);
+	eeprom_sched_get_stats(&stats);
+	check(ok && (memcmp(back, &mem[SCHED_CAL_ADDRESS], sizeof(back)) == 0) && (SCHED_CHUNKS == stats.depth_max),
+			"chunks read");
+	check((SCHED_CHUNKS + 1) == bus.starts, "chunks read in address order");
+	printf("  %u chunks submitted in reverse order: %u STARTs\n", (unsigned)SCHED_CHUNKS, (unsigned)bus.starts);
+
+	/* refused requests */
+	check(!eeprom_sched_read(EEPROM_SCHED_CLASSES, SCHED_CAL_ADDRESS, back, 1, NULL), "unknown class refused");
+	check(!eeprom_sched_write(EEPROM_SCHED_URGENT, EEPROM_SIZE - 1, back, 2, NULL), "request beyond the array refused");
+}
+
+
+/* Streams: samples of a few bytes written through one page of RAM, one
+ * write cycle per page, against one byte write per byte */
+static void run_stream(void)
+{
+	static eeprom_stream_t stream;
+	static uint8_t image[STREAM_SIZE];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t stats;
+	uint64_t start_ns;
+	uint64_t stream_ns;
+	uint64_t byte_ns;
+	uint8_t sample[STREAM_SAMPLE_SIZE + 2];
+	uint16_t got;
+	uint32_t i;
+	uint32_t j;
+	bool ok;
+
+	printf("streams, %u byte samples:\n", (unsigned)STREAM_SAMPLE_SIZE);
+
+	for (i = 0; i < STREAM_SIZE; i++) {
+		image[i] = (uint8_t)((i * 13u) ^ 0x5A);
+	}
+
+	/* logger: the samples fill the region, the last one is cut */
+	eeprom_wait_ready();
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	ok = eeprom_stream_open(&stream, EEPROM_STREAM_WRITE, STREAM_ADDRESS, STREAM_SIZE);
+	for (i = 0; ok && ((i + STREAM_SAMPLE_SIZE) <= STREAM_SIZE); i += STREAM_SAMPLE_SIZE) {
+		ok = eeprom_stream_write(&stream, &image[i], STREAM_SAMPLE_SIZE);
+	}
+	check(ok && !eeprom_stream_write(&stream, &image[i], STREAM_SAMPLE_SIZE)
+			&& (eeprom_stream_tell(&stream) == STREAM_ADDRESS + STREAM_SIZE), "region filled by the samples");
+	ok = eeprom_stream_close(&stream);
+	stream_ns = i2c_sim_time_ns() - start_ns;
+	i2c_sim_get_stats(I2C1, &stats);
+	check(ok && (memcmp(&mem[STREAM_ADDRESS], image, STREAM_SIZE) == 0), "samples written");
+	check((STREAM_SIZE / PAGE_SIZE) == stats.write_cycles, "one write cycle per page");
+
+	/* the same samples by byte writes, first bytes only */
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	ok = true;
+	for (i = 0; i < STREAM_BYTE_WRITES; i++) {
+		ok = ok && eeprom_write_byte(STREAM_ADDRESS + i, image[i] ^ 0xFF) && eeprom_wait_ready();
+	}
+	byte_ns = i2c_sim_time_ns() - start_ns;
+	check(ok, "byte writes");
+	printf("  stream: %u bytes, %u write cycles, %.1f ms\n", (unsigned)STREAM_SIZE,
+			(unsigned)(STREAM_SIZE / PAGE_SIZE), (double)stream_ns / 1e6);
+	printf("  bytes:  %u bytes, %u write cycles, %.1f ms\n", (unsigned)STREAM_BYTE_WRITES,
+			(unsigned)STREAM_BYTE_WRITES, (double)byte_ns / 1e6);
+
+	/* a flush in the middle of a page: the page is completed by a second
+	 * write, the region starts in the middle of a page */
+	ok = eeprom_stream_open(&stream, EEPROM_STREAM_WRITE, STREAM_ADDRESS + 10, 100)
+			&& eeprom_stream_write(&stream, &image[10], 20) && eeprom_stream_flush(&stream)
+			&& eeprom_stream_write(&stream, &image[30], 80) && eeprom_stream_close(&stream);
+	check(ok && (memcmp(&mem[STREAM_ADDRESS + 10], &image[10], 100) == 0)
+			&& (mem[STREAM_ADDRESS + 9] != image[9]), "flush in the middle of a page");
+	/* back to the logged samples */
+	for (i = 0; i < 10; i++) {
+		mem[STREAM_ADDRESS + i] = image[i];
+	}
+
+	/* parser: a few bytes at a time, one sequential read per page */
+	i2c_sim_reset_stats();
+	ok = eeprom_stream_open(&stream, EEPROM_STREAM_READ, STREAM_ADDRESS, STREAM_SIZE);
+	for (i = 0; ok && (i < STREAM_SIZE); i += got) {
+		ok = eeprom_stream_read(&stream, sample, sizeof(sample), &got)
+				&& (got > 0) && (memcmp(sample, &image[i], got) == 0);
+	}
+	ok = ok && (STREAM_SIZE == i) && eeprom_stream_read(&stream, sample, sizeof(sample), &got) && (0 == got);
+	check(ok && eeprom_stream_close(&stream), "samples parsed");
+	i2c_sim_get_stats(I2C1, &stats);
+	j = STREAM_SIZE / PAGE_SIZE;
+	check((j + 1) == stats.starts, "memory address sent for the first chunk only");
+	printf("  parsed in %u reads, %u STARTs\n", (unsigned)j, (unsigned)stats.starts);
+
+	/* last page of the array: the position reaches the end of the array,
+	 * no wrap to address 0 */
+	memcpy(sample, mem, sizeof(sample));
+	ok = eeprom_stream_open(&stream, EEPROM_STREAM_WRITE, (eeprom_addr_t)(EEPROM_SIZE - PAGE_SIZE), PAGE_SIZE)
+			&& eeprom_stream_write(&stream, image, PAGE_SIZE)
+			&& !eeprom_stream_write(&stream, image, 1)
+			&& (EEPROM_SIZE == eeprom_stream_tell(&stream))
+			&& eeprom_stream_close(&stream);
+	check(ok && (memcmp(&mem[EEPROM_SIZE - PAGE_SIZE], image, PAGE_SIZE) == 0)
+			&& (memcmp(sample, mem, sizeof(sample)) == 0), "write stream ends at the end of the array");
+	ok = eeprom_stream_open(&stream, EEPROM_STREAM_READ, (eeprom_addr_t)(EEPROM_SIZE - PAGE_SIZE), PAGE_SIZE);
+	for (i = 0; ok && (i < PAGE_SIZE); i += got) {
+		ok = eeprom_stream_read(&stream, sample, sizeof(sample), &got)
+				&& (got > 0) && (memcmp(sample, &image[i], got) == 0);
+	}
+	ok = ok && eeprom_stream_read(&stream, sample, sizeof(sample), &got) && (0 == got)
+			&& (EEPROM_SIZE == eeprom_stream_tell(&stream));
+	check(ok && eeprom_stream_close(&stream), "read stream ends at the end of the array");
+
+	check(!eeprom_stream_open(&stream, EEPROM_STREAM_READ, EEPROM_SIZE - 4, 8), "region beyond the array refused");
+	check(!eeprom_stream_write(&stream, image, 1), "closed stream refused");
+}
+
+
+/* Compare: a region verified with no read buffer, the read cut at the
+ * first difference */
+static void run_compare(void)
+{
+	static uint8_t image[COMPARE_SIZE];
+	static const uint16_t diff_offsets[] = {0, 1000, COMPARE_SIZE - 1};
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	i2c_sim_stats_t stats;
+	uint64_t start_ns;
+	uint16_t offset;
+	uint16_t length;
+	uint8_t byte;
+	uint32_t i;
+	bool ok;
+
+	printf("compare against the device, %u bytes:\n", (unsigned)COMPARE_SIZE);
+
+	for (i = 0; i < COMPARE_SIZE; i++) {
+		image[i] = (uint8_t)((i * 31u) ^ (i >> 7));
+		mem[COMPARE_ADDRESS + i] = image[i];
+	}
+	eeprom_wait_ready();
+
+	/* the same content: all the bytes are read */
+	i2c_sim_reset_stats();
+	start_ns = i2c_sim_time_ns();
+	check(eeprom_compare_block(COMPARE_ADDRESS, image, COMPARE_SIZE, &offset) && (COMPARE_SIZE == offset),
+			"same content");
+	i2c_sim_get_stats(I2C1, &stats);
+	printf("  %-12s %8u bytes %8.2f ms\n", "same", (unsigned)stats.data_bytes,
+			(double)(i2c_sim_time_ns() - start_ns) / 1e6);
+
+	/* one byte different: the read stops a few bytes after it */
+	for (i = 0; i < sizeof(diff_offsets) / sizeof(diff_offsets[0]); i++) {
+		mem[COMPARE_ADDRESS + diff_offsets[i]] ^= 0x40;
+		i2c_sim_reset_stats();
+		start_ns = i2c_sim_time_ns();
+		ok = eeprom_compare_block(COMPARE_ADDRESS, image, COMPARE_SIZE, &offset) && (diff_offsets[i] == offset);
+		i2c_sim_get_stats(I2C1, &stats);
+		ok = ok && (stats.data_bytes <= (uint32_t)(EEPROM_ADDRESS_BYTES + diff_offsets[i] + 4));
+		check(ok, "first difference found, read cut");
+		printf("  %-5s %4u   %8u bytes %8.2f ms\n", "diff", (unsigned)diff_offsets[i], (unsigned)stats.data_bytes,
+				(double)(i2c_sim_time_ns() - start_ns) / 1e6);
+
+		/* the device counter follows a cut read: the next byte comes by a
+		 * current address read */
+		length = (uint16_t)(((diff_offsets[i] + 4) < COMPARE_SIZE) ? (diff_offsets[i] + 4) : COMPARE_SIZE);
+		i2c_sim_reset_stats();
+		ok = eeprom_read_byte((eeprom_addr_t)(COMPARE_ADDRESS + length), &byte)
+				&& (byte == mem[COMPARE_ADDRESS + length]);
+		i2c_sim_get_stats(I2C1, &stats);
+		mem[COMPARE_ADDRESS + diff_offsets[i]] ^= 0x40;
+		check(ok && (1 == stats.starts), "current address read after the compare");
+	}
+
+	/* short ranges, by the one, two and three byte sequences */
+	ok = true;
+	for (length = 1; length <= 4; length++) {
+		ok = ok && eeprom_compare_block(COMPARE_ADDRESS, image, length, &offset) && (length == offset);
+		mem[COMPARE_ADDRESS + length - 1] ^= 0x01;
+		ok = ok && eeprom_compare_block(COMPARE_ADDRESS, image, length, &offset) && ((length - 1) == offset);
+		mem[COMPARE_ADDRESS + length - 1] ^= 0x01;
+	}
+	check(ok, "short ranges");
+}
+
+
+/* Factory items written as the image builder does, then verified as at
+ * first boot: an erased or a corrupted item fails */
+static void run_layout(void)
+{
+	static uint8_t data[256];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint8_t item;
+	uint16_t i;
+	bool ok = true;
+
+	printf("factory layout, %u items:\n", (unsigned)EEPROM_LAYOUT_ITEMS);
+
+	check(!eeprom_layout_verify_all(), "erased items refused");
+
+	for (item = 0; ok && (item < EEPROM_LAYOUT_ITEMS); item++) {
+		for (i = 0; i < eeprom_layout_items[item].size; i++) {
+			data[i] = (uint8_t)(item * 17u + i);
+		}
+		ok = eeprom_layout_write(item, data, eeprom_layout_items[item].size)
+				&& !eeprom_layout_write(item, data, (uint16_t)(eeprom_layout_items[item].size - 1));
+		printf("  item %u at 0x%04X, %3u bytes\n", (unsigned)item,
+				(unsigned)eeprom_layout_items[item].address, (unsigned)eeprom_layout_items[item].size);
+	}
+	eeprom_wait_ready();
+	check(ok && eeprom_layout_verify_all(), "items written and verified");
+
+	mem[eeprom_layout_items[EEPROM_LAYOUT_CALIBRATION].address + 100] ^= 0x08;
+	check(!eeprom_layout_verify(EEPROM_LAYOUT_CALIBRATION) && eeprom_layout_verify(EEPROM_LAYOUT_BOARD)
+			&& !eeprom_layout_verify_all(), "corrupted item refused");
+	mem[eeprom_layout_items[EEPROM_LAYOUT_CALIBRATION].address + 100] ^= 0x08;
+}
+
+
+/* Performance counters of a write, a read refused during its write cycle,
+ * the ACK polling and two reads: counts, bytes and latency buckets */
+static void run_perf(void)
+{
+	static const char *const op_names[EEPROM_PERF_OPS] = {"write", "read", "probe", "check"};
+	static uint8_t data[PAGE_SIZE];
+	eeprom_perf_stats_t stats;
+	eeprom_twr_stats_t twr_before;
+	eeprom_twr_stats_t twr_after;
+	uint32_t sum;
+	uint32_t us;
+	uint8_t bucket;
+	uint8_t byte;
+	uint8_t op;
+	uint16_t i;
+	bool ok;
+
+	printf("performance counters:\n");
+
+	for (i = 0; i < PAGE_SIZE; i++) {
+		data[i] = (uint8_t)(i * 7u);
+	}
+	eeprom_wait_ready();
+	eeprom_reset_perf_stats();
+	eeprom_get_perf_stats(&stats);
+	ok = (0 == stats.blocking_us);
+	for (op = 0; op < EEPROM_PERF_OPS; op++) {
+		ok = ok && (0 == stats.ops[op].transfers) && (0 == stats.ops[op].bytes);
+	}
+	check(ok, "counters cleared");
+
+	eeprom_get_twr_stats(&twr_before);
+	ok = eeprom_write_page(PERF_ADDRESS, data, PAGE_SIZE)
+			&& !eeprom_read_byte(PERF_ADDRESS, &byte)
+			&& eeprom_wait_ready()
+			&& eeprom_read_block(PERF_ADDRESS, data, PAGE_SIZE)
+			&& eeprom_read_byte(PERF_ADDRESS, &byte);
+	eeprom_get_twr_stats(&twr_after);
+	eeprom_get_perf_stats(&stats);
+	check(ok, "operations run");
+
+	check((1 == stats.ops[EEPROM_PERF_WRITE].transfers) && (PAGE_SIZE == stats.ops[EEPROM_PERF_WRITE].bytes),
+			"write counted");
+	check((3 == stats.ops[EEPROM_PERF_READ].transfers) && (1 == stats.ops[EEPROM_PERF_READ].nacks)
+			&& ((PAGE_SIZE + 1) == stats.ops[EEPROM_PERF_READ].bytes), "reads and NACK counted");
+	check(((twr_after.probes - twr_before.probes) == stats.ops[EEPROM_PERF_PROBE].transfers)
+			&& ((twr_after.nacks - twr_before.nacks) == stats.ops[EEPROM_PERF_PROBE].nacks),
+			"ACK polling counted");
+
+	ok = (stats.blocking_us > 0);
+	for (op = 0; op < EEPROM_PERF_OPS; op++) {
+		sum = 0;
+		for (i = 0; i < EEPROM_PERF_BUCKETS; i++) {
+			sum += stats.ops[op].latency[i];
+		}
+		ok = ok && (sum == stats.ops[op].transfers)
+				&& ((0 == stats.ops[op].transfers) || (stats.ops[op].events > 0));
+	}
+	check(ok, "one histogram entry per transfer");
+
+	/* a page and its address at 400 kHz: 22.5 us a byte, about 1.5 ms
+	 * for 64 bytes */
+	bucket = 0;
+	for (us = (PAGE_SIZE + 4) * 45u / 2u; us > 1; us >>= 1) {
+		bucket++;
+	}
+	check(stats.ops[EEPROM_PERF_READ].latency[bucket] >= 1, "page read in its latency bucket");
+
+	for (op = 0; op < EEPROM_PERF_OPS; op++) {
+		printf("  %-6s %3u transfers %2u NACKs %4u bytes %4u events  buckets",
+				op_names[op], (unsigned)stats.ops[op].transfers, (unsigned)stats.ops[op].nacks,
+				(unsigned)stats.ops[op].bytes, (unsigned)stats.ops[op].events);
+		for (i = 0; i < EEPROM_PERF_BUCKETS; i++) {
+			if (stats.ops[op].latency[i] > 0) {
+				printf(" %u:%u", (unsigned)i, (unsigned)stats.ops[op].latency[i]);
+			}
+		}
+		printf("\n");
+	}
+}
+
+
+/* Spend the time of the service link for some bytes: the I2C interrupts
+ * go on meanwhile */
+static void link_time(uint16_t data_length)
+{
+	uint64_t start_ns = i2c_sim_time_ns();
+
+	while ((i2c_sim_time_ns() - start_ns) < ((uint64_t)data_length * IMAGE_LINK_NS_PER_BYTE)) {
+		i2c_sim_idle();
+	}
+}
+
+
+/* Image sink and source: the file through the service link */
+static bool image_sink(eeprom_addr_t address, const uint8_t *data_ptr, uint16_t data_length)
+{
+	link_time(data_length);
+
+	return (fseek(image_file, (long)address, SEEK_SET) == 0)
+			&& (fwrite(data_ptr, 1, data_length, image_file) == data_length);
+}
+
+
+static bool image_source(eeprom_addr_t address, uint8_t *data_ptr, uint16_t data_length)
+{
+	link_time(data_length);
+
+	return (fseek(image_file, (long)address, SEEK_SET) == 0)
+			&& (fread(data_ptr, 1, data_length, image_file) == data_length);
+}
+
+
+/* Whole device dumped to a file and restored from it, pipelined against
+ * a chunk read or a page write at a time followed by the link */
+static void run_image(void)
+{
+	static uint8_t saved[EEPROM_SIZE];
+	static uint8_t file_data[EEPROM_SIZE];
+	uint8_t chunk[PAGE_SIZE > IMAGE_NAIVE_CHUNK ? PAGE_SIZE : IMAGE_NAIVE_CHUNK];
+	uint8_t *mem = i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS);
+	uint64_t start_ns;
+	double naive_s;
+	double pipe_s;
+	uint32_t i;
+	bool ok;
+
+	printf("image dump and restore, %u bytes, link %u ns/byte:\n", (unsigned)EEPROM_SIZE,
+			(unsigned)IMAGE_LINK_NS_PER_BYTE);
+
+	image_file = tmpfile();
+	if (NULL == image_file) {
+		check(false, "image file");
+		return;
+	}
+	memcpy(saved, mem, EEPROM_SIZE);
+	eeprom_wait_ready();
+
+	/* dump: one chunk read, then the link */
+	start_ns = i2c_sim_time_ns();
+	ok = true;
+	for (i = 0; ok && (i < EEPROM_SIZE); i += IMAGE_NAIVE_CHUNK) {
+		ok = eeprom_read_block((eeprom_addr_t)i, chunk, IMAGE_NAIVE_CHUNK)
+				&& image_sink((eeprom_addr_t)i, chunk, IMAGE_NAIVE_CHUNK);
+	}
+	naive_s = (double)(i2c_sim_time_ns() - start_ns) / 1e9;
+	check(ok, "dump by chunks");
+
+	/* dump: the next chunk read while the link takes this one */
+	rewind(image_file);
+	start_ns = i2c_sim_time_ns();
+	ok = eeprom_image_dump(0, EEPROM_SIZE, &image_sink);
+	pipe_s = (double)(i2c_sim_time_ns() - start_ns) / 1e9;
+	ok = ok && (fseek(image_file, 0, SEEK_SET) == 0)
+			&& (fread(file_data, 1, EEPROM_SIZE, image_file) == EEPROM_SIZE)
+			&& (memcmp(file_data, saved, EEPROM_SIZE) == 0);
+	check(ok, "device dumped to the file");
+	check(pipe_s < naive_s, "dump faster than by chunks");
+	printf("  %-16s %12s %12s\n", "", "serial", "pipelined");
+	printf("  %-16s %8.0f B/s %8.0f B/s\n", "dump", (double)EEPROM_SIZE / naive_s, (double)EEPROM_SIZE / pipe_s);
+
+	/* restore: the link, then one page write and its write cycle */
+	memset(mem, 0xFF, EEPROM_SIZE);
+	start_ns = i2c_sim_time_ns();
+	ok = true;
+	for (i = 0; ok && (i < EEPROM_SIZE); i += PAGE_SIZE) {
+		ok = image_source((eeprom_addr_t)i, chunk, PAGE_SIZE)
+				&& eeprom_write_page((eeprom_addr_t)i, chunk, PAGE_SIZE) && eeprom_wait_ready();
+	}
+	naive_s = (double)(i2c_sim_time_ns() - start_ns) / 1e9;
+	check(ok && (memcmp(mem, saved, EEPROM_SIZE) == 0), "restore by pages");
+
+	/* restore: the next page staged during the write cycle */
+	memset(mem, 0xFF, EEPROM_SIZE);
+	start_ns = i2c_sim_time_ns();
+	ok = eeprom_image_restore(0, EEPROM_SIZE, &image_source);
+	pipe_s = (double)(i2c_sim_time_ns() - start_ns) / 1e9;
+	check(ok && (memcmp(mem, saved, EEPROM_SIZE) == 0), "device restored from the file");
+	check(pipe_s < naive_s, "restore faster than by pages");
+	printf("  %-16s %8.0f B/s %8.0f B/s\n", "restore", (double)EEPROM_SIZE / naive_s, (double)EEPROM_SIZE / pipe_s);
+
+	check(!eeprom_image_dump(1, EEPROM_SIZE, &image_sink), "range beyond the array refused");
+
+	fclose(image_file);
+}
+
+
+
+/* End of file */
@@ -0,0 +1,1623 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * This file i2c_sim.c represents the source file of the host I2C simulator.
+ *
+ * Bus model: every condition and frame takes a number of SCL periods (START
+ * and STOP one period, address and data frames nine periods including the
+ * acknowledge bit). The master peripheral follows the STM32F4 reference
+ * manual: SB, ADDR, TxE, RxNE and BTF are raised when the related bus phase
+ * completes and SCL is stretched while the software has not served them.
+ *
+ * Device model: 24C256, 64-byte pages, two address bytes, page write
+ * roll-over, sequential read roll-over at the end of the array and no
+ * acknowledge of its address during the internal write cycle. A power
+ * cut loses the write cycle in progress, or stores part of it (torn page).
+ *
+ * Timer model: TIM2 update events at (PSC + 1) * (ARR + 1) periods of the
+ * 84 MHz timer clock.
+ *
+ * CRC model: the STM32F4 CRC unit, 32-bit words only.
+ *
+ * DMA model: DMA1 streams serve the I2C TxE/RxNE requests as soon as they
+ * are raised; I2C_CR2_LAST NACKs the byte that ends the DMA transfer.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/crc.h>
+#include <libopencm3/stm32/f4/nvic.h>
+
+#include "i2c_sim.h"
+#include "eeprom.h"
+
+
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Number of simulated I2C peripherals and devices */
+#define SIM_BUS_NUM				3
+#define SIM_DEV_NUM				16
+
+/* Device geometry: the type the driver is built for. The block select
+ * bits of the device address are the memory address bits beyond the
+ * address bytes. */
+#define SIM_DEV_CAPACITY		((uint32_t)EEPROM_SIZE)
+#define SIM_DEV_PAGE_SIZE		((uint32_t)PAGE_SIZE)
+#define SIM_DEV_ADDR_BYTES		EEPROM_ADDRESS_BYTES
+#define SIM_DEV_BLOCK_MASK		((1u << EEPROM_BLOCK_BITS) - 1)
+
+/* Default internal write cycle time */
+#define SIM_WRITE_TIME_NS		5000000u
+
+/* CPU time spent by each register access */
+#define SIM_CPU_STEP_NS			20u
+
+/* Longest time skipped by an idle call: a busy wait on the cycle counter
+ * shall not overshoot its end by much */
+#define SIM_IDLE_STEP_NS		1000u
+
+/* Longest simulated run before declaring a deadlock */
+#define SIM_TIME_LIMIT_NS		(3600ull * 1000000000ull)
+
+/* Back to back interrupt calls before declaring an interrupt storm */
+#define SIM_ISR_STORM_LIMIT		100000u
+
+/* No bus event scheduled */
+#define SIM_NO_EVENT			UINT64_MAX
+
+/* SR1 flags cleared by software writing 0 */
+#define SR1_RC_W0_MASK			(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR \
+								| I2C_SR1_PECERR | I2C_SR1_TIMEOUT | I2C_SR1_SMBALERT)
+
+/* SR1 flags raising the event interrupt */
+#define SR1_EV_MASK				(I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_ADD10 | I2C_SR1_STOPF)
+
+/* SR1 flags raising the event interrupt when buffer interrupts are enabled */
+#define SR1_BUF_MASK			(I2C_SR1_TxE | I2C_SR1_RxNE)
+
+/* TIM2 input clock: twice the APB1 clock */
+#define SIM_TIM_CLOCK_HZ		84000000ull
+
+/* Number of DMA1 streams */
+#define SIM_DMA_STREAM_NUM		8
+
+/* Number of GPIO ports */
+#define SIM_GPIO_PORT_NUM		4
+
+
+
+
+/* ------------- Local typedef definitions ------------- */
+
+/* Bus phases */
+enum {
+	PH_IDLE,		/* bus free */
+	PH_START,		/* START being generated */
+	PH_WAIT,		/* master holds SCL low, waiting for the software */
+	PH_ADDR,		/* address frame on the wire */
+	PH_TX,			/* data frame from master to device */
+	PH_RX,			/* data frame from device to master */
+	PH_STOP			/* STOP being generated */
+};
+
+/* Simulated EEPROM device */
+typedef struct {
+	bool present;
+	uint8_t bus;					/* index of the bus it is attached to */
+	uint8_t address;				/* 7-bit device address, block select bits clear */
+	uint8_t block;					/* block select bits of the last address frame */
+	uint8_t mem[SIM_DEV_CAPACITY];
+	uint32_t pointer;				/* internal address counter */
+	bool writing;					/* addressed in write direction */
+	uint8_t addr_count;				/* memory address bytes received */
+	uint16_t data_count;			/* data bytes received */
+	uint32_t page_base;				/* page being written */
+	uint8_t latch[SIM_DEV_PAGE_SIZE];
+	bool latch_used[SIM_DEV_PAGE_SIZE];
+	uint64_t busy_until_ns;			/* end of the internal write cycle */
+	uint32_t wear[SIM_DEV_CAPACITY / SIM_DEV_PAGE_SIZE];	/* write cycles per page */
+	bool powered;					/* off after a power cut: no ACK */
+	int32_t cut_countdown;			/* write cycles before the power cut, -1: none */
+	bool cut_torn;					/* the interrupted write stores half of its bytes */
+} sim_dev_t;
+
+/* Simulated DMA1 stream */
+typedef struct {
+	bool enabled;
+	bool mem_to_periph;			/* direction */
+	bool tcie;					/* transfer complete interrupt enable */
+	uintptr_t par;				/* peripheral address */
+	uintptr_t mar;				/* memory address */
+	uint16_t ndtr;				/* data items left */
+	uint32_t flags;				/* interrupt flags */
+	int8_t bus;					/* I2C peripheral served, -1 if none */
+} sim_dma_t;
+
+/* Simulated I2C peripheral and its bus */
+typedef struct {
+	uint32_t base;
+	uint8_t ev_irq;
+	uint8_t er_irq;
+	void (*ev_isr)(void);
+	void (*er_isr)(void);
+	volatile uint32_t reg[I2C_SIM_REG_NUM];	/* software view */
+	uint32_t published[I2C_SIM_REG_NUM];		/* last view given to software */
+	uint32_t bit_ns;				/* SCL period */
+	uint8_t phase;
+	uint64_t event_ns;				/* end of the current phase */
+	int8_t dev;						/* addressed device, -1 if none */
+	bool addr_armed;				/* SR1 read while ADDR was set */
+	bool start_req;					/* START requested during a frame */
+	bool stop_req;					/* STOP requested during a frame */
+	uint8_t wire;					/* byte on the wire */
+	bool dr_full;					/* transmitter: byte waiting in DR */
+	uint8_t dr_tx;
+	bool shift_full;				/* receiver: byte waiting in shift register */
+	uint8_t shift;
+	bool device_sending;			/* receiver: last byte acknowledged */
+	bool pos_ack;					/* receiver: ACK latched for the next byte (POS) */
+	i2c_sim_stats_t stats;
+} sim_bus_t;
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Simulated I2C peripherals */
+static sim_bus_t sim_bus[SIM_BUS_NUM];
+
+/* Simulated devices */
+static sim_dev_t sim_dev[SIM_DEV_NUM];
+
+/* Simulated TIM2 */
+static struct {
+	uint32_t psc;
+	uint32_t arr;
+	bool enabled;
+	bool uie;
+	uint32_t sr;
+	uint64_t event_ns;			/* next update event */
+} sim_tim;
+
+/* Simulated DMA1 streams */
+static sim_dma_t sim_dma[SIM_DMA_STREAM_NUM];
+
+/* CRC unit data register */
+static uint32_t sim_crc = 0xFFFFFFFFu;
+
+/* Virtual time */
+static uint64_t sim_now_ns;
+
+/* Internal write cycle time */
+static uint32_t sim_write_time_ns = SIM_WRITE_TIME_NS;
+
+/* Interrupt state */
+static bool sim_irq_enabled[NVIC_IRQ_COUNT];
+static bool sim_in_isr;
+static uint32_t sim_primask;
+
+/* GPIO output levels */
+static uint16_t sim_gpio_odr[SIM_GPIO_PORT_NUM];
+
+/* APB1 clock of the 168 MHz configuration */
+uint32_t rcc_ahb_frequency = 168000000u;
+uint32_t rcc_apb1_frequency = 42000000u;
+
+/* System clock configurations of the F4 with an 8 MHz crystal */
+const clock_scale_t hse_8mhz_3v3[CLOCK_3V3_END] = {
+	{48000000u, 12000000u, 24000000u},
+	{120000000u, 30000000u, 60000000u},
+	{168000000u, 42000000u, 84000000u}
+};
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static sim_bus_t *find_bus(uint32_t);
+static void sim_sync(void);
+static void sim_advance(uint64_t);
+static void sim_dispatch(void);
+static void run_isr(void (*)(void));
+static void apply_writes(sim_bus_t *);
+static void publish(sim_bus_t *);
+static void start_request(sim_bus_t *);
+static void stop_request(sim_bus_t *);
+static void begin_start(sim_bus_t *);
+static void begin_stop(sim_bus_t *);
+static void begin_frame(sim_bus_t *, uint8_t, uint32_t);
+static void end_of_frame(sim_bus_t *);
+static void complete_phase(sim_bus_t *);
+static void clear_addr(sim_bus_t *);
+static void dr_write(sim_bus_t *, uint8_t);
+static uint8_t dr_read(sim_bus_t *);
+static int8_t dev_find(uint8_t, uint8_t);
+static void dev_write(sim_dev_t *, uint8_t);
+static uint8_t dev_read(sim_dev_t *);
+static void dev_stop(sim_dev_t *);
+static void dma_service(void);
+static bool dma_last(sim_bus_t *);
+static sim_dma_t *find_dma(uint32_t, uint8_t);
+static void tim_check(uint32_t);
+static void tim_arm(void);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+/* Reset the simulator: one 24C256 at 0x50 on I2C1 */
+void i2c_sim_init(void)
+{
+	static const uint32_t bases[SIM_BUS_NUM] = {I2C1, I2C2, I2C3};
+	static const uint8_t ev_irqs[SIM_BUS_NUM] = {NVIC_I2C1_EV_IRQ, NVIC_I2C2_EV_IRQ, NVIC_I2C3_EV_IRQ};
+	static const uint8_t er_irqs[SIM_BUS_NUM] = {NVIC_I2C1_ER_IRQ, NVIC_I2C2_ER_IRQ, NVIC_I2C3_ER_IRQ};
+	static void (*const ev_isrs[SIM_BUS_NUM])(void) = {i2c1_ev_isr, i2c2_ev_isr, i2c3_ev_isr};
+	static void (*const er_isrs[SIM_BUS_NUM])(void) = {i2c1_er_isr, i2c2_er_isr, i2c3_er_isr};
+	uint8_t i;
+
+	memset(sim_bus, 0, sizeof(sim_bus));
+	memset(sim_dev, 0, sizeof(sim_dev));
+	memset(sim_dma, 0, sizeof(sim_dma));
+	memset(&sim_tim, 0, sizeof(sim_tim));
+	sim_tim.event_ns = SIM_NO_EVENT;
+	memset(sim_irq_enabled, 0, sizeof(sim_irq_enabled));
+	memset(sim_gpio_odr, 0, sizeof(sim_gpio_odr));
+	sim_now_ns = 0;
+	sim_in_isr = false;
+	sim_primask = 0;
+	sim_write_time_ns = SIM_WRITE_TIME_NS;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		sim_bus[i].base = bases[i];
+		sim_bus[i].ev_irq = ev_irqs[i];
+		sim_bus[i].er_irq = er_irqs[i];
+		sim_bus[i].ev_isr = ev_isrs[i];
+		sim_bus[i].er_isr = er_isrs[i];
+		sim_bus[i].bit_ns = 10000;
+		sim_bus[i].event_ns = SIM_NO_EVENT;
+		sim_bus[i].dev = -1;
+	}
+
+	i2c_sim_attach(I2C1, 0x50);
+}
+
+
+/* Attach an erased 24C256 to a bus */
+void i2c_sim_attach(uint32_t i2c, uint8_t address)
+{
+	sim_bus_t *bus = find_bus(i2c);
+	uint8_t i;
+
+	for (i = 0; i < SIM_DEV_NUM; i++) {
+		if (!sim_dev[i].present) {
+			sim_dev[i].present = true;
+			sim_dev[i].bus = (uint8_t)(bus - sim_bus);
+			sim_dev[i].address = (uint8_t)(address & ~SIM_DEV_BLOCK_MASK);
+			memset(sim_dev[i].mem, 0xFF, sizeof(sim_dev[i].mem));
+			sim_dev[i].powered = true;
+			sim_dev[i].cut_countdown = -1;
+			return;
+		}
+	}
+
+	fprintf(stderr, "i2c_sim: too many devices\n");
+	abort();
+}
+
+
+/* Get the memory array of a device */
+uint8_t *i2c_sim_memory(uint32_t i2c, uint8_t address)
+{
+	int8_t dev = dev_find((uint8_t)(find_bus(i2c) - sim_bus), address);
+
+	return (dev >= 0) ? sim_dev[dev].mem : NULL;
+}
+
+
+/* Write cycles endured by a page of a device since it was attached */
+uint32_t i2c_sim_page_wear(uint32_t i2c, uint8_t address, uint16_t page)
+{
+	int8_t dev = dev_find((uint8_t)(find_bus(i2c) - sim_bus), address);
+
+	return ((dev >= 0) && (page < (SIM_DEV_CAPACITY / SIM_DEV_PAGE_SIZE))) ? sim_dev[dev].wear[page] : 0;
+}
+
+
+/* Cut the power of a device after a number of complete write cycles. The
+ * next write cycle is lost, or torn if requested, and the device does
+ * not answer anymore until the power is restored. */
+void i2c_sim_power_cut(uint32_t i2c, uint8_t address, uint32_t write_cycles, bool torn)
+{
+	int8_t dev = dev_find((uint8_t)(find_bus(i2c) - sim_bus), address);
+
+	if (dev >= 0) {
+		sim_dev[dev].cut_countdown = (int32_t)write_cycles;
+		sim_dev[dev].cut_torn = torn;
+	}
+}
+
+
+/* Power a device again: its array keeps what was written before the cut */
+void i2c_sim_power_restore(uint32_t i2c, uint8_t address)
+{
+	int8_t dev = dev_find((uint8_t)(find_bus(i2c) - sim_bus), address);
+
+	if (dev >= 0) {
+		sim_dev[dev].powered = true;
+		sim_dev[dev].pointer = 0;		/* address counter reset at power up */
+		sim_dev[dev].cut_countdown = -1;
+		sim_dev[dev].busy_until_ns = 0;
+		sim_dev[dev].writing = false;
+		sim_dev[dev].data_count = 0;
+	}
+}
+
+
+/* Check whether a device is powered */
+bool i2c_sim_powered(uint32_t i2c, uint8_t address)
+{
+	int8_t dev = dev_find((uint8_t)(find_bus(i2c) - sim_bus), address);
+
+	return (dev >= 0) && sim_dev[dev].powered;
+}
+
+
+/* Set the internal write cycle time of all devices */
+void i2c_sim_set_write_time(uint32_t write_time_ns)
+{
+	sim_write_time_ns = write_time_ns;
+}
+
+
+/* CPU idle: skip to the next bus event, at most SIM_IDLE_STEP_NS */
+void i2c_sim_idle(void)
+{
+	uint64_t next = SIM_NO_EVENT;
+	uint8_t i;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		apply_writes(&sim_bus[i]);
+		if (sim_bus[i].event_ns < next) {
+			next = sim_bus[i].event_ns;
+		}
+	}
+	if (sim_tim.event_ns < next) {
+		next = sim_tim.event_ns;
+	}
+
+	if ((next - sim_now_ns) < SIM_IDLE_STEP_NS) {
+		sim_advance(next - sim_now_ns);
+	} else {
+		sim_advance(SIM_IDLE_STEP_NS);
+	}
+
+	if (sim_now_ns > SIM_TIME_LIMIT_NS) {
+		fprintf(stderr, "i2c_sim: simulation stalled\n");
+		abort();
+	}
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		publish(&sim_bus[i]);
+	}
+	sim_dispatch();
+}
+
+
+/* Get the virtual time */
+uint64_t i2c_sim_time_ns(void)
+{
+	return sim_now_ns;
+}
+
+
+/* Get the statistics of a bus */
+void i2c_sim_get_stats(uint32_t i2c, i2c_sim_stats_t *stats_ptr)
+{
+	*stats_ptr = find_bus(i2c)->stats;
+}
+
+
+/* Reset the statistics of all buses */
+void i2c_sim_reset_stats(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		memset(&sim_bus[i].stats, 0, sizeof(sim_bus[i].stats));
+	}
+}
+
+
+/* Register access: apply pending side effects and return the register */
+volatile uint32_t *i2c_sim_reg(uint32_t i2c, uint8_t reg)
+{
+	sim_bus_t *bus = find_bus(i2c);
+
+	sim_sync();
+
+	if (I2C_SIM_REG_SR1 == reg) {
+		/* first step of the ADDR clearing sequence */
+		bus->addr_armed = (bus->reg[I2C_SIM_REG_SR1] & I2C_SR1_ADDR) != 0;
+	} else if ((I2C_SIM_REG_SR2 == reg) && bus->addr_armed) {
+		/* second step: SR2 read clears ADDR */
+		bus->addr_armed = false;
+		if ((bus->reg[I2C_SIM_REG_SR1] & I2C_SR1_ADDR) != 0) {
+			clear_addr(bus);
+			publish(bus);
+		}
+	}
+
+	return &bus->reg[reg];
+}
+
+
+/* ------------- libopencm3 stand-in: I2C --------------- */
+
+void i2c_reset(uint32_t i2c)
+{
+	sim_bus_t *bus = find_bus(i2c);
+	uint8_t i;
+
+	for (i = 0; i < I2C_SIM_REG_NUM; i++) {
+		bus->reg[i] = 0;
+		bus->published[i] = 0;
+	}
+	bus->phase = PH_IDLE;
+	bus->event_ns = SIM_NO_EVENT;
+	bus->dev = -1;
+	bus->addr_armed = false;
+	bus->start_req = false;
+	bus->stop_req = false;
+	bus->dr_full = false;
+	bus->shift_full = false;
+	bus->device_sending = false;
+}
+
+void i2c_peripheral_enable(uint32_t i2c)
+{
+	I2C_CR1(i2c) |= I2C_CR1_PE;
+	sim_sync();
+}
+
+void i2c_peripheral_disable(uint32_t i2c)
+{
+	I2C_CR1(i2c) &= ~I2C_CR1_PE;
+	sim_sync();
+}
+
+void i2c_set_standard_mode(uint32_t i2c)
+{
+	(void)i2c;
+}
+
+void i2c_set_fast_mode(uint32_t i2c)
+{
+	(void)i2c;
+}
+
+void i2c_set_speed(uint32_t i2c, enum i2c_speeds speed, uint32_t clock_megahz)
+{
+	sim_bus_t *bus = find_bus(i2c);
+
+	(void)clock_megahz;
+	switch (speed) {
+	case i2c_speed_fm_400k:
+		bus->bit_ns = 2500;
+		break;
+	case i2c_speed_fmp_1m:
+		bus->bit_ns = 1000;
+		break;
+	default:
+		bus->bit_ns = 10000;
+		break;
+	}
+}
+
+void i2c_send_start(uint32_t i2c)
+{
+	I2C_CR1(i2c) |= I2C_CR1_START;
+	sim_sync();
+}
+
+void i2c_send_stop(uint32_t i2c)
+{
+	I2C_CR1(i2c) |= I2C_CR1_STOP;
+	sim_sync();
+}
+
+void i2c_send_7bit_address(uint32_t i2c, uint8_t slave, uint8_t readwrite)
+{
+	i2c_send_data(i2c, (uint8_t)((slave << 1) | readwrite));
+}
+
+void i2c_send_data(uint32_t i2c, uint8_t data)
+{
+	sim_bus_t *bus = find_bus(i2c);
+
+	sim_sync();
+	dr_write(bus, data);
+	publish(bus);
+	sim_dispatch();
+}
+
+uint8_t i2c_get_data(uint32_t i2c)
+{
+	sim_bus_t *bus = find_bus(i2c);
+	uint8_t data;
+
+	sim_sync();
+	data = dr_read(bus);
+	publish(bus);
+	sim_dispatch();
+
+	return data;
+}
+
+void i2c_enable_interrupt(uint32_t i2c, uint32_t interrupt)
+{
+	I2C_CR2(i2c) |= interrupt;
+	sim_sync();
+}
+
+void i2c_disable_interrupt(uint32_t i2c, uint32_t interrupt)
+{
+	I2C_CR2(i2c) &= ~interrupt;
+	sim_sync();
+}
+
+void i2c_enable_ack(uint32_t i2c)
+{
+	I2C_CR1(i2c) |= I2C_CR1_ACK;
+	sim_sync();
+}
+
+void i2c_disable_ack(uint32_t i2c)
+{
+	I2C_CR1(i2c) &= ~I2C_CR1_ACK;
+	sim_sync();
+}
+
+void i2c_nack_next(uint32_t i2c)
+{
+	I2C_CR1(i2c) |= I2C_CR1_POS;
+	sim_sync();
+}
+
+void i2c_nack_current(uint32_t i2c)
+{
+	I2C_CR1(i2c) &= ~I2C_CR1_POS;
+	sim_sync();
+}
+
+void i2c_enable_dma(uint32_t i2c)
+{
+	I2C_CR2(i2c) |= I2C_CR2_DMAEN;
+	sim_sync();
+}
+
+void i2c_disable_dma(uint32_t i2c)
+{
+	I2C_CR2(i2c) &= ~I2C_CR2_DMAEN;
+	sim_sync();
+}
+
+void i2c_set_dma_last_transfer(uint32_t i2c)
+{
+	I2C_CR2(i2c) |= I2C_CR2_LAST;
+	sim_sync();
+}
+
+void i2c_clear_dma_last_transfer(uint32_t i2c)
+{
+	I2C_CR2(i2c) &= ~I2C_CR2_LAST;
+	sim_sync();
+}
+
+
+/* ------------- libopencm3 stand-in: DMA --------------- */
+
+void dma_stream_reset(uint32_t dma, uint8_t stream)
+{
+	sim_dma_t *st = find_dma(dma, stream);
+
+	memset(st, 0, sizeof(*st));
+	st->bus = -1;
+}
+
+void dma_channel_select(uint32_t dma, uint8_t stream, uint32_t channel)
+{
+	(void)find_dma(dma, stream);
+	(void)channel;
+}
+
+void dma_set_transfer_mode(uint32_t dma, uint8_t stream, uint32_t direction)
+{
+	find_dma(dma, stream)->mem_to_periph = (DMA_SxCR_DIR_MEM_TO_PERIPHERAL == direction);
+}
+
+void dma_set_priority(uint32_t dma, uint8_t stream, uint32_t prio)
+{
+	(void)find_dma(dma, stream);
+	(void)prio;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t stream, uint32_t mem_size)
+{
+	(void)find_dma(dma, stream);
+	(void)mem_size;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t stream, uint32_t peripheral_size)
+{
+	(void)find_dma(dma, stream);
+	(void)peripheral_size;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t stream)
+{
+	(void)find_dma(dma, stream);
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t stream, uintptr_t address)
+{
+	find_dma(dma, stream)->par = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t stream, uintptr_t address)
+{
+	find_dma(dma, stream)->mar = address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t stream, uint16_t number)
+{
+	find_dma(dma, stream)->ndtr = number;
+}
+
+uint16_t dma_get_number_of_data(uint32_t dma, uint8_t stream)
+{
+	return find_dma(dma, stream)->ndtr;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t stream)
+{
+	find_dma(dma, stream)->tcie = true;
+}
+
+void dma_enable_stream(uint32_t dma, uint8_t stream)
+{
+	sim_dma_t *st = find_dma(dma, stream);
+	uint8_t i;
+
+	/* peripheral served: the one whose DR is addressed */
+	st->bus = -1;
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		if (st->par == (uintptr_t)&sim_bus[i].reg[I2C_SIM_REG_DR]) {
+			st->bus = (int8_t)i;
+		}
+	}
+	st->enabled = true;
+	sim_sync();
+}
+
+void dma_disable_stream(uint32_t dma, uint8_t stream)
+{
+	find_dma(dma, stream)->enabled = false;
+}
+
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t stream, uint32_t interrupts)
+{
+	return (find_dma(dma, stream)->flags & interrupts) != 0;
+}
+
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t stream, uint32_t interrupts)
+{
+	find_dma(dma, stream)->flags &= ~interrupts;
+}
+
+
+/* ------------- libopencm3 stand-in: TIM2 --------------- */
+
+void timer_reset(uint32_t timer_peripheral)
+{
+	tim_check(timer_peripheral);
+	memset(&sim_tim, 0, sizeof(sim_tim));
+	sim_tim.event_ns = SIM_NO_EVENT;
+}
+
+void timer_set_mode(uint32_t timer_peripheral, uint32_t clock_div, uint32_t alignment, uint32_t direction)
+{
+	tim_check(timer_peripheral);
+	(void)clock_div;
+	(void)alignment;
+	(void)direction;
+}
+
+void timer_set_prescaler(uint32_t timer_peripheral, uint32_t value)
+{
+	tim_check(timer_peripheral);
+	sim_tim.psc = value;
+}
+
+void timer_disable_preload(uint32_t timer_peripheral)
+{
+	tim_check(timer_peripheral);
+}
+
+void timer_continuous_mode(uint32_t timer_peripheral)
+{
+	tim_check(timer_peripheral);
+}
+
+void timer_set_period(uint32_t timer_peripheral, uint32_t period)
+{
+	tim_check(timer_peripheral);
+	sim_tim.arr = period;
+}
+
+void timer_enable_counter(uint32_t timer_peripheral)
+{
+	tim_check(timer_peripheral);
+	sim_tim.enabled = true;
+	tim_arm();
+}
+
+void timer_disable_counter(uint32_t timer_peripheral)
+{
+	tim_check(timer_peripheral);
+	sim_tim.enabled = false;
+	sim_tim.event_ns = SIM_NO_EVENT;
+}
+
+void timer_enable_irq(uint32_t timer_peripheral, uint32_t irq)
+{
+	tim_check(timer_peripheral);
+	sim_tim.uie = sim_tim.uie || ((irq & TIM_DIER_UIE) != 0);
+	sim_dispatch();
+}
+
+void timer_disable_irq(uint32_t timer_peripheral, uint32_t irq)
+{
+	tim_check(timer_peripheral);
+	sim_tim.uie = sim_tim.uie && ((irq & TIM_DIER_UIE) == 0);
+}
+
+bool timer_get_flag(uint32_t timer_peripheral, uint32_t flag)
+{
+	tim_check(timer_peripheral);
+	return (sim_tim.sr & flag) != 0;
+}
+
+void timer_clear_flag(uint32_t timer_peripheral, uint32_t flag)
+{
+	tim_check(timer_peripheral);
+	sim_tim.sr &= ~flag;
+}
+
+
+/* ------------- libopencm3 stand-in: DWT --------------- */
+
+bool dwt_enable_cycle_counter(void)
+{
+	return true;
+}
+
+uint32_t dwt_read_cycle_counter(void)
+{
+	/* a counter read costs CPU time like a register access */
+	sim_sync();
+
+	return (uint32_t)((sim_now_ns * (rcc_ahb_frequency / 1000000u)) / 1000u);
+}
+
+
+/* ------------- libopencm3 stand-in: CRC --------------- */
+
+void crc_reset(void)
+{
+	sim_crc = 0xFFFFFFFFu;
+}
+
+uint32_t crc_calculate(uint32_t data)
+{
+	uint8_t bit;
+
+	sim_crc ^= data;
+	for (bit = 0; bit < 32; bit++) {
+		sim_crc = ((sim_crc & 0x80000000u) != 0) ? ((sim_crc << 1) ^ 0x04C11DB7u) : (sim_crc << 1);
+	}
+
+	return sim_crc;
+}
+
+
+/* ------------- libopencm3 stand-in: NVIC, CPU, RCC, GPIO --------------- */
+
+void nvic_enable_irq(uint8_t irqn)
+{
+	sim_irq_enabled[irqn] = true;
+	sim_dispatch();
+}
+
+void nvic_disable_irq(uint8_t irqn)
+{
+	sim_irq_enabled[irqn] = false;
+}
+
+void cm_enable_interrupts(void)
+{
+	sim_primask = 0;
+	sim_dispatch();
+}
+
+void cm_disable_interrupts(void)
+{
+	sim_primask = 1;
+}
+
+uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	uint32_t old = sim_primask;
+
+	sim_primask = mask;
+	sim_dispatch();
+
+	return old;
+}
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+	(void)clken;
+}
+
+void rcc_clock_setup_hse_3v3(const clock_scale_t *clock)
+{
+	rcc_ahb_frequency = clock->ahb_frequency;
+	rcc_apb1_frequency = clock->apb1_frequency;
+}
+
+void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)alt_func_num;
+	(void)gpios;
+}
+
+void gpio_mode_setup(uint32_t gpioport, uint8_t mode, uint8_t pull_up_down, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)mode;
+	(void)pull_up_down;
+	(void)gpios;
+}
+
+void gpio_set_output_options(uint32_t gpioport, uint8_t otype, uint8_t speed, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)otype;
+	(void)speed;
+	(void)gpios;
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	sim_gpio_odr[((gpioport - GPIOA) >> 10) % SIM_GPIO_PORT_NUM] |= gpios;
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	sim_gpio_odr[((gpioport - GPIOA) >> 10) % SIM_GPIO_PORT_NUM] &= (uint16_t)~gpios;
+}
+
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios)
+{
+	return sim_gpio_odr[((gpioport - GPIOA) >> 10) % SIM_GPIO_PORT_NUM] & gpios;
+}
+
+
+/* Default handlers of the interrupts not served by the application */
+__attribute__((weak)) void tim2_isr(void) {}
+__attribute__((weak)) void i2c1_ev_isr(void) {}
+__attribute__((weak)) void i2c1_er_isr(void) {}
+__attribute__((weak)) void i2c2_ev_isr(void) {}
+__attribute__((weak)) void i2c2_er_isr(void) {}
+__attribute__((weak)) void i2c3_ev_isr(void) {}
+__attribute__((weak)) void i2c3_er_isr(void) {}
+__attribute__((weak)) void dma1_stream0_isr(void) {}
+__attribute__((weak)) void dma1_stream1_isr(void) {}
+__attribute__((weak)) void dma1_stream2_isr(void) {}
+__attribute__((weak)) void dma1_stream3_isr(void) {}
+__attribute__((weak)) void dma1_stream4_isr(void) {}
+__attribute__((weak)) void dma1_stream5_isr(void) {}
+__attribute__((weak)) void dma1_stream6_isr(void) {}
+__attribute__((weak)) void dma1_stream7_isr(void) {}
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Get the simulated peripheral of a base address */
+static sim_bus_t *find_bus(uint32_t i2c)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		if (sim_bus[i].base == i2c) {
+			return &sim_bus[i];
+		}
+	}
+
+	fprintf(stderr, "i2c_sim: unknown peripheral 0x%08x\n", (unsigned)i2c);
+	abort();
+}
+
+
+/* Apply software writes, spend one CPU step and serve interrupts */
+static void sim_sync(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		apply_writes(&sim_bus[i]);
+	}
+	sim_advance(SIM_CPU_STEP_NS);
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		publish(&sim_bus[i]);
+	}
+	sim_dispatch();
+}
+
+
+/* Advance the virtual time completing the bus phases in order */
+static void sim_advance(uint64_t delta_ns)
+{
+	uint64_t target = sim_now_ns + delta_ns;
+	sim_bus_t *next;
+	uint8_t i;
+
+	for (;;) {
+		next = NULL;
+		for (i = 0; i < SIM_BUS_NUM; i++) {
+			if ((sim_bus[i].event_ns <= target)
+			&& ((NULL == next) || (sim_bus[i].event_ns < next->event_ns))) {
+				next = &sim_bus[i];
+			}
+		}
+		if ((sim_tim.event_ns <= target)
+		&& ((NULL == next) || (sim_tim.event_ns <= next->event_ns))) {
+			/* timer update event */
+			sim_now_ns = sim_tim.event_ns;
+			sim_tim.sr |= TIM_SR_UIF;
+			tim_arm();
+			continue;
+		}
+		if (NULL == next) {
+			break;
+		}
+		sim_now_ns = next->event_ns;
+		next->event_ns = SIM_NO_EVENT;
+		complete_phase(next);
+		dma_service();
+	}
+
+	sim_now_ns = target;
+}
+
+
+/* Call the handlers of all pending and enabled interrupts */
+static void sim_dispatch(void)
+{
+	static const uint8_t dma_irqs[SIM_DMA_STREAM_NUM] = {
+		NVIC_DMA1_STREAM0_IRQ, NVIC_DMA1_STREAM1_IRQ, NVIC_DMA1_STREAM2_IRQ, NVIC_DMA1_STREAM3_IRQ,
+		NVIC_DMA1_STREAM4_IRQ, NVIC_DMA1_STREAM5_IRQ, NVIC_DMA1_STREAM6_IRQ, NVIC_DMA1_STREAM7_IRQ
+	};
+	static void (*const dma_isrs[SIM_DMA_STREAM_NUM])(void) = {
+		dma1_stream0_isr, dma1_stream1_isr, dma1_stream2_isr, dma1_stream3_isr,
+		dma1_stream4_isr, dma1_stream5_isr, dma1_stream6_isr, dma1_stream7_isr
+	};
+	uint32_t calls = 0;
+	bool fired;
+	sim_bus_t *bus;
+	uint32_t sr1, cr2;
+	uint8_t i;
+
+	if (sim_in_isr || (sim_primask != 0)) {
+		return;
+	}
+
+	do {
+		fired = false;
+		for (i = 0; i < SIM_BUS_NUM; i++) {
+			bus = &sim_bus[i];
+			sr1 = bus->reg[I2C_SIM_REG_SR1];
+			cr2 = bus->reg[I2C_SIM_REG_CR2];
+			if (sim_irq_enabled[bus->er_irq]
+			&& ((cr2 & I2C_CR2_ITERREN) != 0)
+			&& ((sr1 & SR1_RC_W0_MASK) != 0)) {
+				bus->stats.interrupts++;
+				run_isr(bus->er_isr);
+				fired = true;
+			} else if (sim_irq_enabled[bus->ev_irq]
+			&& ((cr2 & I2C_CR2_ITEVTEN) != 0)
+			&& (((sr1 & SR1_EV_MASK) != 0)
+			|| (((cr2 & I2C_CR2_ITBUFEN) != 0) && ((sr1 & SR1_BUF_MASK) != 0)))) {
+				bus->stats.interrupts++;
+				run_isr(bus->ev_isr);
+				fired = true;
+			}
+		}
+		if (sim_irq_enabled[NVIC_TIM2_IRQ] && sim_tim.uie && ((sim_tim.sr & TIM_SR_UIF) != 0)) {
+			run_isr(tim2_isr);
+			fired = true;
+		}
+		for (i = 0; i < SIM_DMA_STREAM_NUM; i++) {
+			if (sim_irq_enabled[dma_irqs[i]] && sim_dma[i].tcie
+			&& ((sim_dma[i].flags & DMA_TCIF) != 0)) {
+				run_isr(dma_isrs[i]);
+				fired = true;
+			}
+		}
+		if (fired && (++calls > SIM_ISR_STORM_LIMIT)) {
+			fprintf(stderr, "i2c_sim: interrupt storm\n");
+			abort();
+		}
+	} while (fired);
+}
+
+
+/* Run an interrupt handler */
+static void run_isr(void (*isr)(void))
+{
+	uint8_t i;
+
+	sim_in_isr = true;
+	(*isr)();
+	sim_in_isr = false;
+
+	for (i = 0; i < SIM_BUS_NUM; i++) {
+		apply_writes(&sim_bus[i]);
+		publish(&sim_bus[i]);
+	}
+}
+
+
+/* Apply the hardware semantics of the software register writes */
+static void apply_writes(sim_bus_t *bus)
+{
+	uint32_t old, written;
+
+	/* SR1: only rc_w0 flags can be cleared */
+	old = bus->published[I2C_SIM_REG_SR1];
+	written = bus->reg[I2C_SIM_REG_SR1];
+	if (written != old) {
+		bus->reg[I2C_SIM_REG_SR1] = old & (written | ~SR1_RC_W0_MASK);
+	}
+
+	/* SR2 and DR are not writable here */
+	bus->reg[I2C_SIM_REG_SR2] = bus->published[I2C_SIM_REG_SR2];
+	bus->reg[I2C_SIM_REG_DR] = bus->published[I2C_SIM_REG_DR];
+
+	/* CR1: START and STOP requests */
+	old = bus->published[I2C_SIM_REG_CR1];
+	written = bus->reg[I2C_SIM_REG_CR1];
+	bus->published[I2C_SIM_REG_CR1] = written;
+	if (((written & ~old) & I2C_CR1_START) != 0) {
+		start_request(bus);
+	}
+	if (((written & ~old) & I2C_CR1_STOP) != 0) {
+		stop_request(bus);
+	}
+
+	dma_service();
+	publish(bus);
+}
+
+
+/* Make the current state the reference for write detection */
+static void publish(sim_bus_t *bus)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_SIM_REG_NUM; i++) {
+		bus->published[i] = bus->reg[i];
+	}
+}
+
+
+/* START requested by the software */
+static void start_request(sim_bus_t *bus)
+{
+	if ((PH_IDLE == bus->phase) || (PH_WAIT == bus->phase)) {
+		begin_start(bus);
+	} else {
+		/* generated at the end of the current phase */
+		bus->start_req = true;
+	}
+}
+
+
+/* STOP requested by the software */
+static void stop_request(sim_bus_t *bus)
+{
+	if (PH_IDLE == bus->phase) {
+		/* not master: nothing to do */
+		bus->reg[I2C_SIM_REG_CR1] &= ~I2C_CR1_STOP;
+	} else if (PH_WAIT == bus->phase) {
+		begin_stop(bus);
+	} else {
+		/* generated at the end of the current phase */
+		bus->stop_req = true;
+	}
+}
+
+
+/* Put a START (or repeated START) on the bus */
+static void begin_start(sim_bus_t *bus)
+{
+	bus->start_req = false;
+	bus->phase = PH_START;
+	bus->event_ns = sim_now_ns + bus->bit_ns;
+	bus->reg[I2C_SIM_REG_SR1] &= ~(I2C_SR1_TxE | I2C_SR1_BTF);
+	bus->dr_full = false;
+	bus->device_sending = false;
+}
+
+
+/* Put a STOP on the bus */
+static void begin_stop(sim_bus_t *bus)
+{
+	bus->stop_req = false;
+	bus->phase = PH_STOP;
+	bus->event_ns = sim_now_ns + bus->bit_ns;
+}
+
+
+/* Put an address or data frame on the bus */
+static void begin_frame(sim_bus_t *bus, uint8_t phase, uint32_t wire)
+{
+	bus->phase = phase;
+	bus->wire = (uint8_t)wire;
+	bus->event_ns = sim_now_ns + 9u * bus->bit_ns;
+}
+
+
+/* Master holds the bus: serve the conditions requested meanwhile */
+static void end_of_frame(sim_bus_t *bus)
+{
+	bus->phase = PH_WAIT;
+	if (bus->stop_req) {
+		begin_stop(bus);
+	} else if (bus->start_req) {
+		begin_start(bus);
+	}
+}
+
+
+/* End of a bus phase */
+static void complete_phase(sim_bus_t *bus)
+{
+	volatile uint32_t *reg = bus->reg;
+	sim_dev_t *dev = (bus->dev >= 0) ? &sim_dev[bus->dev] : NULL;
+	bool ack;
+
+	switch (bus->phase) {
+	case PH_START:
+	{
+		bus->stats.starts++;
+		bus->stats.bit_times++;
+		reg[I2C_SIM_REG_SR1] |= I2C_SR1_SB;
+		reg[I2C_SIM_REG_SR2] |= I2C_SR2_MSL | I2C_SR2_BUSY;
+		reg[I2C_SIM_REG_CR1] &= ~I2C_CR1_START;
+		bus->dev = -1;
+		bus->phase = PH_WAIT;
+		if (bus->stop_req) {
+			begin_stop(bus);
+		}
+		break;
+	}
+	case PH_ADDR:
+	{
+		bus->stats.address_frames++;
+		bus->stats.bit_times += 9;
+		bus->dev = dev_find((uint8_t)(bus - sim_bus), (uint8_t)(bus->wire >> 1));
+		if ((bus->dev >= 0) && sim_dev[bus->dev].powered
+		&& (sim_now_ns >= sim_dev[bus->dev].busy_until_ns)) {
+			dev = &sim_dev[bus->dev];
+			dev->writing = (bus->wire & 1) == 0;
+			dev->block = (uint8_t)((bus->wire >> 1) & SIM_DEV_BLOCK_MASK);
+			dev->addr_count = 0;
+			dev->data_count = 0;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_ADDR;
+			if (dev->writing) {
+				reg[I2C_SIM_REG_SR2] |= I2C_SR2_TRA;
+			} else {
+				reg[I2C_SIM_REG_SR2] &= ~I2C_SR2_TRA;
+			}
+		} else {
+			bus->dev = -1;
+			bus->stats.nacks++;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_AF;
+		}
+		end_of_frame(bus);
+		break;
+	}
+	case PH_TX:
+	{
+		bus->stats.data_bytes++;
+		bus->stats.bit_times += 9;
+		if (dev != NULL) {
+			dev_write(dev, bus->wire);
+			if (bus->dr_full) {
+				/* next byte already in DR */
+				bus->dr_full = false;
+				reg[I2C_SIM_REG_SR1] |= I2C_SR1_TxE;
+				begin_frame(bus, PH_TX, bus->dr_tx);
+			} else {
+				reg[I2C_SIM_REG_SR1] |= I2C_SR1_BTF;
+				end_of_frame(bus);
+			}
+		} else {
+			bus->stats.nacks++;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_AF;
+			end_of_frame(bus);
+		}
+		break;
+	}
+	case PH_RX:
+	{
+		bus->stats.data_bytes++;
+		bus->stats.bit_times += 9;
+		/* acknowledge of this byte */
+		if ((reg[I2C_SIM_REG_CR1] & I2C_CR1_POS) != 0) {
+			ack = bus->pos_ack;
+			bus->pos_ack = (reg[I2C_SIM_REG_CR1] & I2C_CR1_ACK) != 0;
+		} else {
+			ack = (reg[I2C_SIM_REG_CR1] & I2C_CR1_ACK) != 0;
+		}
+		if (dma_last(bus)) {
+			ack = false;
+		}
+		bus->device_sending = ack;
+		/* store the byte */
+		if ((reg[I2C_SIM_REG_SR1] & I2C_SR1_RxNE) == 0) {
+			reg[I2C_SIM_REG_DR] = bus->wire;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_RxNE;
+			if (ack && !bus->stop_req && !bus->start_req) {
+				/* device goes on with the next byte */
+				begin_frame(bus, PH_RX, dev_read(dev));
+			} else {
+				end_of_frame(bus);
+			}
+		} else {
+			/* DR still full: byte waits in the shift register */
+			bus->shift = bus->wire;
+			bus->shift_full = true;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_BTF;
+			end_of_frame(bus);
+		}
+		if (!ack) {
+			bus->stats.nacks++;
+		}
+		break;
+	}
+	case PH_STOP:
+	{
+		bus->stats.stops++;
+		bus->stats.bit_times++;
+		reg[I2C_SIM_REG_SR2] &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+		reg[I2C_SIM_REG_SR1] &= ~(I2C_SR1_TxE | I2C_SR1_BTF);
+		reg[I2C_SIM_REG_CR1] &= ~I2C_CR1_STOP;
+		if (dev != NULL) {
+			dev_stop(dev);
+		}
+		bus->dev = -1;
+		bus->dr_full = false;
+		bus->device_sending = false;
+		bus->phase = PH_IDLE;
+		if (bus->start_req) {
+			begin_start(bus);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+
+/* ADDR cleared by the software: the data phase can go on */
+static void clear_addr(sim_bus_t *bus)
+{
+	bus->reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_ADDR;
+
+	if ((bus->reg[I2C_SIM_REG_SR2] & I2C_SR2_TRA) != 0) {
+		/* transmitter: DR empty */
+		bus->reg[I2C_SIM_REG_SR1] |= I2C_SR1_TxE;
+	} else if (PH_WAIT == bus->phase) {
+		/* receiver: device sends the first byte */
+		bus->device_sending = true;
+		bus->pos_ack = (bus->reg[I2C_SIM_REG_CR1] & I2C_CR1_ACK) != 0;
+		begin_frame(bus, PH_RX, dev_read(&sim_dev[bus->dev]));
+	}
+
+	dma_service();
+}
+
+
+/* Software writes DR */
+static void dr_write(sim_bus_t *bus, uint8_t data)
+{
+	volatile uint32_t *reg = bus->reg;
+
+	if ((reg[I2C_SIM_REG_SR1] & I2C_SR1_SB) != 0) {
+		/* address frame */
+		reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_SB;
+		begin_frame(bus, PH_ADDR, data);
+	} else if (((reg[I2C_SIM_REG_SR2] & I2C_SR2_TRA) != 0)
+			&& ((reg[I2C_SIM_REG_SR1] & I2C_SR1_ADDR) == 0)) {
+		if (PH_WAIT == bus->phase) {
+			/* shift register empty: byte goes on the wire */
+			reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_BTF;
+			reg[I2C_SIM_REG_SR1] |= I2C_SR1_TxE;
+			begin_frame(bus, PH_TX, data);
+		} else {
+			/* byte waits in DR */
+			bus->dr_tx = data;
+			bus->dr_full = true;
+			reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_TxE;
+		}
+	}
+}
+
+
+/* Software reads DR */
+static uint8_t dr_read(sim_bus_t *bus)
+{
+	volatile uint32_t *reg = bus->reg;
+	uint8_t data = (uint8_t)reg[I2C_SIM_REG_DR];
+
+	reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_RxNE;
+
+	if (bus->shift_full) {
+		/* shift register moves to DR, SCL released */
+		bus->shift_full = false;
+		reg[I2C_SIM_REG_DR] = bus->shift;
+		reg[I2C_SIM_REG_SR1] |= I2C_SR1_RxNE;
+		reg[I2C_SIM_REG_SR1] &= ~I2C_SR1_BTF;
+		if ((PH_WAIT == bus->phase) && bus->device_sending && (bus->dev >= 0)) {
+			begin_frame(bus, PH_RX, dev_read(&sim_dev[bus->dev]));
+		}
+	}
+
+	return data;
+}
+
+
+/* Find a device on a bus */
+static int8_t dev_find(uint8_t bus_index, uint8_t address)
+{
+	int8_t i;
+
+	for (i = 0; i < SIM_DEV_NUM; i++) {
+		if (sim_dev[i].present && (sim_dev[i].bus == bus_index)
+		&& (sim_dev[i].address == (address & ~SIM_DEV_BLOCK_MASK))) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Device receives a byte: memory address first, then page data */
+static void dev_write(sim_dev_t *dev, uint8_t data)
+{
+	if (dev->addr_count < SIM_DEV_ADDR_BYTES) {
+		if (0 == dev->addr_count) {
+			/* the block select bits are the highest address bits */
+			dev->pointer = dev->block;
+		}
+		dev->pointer = ((dev->pointer << 8) | data) & (SIM_DEV_CAPACITY - 1);
+		dev->addr_count++;
+	} else {
+		if (0 == dev->data_count) {
+			dev->page_base = dev->pointer & ~(SIM_DEV_PAGE_SIZE - 1);
+			memset(dev->latch_used, 0, sizeof(dev->latch_used));
+		}
+		dev->latch[dev->pointer & (SIM_DEV_PAGE_SIZE - 1)] = data;
+		dev->latch_used[dev->pointer & (SIM_DEV_PAGE_SIZE - 1)] = true;
+		/* roll over inside the page */
+		dev->pointer = dev->page_base | ((dev->pointer + 1) & (SIM_DEV_PAGE_SIZE - 1));
+		dev->data_count++;
+	}
+}
+
+
+/* Device sends a byte: roll over at the end of the array */
+static uint8_t dev_read(sim_dev_t *dev)
+{
+	uint8_t data = dev->mem[dev->pointer];
+
+	dev->pointer = (dev->pointer + 1) & (SIM_DEV_CAPACITY - 1);
+
+	return data;
+}
+
+
+/* STOP: a write with data starts the internal write cycle */
+static void dev_stop(sim_dev_t *dev)
+{
+	uint32_t i;
+	uint32_t stored = 0;
+	uint32_t limit = SIM_DEV_PAGE_SIZE;
+
+	if (dev->writing && (dev->data_count > 0)) {
+		if (0 == dev->cut_countdown) {
+			/* power cut during this write cycle */
+			limit = dev->cut_torn ? (dev->data_count / 2) : 0;
+			dev->powered = false;
+		}
+		if (dev->cut_countdown >= 0) {
+			dev->cut_countdown--;
+		}
+		for (i = 0; (i < SIM_DEV_PAGE_SIZE) && (stored < limit); i++) {
+			if (dev->latch_used[i]) {
+				dev->mem[dev->page_base + i] = dev->latch[i];
+				stored++;
+			}
+		}
+		dev->busy_until_ns = sim_now_ns + sim_write_time_ns;
+		dev->wear[dev->page_base / SIM_DEV_PAGE_SIZE]++;
+		sim_bus[dev->bus].stats.write_cycles++;
+	}
+	dev->writing = false;
+	dev->data_count = 0;
+}
+
+
+
+
+/* Serve the I2C DMA requests of the enabled streams */
+static void dma_service(void)
+{
+	sim_dma_t *st;
+	sim_bus_t *bus;
+	volatile uint32_t *reg;
+	uint8_t i;
+
+	for (i = 0; i < SIM_DMA_STREAM_NUM; i++) {
+		st = &sim_dma[i];
+		if (!st->enabled || (st->bus < 0)) {
+			continue;
+		}
+		bus = &sim_bus[st->bus];
+		reg = bus->reg;
+		if ((reg[I2C_SIM_REG_CR2] & I2C_CR2_DMAEN) == 0) {
+			continue;
+		}
+		if (st->mem_to_periph) {
+			/* TxE request */
+			while ((st->ndtr > 0) && ((reg[I2C_SIM_REG_SR1] & I2C_SR1_TxE) != 0)
+			&& ((reg[I2C_SIM_REG_SR2] & I2C_SR2_TRA) != 0)
+			&& ((reg[I2C_SIM_REG_SR1] & I2C_SR1_ADDR) == 0)) {
+				dr_write(bus, *(uint8_t *)st->mar);
+				st->mar++;
+				st->ndtr--;
+			}
+		} else {
+			/* RxNE request */
+			while ((st->ndtr > 0) && ((reg[I2C_SIM_REG_SR1] & I2C_SR1_RxNE) != 0)) {
+				*(uint8_t *)st->mar = dr_read(bus);
+				st->mar++;
+				st->ndtr--;
+			}
+		}
+		if (0 == st->ndtr) {
+			st->enabled = false;
+			st->flags |= DMA_TCIF;
+		}
+	}
+}
+
+
+/* Receiver: the byte being received is the last one of the DMA transfer */
+static bool dma_last(sim_bus_t *bus)
+{
+	uint16_t pending = ((bus->reg[I2C_SIM_REG_SR1] & I2C_SR1_RxNE) != 0) ? 1 : 0;
+	uint8_t i;
+
+	if ((bus->reg[I2C_SIM_REG_CR2] & (I2C_CR2_DMAEN | I2C_CR2_LAST)) != (I2C_CR2_DMAEN | I2C_CR2_LAST)) {
+		return false;
+	}
+
+	for (i = 0; i < SIM_DMA_STREAM_NUM; i++) {
+		if (sim_dma[i].enabled && !sim_dma[i].mem_to_periph
+		&& (sim_dma[i].bus == (int8_t)(bus - sim_bus))
+		&& (sim_dma[i].ndtr == (uint16_t)(pending + 1))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/* Get a DMA1 stream */
+static sim_dma_t *find_dma(uint32_t dma, uint8_t stream)
+{
+	if ((dma != DMA1) || (stream >= SIM_DMA_STREAM_NUM)) {
+		fprintf(stderr, "i2c_sim: unsupported DMA stream\n");
+		abort();
+	}
+
+	return &sim_dma[stream];
+}
+
+
+
+
+/* Only TIM2 is simulated */
+static void tim_check(uint32_t timer_peripheral)
+{
+	if (timer_peripheral != TIM2) {
+		fprintf(stderr, "i2c_sim: unsupported timer\n");
+		abort();
+	}
+}
+
+
+/* Schedule the next TIM2 update event */
+static void tim_arm(void)
+{
+	if (sim_tim.enabled) {
+		sim_tim.event_ns = sim_now_ns
+				+ ((uint64_t)(sim_tim.psc + 1) * (sim_tim.arr + 1) * 1000000000ull) / SIM_TIM_CLOCK_HZ;
+	} else {
+		sim_tim.event_ns = SIM_NO_EVENT;
+	}
+}
+
+
+
+
+/* End of file */
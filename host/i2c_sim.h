@@ -0,0 +1,96 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * This file i2c_sim.h represents the header file of the host I2C simulator.
+ *
+ * The simulator stands in for the STM32F4 I2C peripherals at register level
+ * and for the 24C256 devices attached to them, so that the driver can run
+ * unchanged on a Linux host. Time is virtual: it advances with every
+ * register access (CPU time) and skips ahead, up to the next bus event,
+ * while the driver is idle.
+*/
+
+
+#ifndef _I2C_SIM_INCLUDED_
+#define _I2C_SIM_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Register identifiers */
+enum {
+	I2C_SIM_REG_CR1,
+	I2C_SIM_REG_CR2,
+	I2C_SIM_REG_OAR1,
+	I2C_SIM_REG_DR,
+	I2C_SIM_REG_SR1,
+	I2C_SIM_REG_SR2,
+	I2C_SIM_REG_CCR,
+	I2C_SIM_REG_TRISE,
+	I2C_SIM_REG_NUM
+};
+
+
+/* ------------- Exported types ------------- */
+
+/* Bus statistics */
+typedef struct {
+	uint32_t bit_times;			/* SCL periods, START and STOP count one each */
+	uint32_t starts;			/* START and repeated START conditions */
+	uint32_t stops;				/* STOP conditions */
+	uint32_t address_frames;	/* device address frames */
+	uint32_t data_bytes;		/* data frames in both directions */
+	uint32_t nacks;				/* frames not acknowledged */
+	uint32_t write_cycles;		/* internal write cycles started by devices */
+	uint32_t interrupts;		/* I2C event and error interrupts served */
+} i2c_sim_stats_t;
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void i2c_sim_init(void);
+extern void i2c_sim_attach(uint32_t, uint8_t);
+extern uint8_t *i2c_sim_memory(uint32_t, uint8_t);
+extern uint32_t i2c_sim_page_wear(uint32_t, uint8_t, uint16_t);
+extern void i2c_sim_power_cut(uint32_t, uint8_t, uint32_t, bool);
+extern void i2c_sim_power_restore(uint32_t, uint8_t);
+extern bool i2c_sim_powered(uint32_t, uint8_t);
+extern void i2c_sim_set_write_time(uint32_t);
+extern void i2c_sim_idle(void);
+extern uint64_t i2c_sim_time_ns(void);
+extern void i2c_sim_get_stats(uint32_t, i2c_sim_stats_t *);
+extern void i2c_sim_reset_stats(void);
+extern volatile uint32_t *i2c_sim_reg(uint32_t, uint8_t);
+
+
+
+
+#endif
+
+/* End of file */
@@ -0,0 +1,51 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/cm3/cortex.h: interrupt masking is
+ * honoured by the simulator interrupt dispatcher.
+*/
+
+
+#ifndef _HOST_CORTEX_INCLUDED_
+#define _HOST_CORTEX_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void cm_enable_interrupts(void);
+extern void cm_disable_interrupts(void);
+extern uint32_t cm_mask_interrupts(uint32_t);
+
+
+
+
+#endif
+
+/* End of file */
@@ -0,0 +1,50 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/cm3/dwt.h: the cycle counter follows the
+ * virtual time of the simulator at the AHB clock.
+*/
+
+
+#ifndef _HOST_DWT_INCLUDED_
+#define _HOST_DWT_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern bool dwt_enable_cycle_counter(void);
+extern uint32_t dwt_read_cycle_counter(void);
+
+
+
+
+#endif
+
+/* End of file */
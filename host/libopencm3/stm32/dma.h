@@ -0,0 +1,97 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/dma.h (STM32F4 stream DMA). Memory and
+ * peripheral addresses are host pointers, so they are passed as uintptr_t,
+ * which is uint32_t on the target.
+*/
+
+
+#ifndef _HOST_DMA_INCLUDED_
+#define _HOST_DMA_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Controllers */
+#define DMA1						0x40026000u
+#define DMA2						0x40026400u
+
+/* Streams */
+#define DMA_STREAM0					0
+#define DMA_STREAM1					1
+#define DMA_STREAM2					2
+#define DMA_STREAM3					3
+#define DMA_STREAM4					4
+#define DMA_STREAM5					5
+#define DMA_STREAM6					6
+#define DMA_STREAM7					7
+
+/* Stream configuration */
+#define DMA_SxCR_CHSEL_SHIFT		25
+#define DMA_SxCR_CHSEL_1			(1u << DMA_SxCR_CHSEL_SHIFT)
+#define DMA_SxCR_CHSEL_3			(3u << DMA_SxCR_CHSEL_SHIFT)
+#define DMA_SxCR_CHSEL_7			(7u << DMA_SxCR_CHSEL_SHIFT)
+#define DMA_SxCR_DIR_PERIPHERAL_TO_MEM	(0u << 6)
+#define DMA_SxCR_DIR_MEM_TO_PERIPHERAL	(1u << 6)
+#define DMA_SxCR_PL_HIGH			(2u << 16)
+#define DMA_SxCR_MSIZE_8BIT			(0u << 13)
+#define DMA_SxCR_PSIZE_8BIT			(0u << 11)
+
+/* Interrupt flags */
+#define DMA_TCIF					(1u << 5)
+#define DMA_TEIF					(1u << 3)
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void dma_stream_reset(uint32_t, uint8_t);
+extern void dma_channel_select(uint32_t, uint8_t, uint32_t);
+extern void dma_set_transfer_mode(uint32_t, uint8_t, uint32_t);
+extern void dma_set_priority(uint32_t, uint8_t, uint32_t);
+extern void dma_set_memory_size(uint32_t, uint8_t, uint32_t);
+extern void dma_set_peripheral_size(uint32_t, uint8_t, uint32_t);
+extern void dma_enable_memory_increment_mode(uint32_t, uint8_t);
+extern void dma_set_peripheral_address(uint32_t, uint8_t, uintptr_t);
+extern void dma_set_memory_address(uint32_t, uint8_t, uintptr_t);
+extern void dma_set_number_of_data(uint32_t, uint8_t, uint16_t);
+extern uint16_t dma_get_number_of_data(uint32_t, uint8_t);
+extern void dma_enable_transfer_complete_interrupt(uint32_t, uint8_t);
+extern void dma_enable_stream(uint32_t, uint8_t);
+extern void dma_disable_stream(uint32_t, uint8_t);
+extern bool dma_get_interrupt_flag(uint32_t, uint8_t, uint32_t);
+extern void dma_clear_interrupt_flags(uint32_t, uint8_t, uint32_t);
+
+
+
+
+#endif
+
+/* End of file */
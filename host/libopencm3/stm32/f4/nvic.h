@@ -0,0 +1,88 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/f4/nvic.h: enabled IRQs are dispatched
+ * by the simulator to the handlers below.
+*/
+
+
+#ifndef _HOST_NVIC_INCLUDED_
+#define _HOST_NVIC_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* IRQ numbers */
+#define NVIC_DMA1_STREAM0_IRQ	11
+#define NVIC_DMA1_STREAM1_IRQ	12
+#define NVIC_DMA1_STREAM2_IRQ	13
+#define NVIC_DMA1_STREAM3_IRQ	14
+#define NVIC_DMA1_STREAM4_IRQ	15
+#define NVIC_DMA1_STREAM5_IRQ	16
+#define NVIC_DMA1_STREAM6_IRQ	17
+#define NVIC_TIM2_IRQ			28
+#define NVIC_I2C1_EV_IRQ		31
+#define NVIC_I2C1_ER_IRQ		32
+#define NVIC_I2C2_EV_IRQ		33
+#define NVIC_I2C2_ER_IRQ		34
+#define NVIC_DMA1_STREAM7_IRQ	47
+#define NVIC_I2C3_EV_IRQ		72
+#define NVIC_I2C3_ER_IRQ		73
+#define NVIC_IRQ_COUNT			91
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void nvic_enable_irq(uint8_t);
+extern void nvic_disable_irq(uint8_t);
+
+/* Interrupt handlers (weak defaults in the simulator) */
+extern void tim2_isr(void);
+extern void i2c1_ev_isr(void);
+extern void i2c1_er_isr(void);
+extern void i2c2_ev_isr(void);
+extern void i2c2_er_isr(void);
+extern void i2c3_ev_isr(void);
+extern void i2c3_er_isr(void);
+extern void dma1_stream0_isr(void);
+extern void dma1_stream1_isr(void);
+extern void dma1_stream2_isr(void);
+extern void dma1_stream3_isr(void);
+extern void dma1_stream4_isr(void);
+extern void dma1_stream5_isr(void);
+extern void dma1_stream6_isr(void);
+extern void dma1_stream7_isr(void);
+
+
+
+
+#endif
+
+/* End of file */
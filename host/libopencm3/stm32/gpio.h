@@ -0,0 +1,95 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/gpio.h: output levels are kept by the
+ * simulator so that a host program can check the board LEDs.
+*/
+
+
+#ifndef _HOST_GPIO_INCLUDED_
+#define _HOST_GPIO_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Ports */
+#define GPIOA				0x40020000u
+#define GPIOB				0x40020400u
+#define GPIOC				0x40020800u
+#define GPIOD				0x40020C00u
+
+/* Pins */
+#define GPIO0				(1u << 0)
+#define GPIO1				(1u << 1)
+#define GPIO2				(1u << 2)
+#define GPIO3				(1u << 3)
+#define GPIO4				(1u << 4)
+#define GPIO5				(1u << 5)
+#define GPIO6				(1u << 6)
+#define GPIO7				(1u << 7)
+#define GPIO8				(1u << 8)
+#define GPIO9				(1u << 9)
+#define GPIO10				(1u << 10)
+#define GPIO11				(1u << 11)
+#define GPIO12				(1u << 12)
+#define GPIO13				(1u << 13)
+#define GPIO14				(1u << 14)
+#define GPIO15				(1u << 15)
+
+/* Modes, pull-ups, output types and speeds */
+#define GPIO_MODE_INPUT		0x0
+#define GPIO_MODE_OUTPUT	0x1
+#define GPIO_MODE_AF		0x2
+#define GPIO_MODE_ANALOG	0x3
+#define GPIO_PUPD_NONE		0x0
+#define GPIO_OTYPE_PP		0x0
+#define GPIO_OTYPE_OD		0x1
+#define GPIO_OSPEED_100MHZ	0x3
+
+/* Alternate functions */
+#define GPIO_AF4			0x4
+#define GPIO_AF9			0x9
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void gpio_set_af(uint32_t, uint8_t, uint16_t);
+extern void gpio_mode_setup(uint32_t, uint8_t, uint8_t, uint16_t);
+extern void gpio_set_output_options(uint32_t, uint8_t, uint8_t, uint16_t);
+extern void gpio_set(uint32_t, uint16_t);
+extern void gpio_clear(uint32_t, uint16_t);
+extern uint16_t gpio_get(uint32_t, uint16_t);
+
+
+
+
+#endif
+
+/* End of file */
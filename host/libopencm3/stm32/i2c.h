@@ -0,0 +1,136 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/i2c.h. Register accesses go through the
+ * simulator, which applies the hardware side effects (ADDR clearing sequence,
+ * rc_w0 flags, START/STOP generation) and advances the bus model.
+*/
+
+
+#ifndef _HOST_I2C_INCLUDED_
+#define _HOST_I2C_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Peripheral base addresses */
+#define I2C1				0x40005400u
+#define I2C2				0x40005800u
+#define I2C3				0x40005C00u
+
+/* Registers */
+#define I2C_CR1(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_CR1))
+#define I2C_CR2(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_CR2))
+#define I2C_OAR1(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_OAR1))
+#define I2C_DR(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_DR))
+#define I2C_SR1(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_SR1))
+#define I2C_SR2(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_SR2))
+#define I2C_CCR(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_CCR))
+#define I2C_TRISE(i2c_base)	(*i2c_sim_reg((i2c_base), I2C_SIM_REG_TRISE))
+
+/* CR1 bits */
+#define I2C_CR1_PE			(1u << 0)
+#define I2C_CR1_START		(1u << 8)
+#define I2C_CR1_STOP		(1u << 9)
+#define I2C_CR1_ACK			(1u << 10)
+#define I2C_CR1_POS			(1u << 11)
+#define I2C_CR1_SWRST		(1u << 15)
+
+/* CR2 bits */
+#define I2C_CR2_ITERREN		(1u << 8)
+#define I2C_CR2_ITEVTEN		(1u << 9)
+#define I2C_CR2_ITBUFEN		(1u << 10)
+#define I2C_CR2_DMAEN		(1u << 11)
+#define I2C_CR2_LAST		(1u << 12)
+
+/* SR1 bits */
+#define I2C_SR1_SB			(1u << 0)
+#define I2C_SR1_ADDR		(1u << 1)
+#define I2C_SR1_BTF			(1u << 2)
+#define I2C_SR1_ADD10		(1u << 3)
+#define I2C_SR1_STOPF		(1u << 4)
+#define I2C_SR1_RxNE		(1u << 6)
+#define I2C_SR1_TxE			(1u << 7)
+#define I2C_SR1_BERR		(1u << 8)
+#define I2C_SR1_ARLO		(1u << 9)
+#define I2C_SR1_AF			(1u << 10)
+#define I2C_SR1_OVR			(1u << 11)
+#define I2C_SR1_PECERR		(1u << 12)
+#define I2C_SR1_TIMEOUT		(1u << 14)
+#define I2C_SR1_SMBALERT	(1u << 15)
+
+/* SR2 bits */
+#define I2C_SR2_MSL			(1u << 0)
+#define I2C_SR2_BUSY		(1u << 1)
+#define I2C_SR2_TRA			(1u << 2)
+
+/* Transfer direction */
+#define I2C_WRITE			0
+#define I2C_READ			1
+
+/* Bus speeds */
+enum i2c_speeds {
+	i2c_speed_sm_100k,
+	i2c_speed_fm_400k,
+	i2c_speed_fmp_1m,
+	i2c_speed_unknown
+};
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void i2c_reset(uint32_t);
+extern void i2c_peripheral_enable(uint32_t);
+extern void i2c_peripheral_disable(uint32_t);
+extern void i2c_set_standard_mode(uint32_t);
+extern void i2c_set_fast_mode(uint32_t);
+extern void i2c_set_speed(uint32_t, enum i2c_speeds, uint32_t);
+extern void i2c_send_start(uint32_t);
+extern void i2c_send_stop(uint32_t);
+extern void i2c_send_7bit_address(uint32_t, uint8_t, uint8_t);
+extern void i2c_send_data(uint32_t, uint8_t);
+extern uint8_t i2c_get_data(uint32_t);
+extern void i2c_enable_interrupt(uint32_t, uint32_t);
+extern void i2c_disable_interrupt(uint32_t, uint32_t);
+extern void i2c_enable_ack(uint32_t);
+extern void i2c_disable_ack(uint32_t);
+extern void i2c_nack_next(uint32_t);
+extern void i2c_nack_current(uint32_t);
+extern void i2c_enable_dma(uint32_t);
+extern void i2c_disable_dma(uint32_t);
+extern void i2c_set_dma_last_transfer(uint32_t);
+extern void i2c_clear_dma_last_transfer(uint32_t);
+
+
+
+
+#endif
+
+/* End of file */
@@ -0,0 +1,92 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/rcc.h: clocks are accepted and ignored,
+ * the system clock setup only sets the bus frequencies.
+*/
+
+
+#ifndef _HOST_RCC_INCLUDED_
+#define _HOST_RCC_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Peripheral clock enable identifiers */
+enum rcc_periph_clken {
+	RCC_GPIOA,
+	RCC_GPIOB,
+	RCC_GPIOC,
+	RCC_GPIOD,
+	RCC_I2C1,
+	RCC_I2C2,
+	RCC_I2C3,
+	RCC_TIM2,
+	RCC_DMA1,
+	RCC_CRC
+};
+
+/* System clock configurations from the 8 MHz crystal */
+enum {
+	CLOCK_3V3_48MHZ,
+	CLOCK_3V3_120MHZ,
+	CLOCK_3V3_168MHZ,
+	CLOCK_3V3_END
+};
+
+
+/* ------------- Exported types ------------- */
+
+/* System clock configuration: the frequencies the drivers read */
+typedef struct {
+	uint32_t ahb_frequency;
+	uint32_t apb1_frequency;
+	uint32_t apb2_frequency;
+} clock_scale_t;
+
+
+/* ------------- Exported variables ------------- */
+
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+extern const clock_scale_t hse_8mhz_3v3[CLOCK_3V3_END];
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void rcc_periph_clock_enable(enum rcc_periph_clken);
+extern void rcc_clock_setup_hse_3v3(const clock_scale_t *);
+
+
+
+
+#endif
+
+/* End of file */
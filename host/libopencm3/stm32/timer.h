@@ -0,0 +1,75 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * Host stand-in for libopencm3/stm32/timer.h: TIM2 update events are
+ * generated on the virtual time line of the simulator.
+*/
+
+
+#ifndef _HOST_TIMER_INCLUDED_
+#define _HOST_TIMER_INCLUDED_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_sim.h"
+
+
+/* ------------- Exported definitions ------------- */
+
+/* Timers */
+#define TIM2				0x40000000u
+
+/* CR1 settings */
+#define TIM_CR1_CKD_CK_INT	(0u << 8)
+#define TIM_CR1_CMS_EDGE	(0u << 5)
+#define TIM_CR1_DIR_UP		(0u << 4)
+
+/* Interrupts and flags */
+#define TIM_DIER_UIE		(1u << 0)
+#define TIM_SR_UIF			(1u << 0)
+
+
+/* ------------ Exported functions prototypes -------------- */
+
+extern void timer_reset(uint32_t);
+extern void timer_set_mode(uint32_t, uint32_t, uint32_t, uint32_t);
+extern void timer_set_prescaler(uint32_t, uint32_t);
+extern void timer_disable_preload(uint32_t);
+extern void timer_continuous_mode(uint32_t);
+extern void timer_set_period(uint32_t, uint32_t);
+extern void timer_enable_counter(uint32_t);
+extern void timer_disable_counter(uint32_t);
+extern void timer_enable_irq(uint32_t, uint32_t);
+extern void timer_disable_irq(uint32_t, uint32_t);
+extern bool timer_get_flag(uint32_t, uint32_t);
+extern void timer_clear_flag(uint32_t, uint32_t);
+
+
+
+
+#endif
+
+/* End of file */
@@ -0,0 +1,262 @@
+/*
+* The MIT License (MIT)
+*
+* Copyright (c) 2015 Marco Russi
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/*
+ * This file mkimage.c builds the factory image of the EEPROM on a Linux
+ * host: the factory items and key/value entries are written by the
+ * driver itself to a simulated device, whose array is then saved as the
+ * binary image burnt by the programmer.
+ *
+ *   eeprom_mkimage [-i ITEM FILE]... [-k KEY HEX]... -o IMAGE
+ *
+ * ITEM is serial, board or calibration; a FILE shorter than the item is
+ * padded with zeros. KEY is a key/value store key, HEX its value.
+*/
+
+
+/* ---------------- Inclusions ----------------- */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_sim.h"
+#include "rtos.h"
+#include "eeprom.h"
+#include "eeprom_kv.h"
+#include "eeprom_layout.h"
+#include <libopencm3/stm32/i2c.h>
+
+
+
+
+/* ---------------- Local Defines ----------------- */
+
+/* Simulated device */
+#define SIM_EEPROM_ADDRESS		0x50
+
+/* Largest factory item */
+#define ITEM_SIZE_MAX			1024
+
+
+
+
+/* ----------- Local variables declaration ------------- */
+
+/* Item names, by item index */
+static const char *const item_names[EEPROM_LAYOUT_ITEMS] = {
+	"serial",
+	"board",
+	"calibration"
+};
+
+/* RTOS states: no tasks, the driver is used by blocking calls only */
+static void (*no_task_ptr_array[])(void) = {
+	NULL
+};
+
+rtos_state_t * const rtos_cfg_states_array[RTOS_CFG_KE_STATE_MAX_NUM] = {
+	no_task_ptr_array,
+	no_task_ptr_array,
+	no_task_ptr_array
+};
+
+
+
+
+/* ----------- Local functions prototypes ------------- */
+
+static void usage(void);
+static bool write_item(const char *, const char *);
+static bool write_key(bool *, const char *, const char *);
+static bool save_image(const char *);
+
+
+
+
+/* ------------- Exported functions implementation --------------- */
+
+int main(int argc, char **argv)
+{
+	const char *image_name = NULL;
+	bool kv_formatted = false;
+	bool ok = true;
+	int i;
+
+	i2c_sim_init();
+	eeprom_init();
+
+	for (i = 1; ok && (i < argc); i++) {
+		if ((strcmp(argv[i], "-i") == 0) && ((i + 2) < argc)) {
+			ok = write_item(argv[i + 1], argv[i + 2]);
+			i += 2;
+		} else if ((strcmp(argv[i], "-k") == 0) && ((i + 2) < argc)) {
+			ok = write_key(&kv_formatted, argv[i + 1], argv[i + 2]);
+			i += 2;
+		} else if ((strcmp(argv[i], "-o") == 0) && ((i + 1) < argc)) {
+			image_name = argv[i + 1];
+			i++;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (!ok) {
+		return 1;
+	}
+	if (NULL == image_name) {
+		usage();
+		return 2;
+	}
+
+	ok = ok && eeprom_wait_ready() && save_image(image_name);
+
+	return ok ? 0 : 1;
+}
+
+
+
+
+/* ------------ Local functions implementation -------------- */
+
+/* Print the command line */
+static void usage(void)
+{
+	fprintf(stderr, "usage: eeprom_mkimage [-i ITEM FILE]... [-k KEY HEX]... -o IMAGE\n");
+	fprintf(stderr, "  ITEM: serial, board or calibration\n");
+}
+
+
+/* Write a factory item from a file, padded with zeros, and verify it as
+ * the firmware does */
+static bool write_item(const char *name, const char *file_name)
+{
+	static uint8_t data[ITEM_SIZE_MAX];
+	FILE *file;
+	size_t length;
+	uint8_t item;
+
+	for (item = 0; item < EEPROM_LAYOUT_ITEMS; item++) {
+		if (strcmp(name, item_names[item]) == 0) {
+			break;
+		}
+	}
+	if ((EEPROM_LAYOUT_ITEMS == item) || (eeprom_layout_items[item].size > sizeof(data))) {
+		fprintf(stderr, "eeprom_mkimage: unknown item %s\n", name);
+		return false;
+	}
+
+	file = fopen(file_name, "rb");
+	if (NULL == file) {
+		perror(file_name);
+		return false;
+	}
+	memset(data, 0, sizeof(data));
+	length = fread(data, 1, sizeof(data), file);
+	fclose(file);
+	if (length > eeprom_layout_items[item].size) {
+		fprintf(stderr, "eeprom_mkimage: %s: %u bytes, %s holds %u\n", file_name, (unsigned)length,
+				name, (unsigned)eeprom_layout_items[item].size);
+		return false;
+	}
+
+	if (!eeprom_layout_write(item, data, eeprom_layout_items[item].size)
+	|| !eeprom_wait_ready() || !eeprom_layout_verify(item)) {
+		fprintf(stderr, "eeprom_mkimage: %s not written\n", name);
+		return false;
+	}
+	printf("%-12s 0x%05X %5u bytes + CRC\n", name, (unsigned)eeprom_layout_items[item].address,
+			(unsigned)eeprom_layout_items[item].size);
+
+	return true;
+}
+
+
+/* Set a key of the key/value store, formatted by the first key */
+static bool write_key(bool *formatted_ptr, const char *key_text, const char *hex_text)
+{
+	uint8_t value[EEPROM_KV_VALUE_MAX];
+	unsigned long key;
+	unsigned int byte;
+	size_t length = strlen(hex_text) / 2;
+	size_t i;
+	char *end_ptr;
+
+	key = strtoul(key_text, &end_ptr, 0);
+	if ((*end_ptr != '\0') || (key >= EEPROM_KV_KEYS)
+	|| ((strlen(hex_text) % 2) != 0) || (0 == length) || (length > sizeof(value))) {
+		fprintf(stderr, "eeprom_mkimage: bad key %s = %s\n", key_text, hex_text);
+		return false;
+	}
+	for (i = 0; i < length; i++) {
+		if (sscanf(&hex_text[2 * i], "%2x", &byte) != 1) {
+			fprintf(stderr, "eeprom_mkimage: bad value %s\n", hex_text);
+			return false;
+		}
+		value[i] = (uint8_t)byte;
+	}
+
+	if (!*formatted_ptr) {
+		if (!eeprom_kv_format()) {
+			fprintf(stderr, "eeprom_mkimage: key/value store not formatted\n");
+			return false;
+		}
+		*formatted_ptr = true;
+	}
+	if (!eeprom_kv_set((uint8_t)key, value, (uint8_t)length)) {
+		fprintf(stderr, "eeprom_mkimage: key %lu not set\n", key);
+		return false;
+	}
+	printf("key %-8lu %5u bytes\n", key, (unsigned)length);
+
+	return true;
+}
+
+
+/* Save the device array */
+static bool save_image(const char *image_name)
+{
+	FILE *file = fopen(image_name, "wb");
+	bool ok;
+
+	if (NULL == file) {
+		perror(image_name);
+		return false;
+	}
+	ok = (fwrite(i2c_sim_memory(I2C1, SIM_EEPROM_ADDRESS), 1, EEPROM_SIZE, file) == EEPROM_SIZE);
+	ok = (fclose(file) == 0) && ok;
+	if (ok) {
+		printf("%s: %u bytes\n", image_name, (unsigned)EEPROM_SIZE);
+	}
+
+	return ok;
+}
+
+
+
+
+/* End of file */
@@ -63,6 +63,9 @@ int main(void)
 	while (1) {
 		/* call RTOS */
 		rtos_execute_task();
+
+		/* idle until the next check */
+		RTOS_CFG_IDLE_HOOK();
 	}
 
 	return 0;
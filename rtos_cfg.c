@@ -39,6 +39,10 @@
 #include <stdint.h>
 #include "rtos_cfg.h"		/* component RTOS configuration header file */
 #include "eeprom.h"			/* EEPROM module */
+#include "eeprom_cache.h"	/* EEPROM write-back cache */
+#include "eeprom_queue.h"	/* EEPROM write coalescing queue */
+#include "eeprom_sched.h"	/* EEPROM request scheduler */
+#include "eeprom_txn.h"		/* EEPROM atomic transactions */
 #include "test.h"			/* TEST module */
 
 
@@ -49,6 +53,10 @@
 /* INIT state tasks */
 static void (*init_state_ptr_array[])(void) = {
 	&eeprom_init,
+	&eeprom_txn_init,
+	&eeprom_cache_init,
+	&eeprom_queue_init,
+	&eeprom_sched_init,
 	&test_init,
 	NULL
 };
@@ -57,6 +65,7 @@ static void (*init_state_ptr_array[])(void) = {
 /* NORMAL state tasks */
 static void (*normal_state_ptr_array[])(void) = {
 	&test_task,
+	&eeprom_cache_task,
 	NULL
 };
 
@@ -47,6 +47,17 @@ enum {
 	RTOS_CFG_KE_STATE_MAX_NUM
 };
 
+/* Callback timers reserved by the components */
+#define RTOS_CFG_CB_ID_EEPROM		RTOS_CB_ID_1	/* EEPROM write cycle wait */
+#define RTOS_CFG_CB_ID_EEPROM_QUEUE	RTOS_CB_ID_2	/* EEPROM write queue flush */
+#define RTOS_CFG_CB_ID_EEPROM_SCHED	RTOS_CB_ID_3	/* EEPROM request scheduler */
+
+/* Called by the main loop between two task checks: nothing on the board,
+ * the simulator time on the host build */
+#ifndef RTOS_CFG_IDLE_HOOK
+#define RTOS_CFG_IDLE_HOOK()
+#endif
+
 
 /*==============================================================================
     Exported Types
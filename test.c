@@ -37,6 +37,8 @@
 #include "rtos.h"
 /* EEPROM driver */
 #include "eeprom.h"
+/* EEPROM factory data */
+#include "eeprom_layout.h"
 
 
 
@@ -47,6 +49,11 @@
 #define EEPROM_TEST_PAGE_START_ADD			(0x0004)
 /* EEPROM test byte address*/
 #define EEPROM_TEST_BYTE_ADD				(0x0101)
+/* EEPROM test block start address and size: it spans several pages */
+#define EEPROM_TEST_BLOCK_START_ADD			(0x0210)
+#define EEPROM_TEST_BLOCK_SIZE				(200)
+/* EEPROM test block byte changed for the compare test */
+#define EEPROM_TEST_COMPARE_DIFF			(150)
 
 
 
@@ -57,10 +64,15 @@
 enum
 {
 	EEP_TEST_START,
-	EEP_TEST_WRITE_BYTE = EEP_TEST_START,
+	EEP_TEST_VERIFY_LAYOUT = EEP_TEST_START,
+	EEP_TEST_WRITE_BYTE,
 	EEP_TEST_READ_BYTE,
 	EEP_TEST_WRITE_PAGE,
 	EEP_TEST_READ_PAGE,
+	EEP_TEST_WRITE_BLOCK,
+	EEP_TEST_WAIT_BLOCK,
+	EEP_TEST_READ_BLOCK,
+	EEP_TEST_COMPARE_BLOCK,
 	EEP_TEST_END_SUCCESS,
 	EEP_TEST_END_FAIL
 };
@@ -73,6 +85,12 @@ enum
 /* Store EEPROM test current state */
 uint16_t eeprom_test_state = EEP_TEST_START;
 
+/* Block written in background and its final status */
+static uint8_t eeprom_test_block[EEPROM_TEST_BLOCK_SIZE];
+static volatile uint8_t eeprom_test_block_status = EEPROM_ST_IDLE;
+
+static void test_block_done(uint8_t);
+
 
 
 
@@ -107,12 +125,23 @@ void test_task(void)
 	uint8_t test_buffer[22] = {'T','H','I','S','_','I','S','_',
 							'A','N','_','E','E','P','R','O','M',
 							'_','T','E','S','T'};
-	uint8_t test_buffer_back[22] = {0,0,0,0,0,0,0,0,0,0,0,0,
-									0,0,0,0,0,0,0,0,0,0};
+	uint16_t test_offset;
+	uint16_t test_index;
 
 	/* manage next state */
 	switch (eeprom_test_state)
 	{
+	case EEP_TEST_VERIFY_LAYOUT:
+	{
+		/* factory data burnt by the programmer: verify it, do not write it */
+		if (true == eeprom_layout_verify_all()) {
+			/* set blue LED */
+			gpio_set(GPIOD, GPIO15);
+		}
+		/* go on with the byte test anyway: the board may be unprovisioned */
+		eeprom_test_state = EEP_TEST_WRITE_BYTE;
+		break;
+	}
 	case EEP_TEST_WRITE_BYTE:
 	{
 		/* write the test byte to EEPROM */
@@ -157,12 +186,12 @@ void test_task(void)
 	}
 	case EEP_TEST_READ_PAGE:
 	{
-		/* read back the test byte from EEPROM */
-		if (true == eeprom_read_page(EEPROM_TEST_PAGE_START_ADD, test_buffer_back, 22)) {
+		/* compare the page with the test buffer while it is read */
+		if (true == eeprom_compare_block(EEPROM_TEST_PAGE_START_ADD, test_buffer, 22, &test_offset)) {
 			/* read success */
-			if (memcmp(test_buffer, test_buffer_back, 22) == 0) {
-				/* data is valid, EEPROM is fine */
-				eeprom_test_state = EEP_TEST_END_SUCCESS;
+			if (22 == test_offset) {
+				/* data is valid: go on with block test */
+				eeprom_test_state = EEP_TEST_WRITE_BLOCK;
 			} else {
 				/* data is not valid: EEPROM fail */
 				eeprom_test_state = EEP_TEST_END_FAIL;
@@ -173,6 +202,80 @@ void test_task(void)
 		}
 		break;
 	}
+	case EEP_TEST_WRITE_BLOCK:
+	{
+		/* fill the block with a known pattern */
+		for (test_index = 0; test_index < EEPROM_TEST_BLOCK_SIZE; test_index++) {
+			eeprom_test_block[test_index] = (uint8_t)(test_index ^ 0xA5);
+		}
+		/* start writing the block: the write cycles are waited in background */
+		eeprom_test_block_status = EEPROM_ST_BUSY;
+		if (true == eeprom_write_block_async(EEPROM_TEST_BLOCK_START_ADD, eeprom_test_block,
+											EEPROM_TEST_BLOCK_SIZE, &test_block_done)) {
+			/* write started, wait for its end */
+			eeprom_test_state = EEP_TEST_WAIT_BLOCK;
+		} else {
+			/* write fail, EEPROM test fail */
+			eeprom_test_state = EEP_TEST_END_FAIL;
+		}
+		break;
+	}
+	case EEP_TEST_WAIT_BLOCK:
+	{
+		/* the other tasks keep running meanwhile */
+		if (EEPROM_ST_DONE == eeprom_test_block_status) {
+			/* write success, go on to read back */
+			eeprom_test_state = EEP_TEST_READ_BLOCK;
+		} else if (EEPROM_ST_BUSY != eeprom_test_block_status) {
+			/* write fail, EEPROM test fail */
+			eeprom_test_state = EEP_TEST_END_FAIL;
+		} else {
+			/* still writing */
+		}
+		break;
+	}
+	case EEP_TEST_READ_BLOCK:
+	{
+		/* read back the block from EEPROM */
+		memset(eeprom_test_block, 0, EEPROM_TEST_BLOCK_SIZE);
+		if (true == eeprom_read_block(EEPROM_TEST_BLOCK_START_ADD, eeprom_test_block, EEPROM_TEST_BLOCK_SIZE)) {
+			/* read success, check data validity */
+			eeprom_test_state = EEP_TEST_COMPARE_BLOCK;
+			for (test_index = 0; test_index < EEPROM_TEST_BLOCK_SIZE; test_index++) {
+				if (eeprom_test_block[test_index] != (uint8_t)(test_index ^ 0xA5)) {
+					/* data is not valid: EEPROM fail */
+					eeprom_test_state = EEP_TEST_END_FAIL;
+				}
+			}
+		} else {
+			/* read fail, EEPROM test fail */
+			eeprom_test_state = EEP_TEST_END_FAIL;
+		}
+		break;
+	}
+	case EEP_TEST_COMPARE_BLOCK:
+	{
+		/* the block holds the pattern read back: compare it with the device,
+		 * then with one byte changed, which shall be found */
+		if ((true == eeprom_compare_block(EEPROM_TEST_BLOCK_START_ADD, eeprom_test_block,
+										  EEPROM_TEST_BLOCK_SIZE, &test_offset))
+		&& (EEPROM_TEST_BLOCK_SIZE == test_offset)) {
+			eeprom_test_block[EEPROM_TEST_COMPARE_DIFF] ^= 0xFF;
+			if ((true == eeprom_compare_block(EEPROM_TEST_BLOCK_START_ADD, eeprom_test_block,
+											  EEPROM_TEST_BLOCK_SIZE, &test_offset))
+			&& (EEPROM_TEST_COMPARE_DIFF == test_offset)) {
+				/* data is valid and differences are found: EEPROM test success */
+				eeprom_test_state = EEP_TEST_END_SUCCESS;
+			} else {
+				/* difference not found: EEPROM test fail */
+				eeprom_test_state = EEP_TEST_END_FAIL;
+			}
+		} else {
+			/* read fail or data not valid: EEPROM test fail */
+			eeprom_test_state = EEP_TEST_END_FAIL;
+		}
+		break;
+	}
 	case EEP_TEST_END_SUCCESS:
 	{
 		/* set green LED */
@@ -195,6 +298,17 @@ void test_task(void)
 
 
 
+/* --------------- Local functions ------------- */
+
+/* Block write completion (I2C interrupt) */
+static void test_block_done(uint8_t status)
+{
+	eeprom_test_block_status = status;
+}
+
+
+
+
 /* End of file */
 
 